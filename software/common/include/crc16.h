@@ -0,0 +1,29 @@
+/**
+ * Bitwise CRC-16, as used to check firmware images.
+ *
+ * Polynomial x^16 + x^12 + x^5 + 1 (0x1021), initial value 0x0000, no reflection (CRC-16/XMODEM).
+ * Matches _crc_xmodem_update from avr-libc, which the bootloader uses.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Update a CRC with a single byte.
+ *
+ * @param crc  The current CRC value, 0 to start a new CRC
+ * @param data The byte to add to the CRC
+ * @return The updated CRC value
+ */
+uint16_t crc16_update(uint16_t crc, uint8_t data);
+
+/**
+ * Update a CRC with a buffer of bytes.
+ *
+ * @param crc The current CRC value, 0 to start a new CRC
+ * @param buf The bytes to add to the CRC
+ * @param len The number of bytes
+ * @return The updated CRC value
+ */
+uint16_t crc16_update_buf(uint16_t crc, const uint8_t *buf, uint32_t len);
@@ -0,0 +1,28 @@
+/**
+ * Table-driven CRC-8, as used for SMBus Packet Error Checking (PEC).
+ *
+ * Polynomial x^8 + x^2 + x + 1 (0x07), initial value 0x00, no reflection.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Update a CRC with a single byte.
+ *
+ * @param crc  The current CRC value, 0 to start a new CRC
+ * @param data The byte to add to the CRC
+ * @return The updated CRC value
+ */
+uint8_t crc8_update(uint8_t crc, uint8_t data);
+
+/**
+ * Update a CRC with a buffer of bytes.
+ *
+ * @param crc The current CRC value, 0 to start a new CRC
+ * @param buf The bytes to add to the CRC
+ * @param len The number of bytes
+ * @return The updated CRC value
+ */
+uint8_t crc8_update_buf(uint8_t crc, const uint8_t *buf, uint32_t len);
@@ -56,8 +56,32 @@ struct i2c_msg {
  */
 enum i2c_error {
   I2C_ERR = 1,
+
+  /** Another controller won arbitration, the transfer can be retried */
+  I2C_ERR_ARBLOST,
+
+  /** The bus did not become free in time */
+  I2C_ERR_BUSY,
+
+  /** Packet Error Checking failed, the data was corrupted on the bus */
+  I2C_ERR_PEC,
 };
 
+/**
+ * Number of times a transfer is retried after losing arbitration to another controller.
+ */
+#define I2C_ARBLOST_RETRIES     8
+
+/**
+ * Number of times a block read is retried after a PEC mismatch.
+ */
+#define I2C_PEC_RETRIES         3
+
+/**
+ * Maximum length of a block transfer, in bytes.
+ */
+#define I2C_BLOCK_MAX           128
+
 /**
  * Initialize the I2C bus as a controller.
  *
@@ -70,6 +94,9 @@ int i2c_configure(uint8_t mode);
  * Send one or more messages on the I2C bus, in a single transfer.
  * STOP is issued to terminate the operation; each message begins with a START.
  *
+ * The bus may be shared with other controllers. Transfers wait for the bus to be free
+ * before starting, and are retried from the beginning if arbitration is lost.
+ *
  * @param addr     7-bit I2C address
  * @param msgs     Array of messages to send
  * @param num_msgs Number of messages to send
@@ -231,6 +258,66 @@ static inline int i2c_reg_write_word(uint8_t addr, uint8_t reg, uint16_t value)
   return i2c_write(addr, buf, 3);
 }
 
+/**
+ * Read a block of registers from an I2C device, starting at the specified register address.
+ *
+ * @param addr 7-bit I2C address of the target device
+ * @param reg Register address to start reading from
+ * @param buf Buffer to store the read data
+ * @param len Number of bytes to read
+ * @return 0 if successful, negative error code otherwise
+ */
+static inline int i2c_reg_read_block(uint8_t addr, uint8_t reg, uint8_t *buf, uint32_t len)
+{
+  return i2c_write_read(addr, &reg, 1, buf, len);
+}
+
+/**
+ * Read a block of registers from an I2C device, with SMBus Packet Error Checking.
+ *
+ * The controller writes the register address and the block length, then reads the block
+ * followed by a PEC byte covering the whole transaction. Reads that fail the PEC check are
+ * counted, and retried up to I2C_PEC_RETRIES times.
+ *
+ * @param addr 7-bit I2C address of the target device
+ * @param reg Register address to start reading from
+ * @param buf Buffer to store the read data
+ * @param len Number of bytes to read, up to I2C_BLOCK_MAX
+ * @return 0 if successful, negative error code otherwise
+ */
+int i2c_reg_read_block_pec(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len);
+
+/**
+ * Write a block of registers to an I2C device, with SMBus Packet Error Checking.
+ *
+ * The register address and data are followed by a PEC byte covering the whole transaction.
+ * The target is responsible for discarding writes that fail the PEC check.
+ *
+ * @param addr 7-bit I2C address of the target device
+ * @param reg Register address to start writing to
+ * @param buf Data to write
+ * @param len Number of bytes to write, up to I2C_BLOCK_MAX
+ * @return 0 if successful, negative error code otherwise
+ */
+int i2c_reg_write_block_pec(uint8_t addr, uint8_t reg, const uint8_t *buf, uint8_t len);
+
+/**
+ * Get the number of PEC mismatches detected by i2c_reg_read_block_pec.
+ */
+uint32_t i2c_get_pec_errors();
+
+/**
+ * Get the number of transfers that failed, saturating at 65535.
+ *
+ * A transfer retried after losing arbitration is only counted once, if it fails in the end.
+ */
+uint16_t i2c_get_errors();
+
+/**
+ * Reset the count of failed transfers to 0.
+ */
+void i2c_clear_errors();
+
 /**
  * Perform a read/modify/write operation on a single byte register of an I2C device.
  *
@@ -38,8 +38,8 @@ bool ina700_is_present(uint8_t addr);
 // Get the measured bus voltage, in mV
 int ina700_get_bus_voltage(uint8_t addr, uint16_t *voltage);
 
-// Get the die temperature, in mC
-int ina700_get_temp(uint8_t addr, uint16_t *temp);
+// Get the die temperature, in degrees C
+int ina700_get_temp(uint8_t addr, float *temp);
 
 // Get the measured current, in mA
 int ina700_get_current(uint8_t addr, uint16_t *current);
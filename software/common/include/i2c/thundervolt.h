@@ -6,6 +6,9 @@
 // I2C target mode address
 #define THUNDERVOLT_I2C_ADDR            0x48
 
+// I2C address of the on-board TMP1075
+#define THUNDERVOLT_ADDR_TMP            0x49
+
 // I2C target mode registers
 #define THUNDERVOLT_REG_CONFIG          0x00 // Configuration register (RW)
 #define THUNDERVOLT_REG_STATUS          0x01 // Status register (R)
@@ -20,16 +23,193 @@
 #define THUNDERVOLT_REG_OTSD_TEMP       0x0A // Over-temperature shutdown temperature (RW)
 #define THUNDERVOLT_REG_HWREV           0x0B // Hardware revision (R)
 #define THUNDERVOLT_REG_SWREV           0x0C // Software revision (R)
-#define THUNDERVOLT_NUM_REGISTERS       0x0D // Number of registers
+#define THUNDERVOLT_REG_WINDOW          0x0D // Register window select (RW)
+#define THUNDERVOLT_REG_TELEM_PERIOD    0x0E // Telemetry sample period, in 10ms units, 0 to disable (RW)
+#define THUNDERVOLT_REG_TELEM_SAMPLES   0x0F // Telemetry samples per history record (RW)
+#define THUNDERVOLT_REG_HIST_COUNT      0x10 // Number of history records available (R)
+#define THUNDERVOLT_REG_HIST_POP        0x11 // Discard the oldest N history records (W)
+#define THUNDERVOLT_REG_BUS_CTRL        0x12 // I2C bus control (RW)
+#define THUNDERVOLT_REG_U10_DELAY       0x13 // U10 hold time after regulator power-good, in ms (RW)
+#define THUNDERVOLT_REG_OTSD_CTRL       0x14 // Over-temperature shutdown sensor configuration (RW)
+#define THUNDERVOLT_REG_OTSD_LATENCY_L  0x15 // Worst-case over-temperature shutdown latency, in ms [7:0] (R)
+#define THUNDERVOLT_REG_OTSD_LATENCY_H  0x16 // Worst-case over-temperature shutdown latency, in ms [15:8] (R)
+#define THUNDERVOLT_REG_GOV_MARGIN      0x17 // Thermal governor margin below the OTSD temperature, in degrees C (RW)
+#define THUNDERVOLT_REG_THROTTLE        0x18 // Thermal governor throttle step, 0 when not throttling (R)
+#define THUNDERVOLT_REG_AVP_GAIN_1V0    0x19 // 1.0V rail load-line gain, in mV/A, 0 to disable (RW)
+#define THUNDERVOLT_REG_AVP_GAIN_1V15   0x1A // 1.15V rail load-line gain, in mV/A, 0 to disable (RW)
+#define THUNDERVOLT_REG_AVP_GAIN_1V8    0x1B // 1.8V rail load-line gain, in mV/A, 0 to disable (RW)
+#define THUNDERVOLT_REG_AVP_GAIN_3V3    0x1C // 3.3V rail load-line gain, in mV/A, 0 to disable (RW)
+#define THUNDERVOLT_REG_CAL_CTRL        0x1D // Setpoint calibration control (RW)
+#define THUNDERVOLT_REG_CAL_OFFSET_1V0  0x1E // 1.0V rail calibration offset at stock voltage, in mV (int8, R)
+#define THUNDERVOLT_REG_CAL_OFFSET_1V15 0x1F // 1.15V rail calibration offset at stock voltage, in mV (int8, R)
+#define THUNDERVOLT_REG_CAL_OFFSET_1V8  0x20 // 1.8V rail calibration offset at stock voltage, in mV (int8, R)
+#define THUNDERVOLT_REG_CAL_OFFSET_3V3  0x21 // 3.3V rail calibration offset at stock voltage, in mV (int8, R)
+#define THUNDERVOLT_REG_CAL_GAIN_1V0    0x22 // 1.0V rail calibration gain error, in 1/1000 (int8, R)
+#define THUNDERVOLT_REG_CAL_GAIN_1V15   0x23 // 1.15V rail calibration gain error, in 1/1000 (int8, R)
+#define THUNDERVOLT_REG_CAL_GAIN_1V8    0x24 // 1.8V rail calibration gain error, in 1/1000 (int8, R)
+#define THUNDERVOLT_REG_CAL_GAIN_3V3    0x25 // 3.3V rail calibration gain error, in 1/1000 (int8, R)
+#define THUNDERVOLT_REG_MODE_CTRL       0x26 // Regulator mode policy, 2 bits per rail (RW)
+#define THUNDERVOLT_REG_FPWM_TH_1V0     0x27 // 1.0V rail forced PWM threshold, in 20mA units (RW)
+#define THUNDERVOLT_REG_FPWM_TH_1V15    0x28 // 1.15V rail forced PWM threshold, in 20mA units (RW)
+#define THUNDERVOLT_REG_FPWM_TH_1V8     0x29 // 1.8V rail forced PWM threshold, in 20mA units (RW)
+#define THUNDERVOLT_REG_FPWM_TH_3V3     0x2A // 3.3V rail forced PWM threshold, in 20mA units (RW)
+#define THUNDERVOLT_REG_MODE_STATUS     0x2B // Rails running in forced PWM, 1 bit per rail (R)
+#define THUNDERVOLT_REG_SUPPLY_L        0x2C // ATtiny supply voltage (VDD), in mV [7:0] (R)
+#define THUNDERVOLT_REG_SUPPLY_H        0x2D // ATtiny supply voltage (VDD), in mV [15:8] (R)
+#define THUNDERVOLT_REG_BATT_L          0x2E // Battery voltage reported by the host, in mV, 0 if unknown [7:0] (RW)
+#define THUNDERVOLT_REG_BATT_H          0x2F // Battery voltage reported by the host, in mV [15:8], applied when written (RW)
+#define THUNDERVOLT_REG_BATT_SOC        0x30 // Estimated battery state of charge, in percent, 0xFF if unknown (R)
+#define THUNDERVOLT_REG_BATT_LOW_TH     0x31 // Low battery threshold, in 20mV units, 0 to disable (RW)
+#define THUNDERVOLT_REG_BATT_OFS_1V0    0x32 // 1.0V rail offset on low battery, in mV (int8, RW)
+#define THUNDERVOLT_REG_BATT_OFS_1V15   0x33 // 1.15V rail offset on low battery, in mV (int8, RW)
+#define THUNDERVOLT_REG_BATT_OFS_1V8    0x34 // 1.8V rail offset on low battery, in mV (int8, RW)
+#define THUNDERVOLT_REG_BATT_OFS_3V3    0x35 // 3.3V rail offset on low battery, in mV (int8, RW)
+#define THUNDERVOLT_REG_PROFILE_SELECT  0x36 // Active voltage profile, 0xFF if none (RW)
+#define THUNDERVOLT_REG_PROFILE_SAVE    0x37 // Save the active settings to a voltage profile slot (W)
+#define THUNDERVOLT_REG_BOOTLOADER      0x38 // Write THUNDERVOLT_BOOT_ENTER to hand over to the bootloader (W)
+#define THUNDERVOLT_REG_COUNTERS_CLEAR  0x39 // Reset the performance counters (W)
+#define THUNDERVOLT_REG_HEALTH_1V0      0x3A // 1.0V regulator latched faults, write 1s to clear (RW)
+#define THUNDERVOLT_REG_HEALTH_1V15     0x3B // 1.15V regulator latched faults, write 1s to clear (RW)
+#define THUNDERVOLT_REG_HEALTH_1V8      0x3C // 1.8V regulator latched faults, write 1s to clear (RW)
+#define THUNDERVOLT_REG_HEALTH_3V3      0x3D // 3.3V regulator latched faults, write 1s to clear (RW)
+#define THUNDERVOLT_NUM_REGISTERS       0x3E // Number of registers
+
+// Live registers, read directly from the firmware state (R)
+#define THUNDERVOLT_REG_PEC_ERRORS      0x70 // Number of writes discarded due to a PEC mismatch, wrapping
+
+// Register window, maps the data selected by the WINDOW register (R)
+#define THUNDERVOLT_REG_WINDOW_BASE     0x80
+#define THUNDERVOLT_WINDOW_SIZE         0x80
 
 // CONFIG register
+#define THUNDERVOLT_GOVERNOR            (1 << 3) // Bit 3: Enable the thermal governor
 #define THUNDERVOLT_LED                 (1 << 2) // Bit 2: Enable the onboard LED
 #define THUNDERVOLT_OTSD                (1 << 1) // Bit 1: Enable over-temperature shutdown
 #define THUNDERVOLT_CLEAR               (1 << 0) // Bit 0: Clear persisted values
 
 // STATUS register
+#define THUNDERVOLT_REGULATOR_FAULT     (1 << 2) // Bit 2: A regulator fault is latched in the HEALTH registers
+#define THUNDERVOLT_BATT_LOW            (1 << 1) // Bit 1: The battery is below the low battery threshold
 #define THUNDERVOLT_SAFEMODE            (1 << 0) // Bit 0: Safe mode is active
 
+// OTSD_CTRL register
+#define THUNDERVOLT_OTSD_RATE           0x03     // Bits 0-1: TMP1075 conversion rate, 27.5/55/110/220ms
+#define THUNDERVOLT_OTSD_FAULTS         0x0C     // Bits 2-3: TMP1075 fault count, 1/2/3/4 (1/2/4/6 on TMP1075N)
+#define THUNDERVOLT_OTSD_FAULTS_SHIFT   2
+#define THUNDERVOLT_OTSD_INTERRUPT      (1 << 4) // Bit 4: Use interrupt mode for ALERT, instead of comparator mode
+
+// BUS_CTRL register
+#define THUNDERVOLT_BUS_PEC             (1 << 0) // Bit 0: Enable SMBus Packet Error Checking
+#define THUNDERVOLT_PEC_WRITE_MAX       15       // Longest write accepted with PEC, in data bytes
+
+// HEALTH registers
+#define THUNDERVOLT_HEALTH_THERM        (1 << 0) // Bit 0: Thermal warning (TPS6286x) or thermal shutdown (TPS6381x)
+#define THUNDERVOLT_HEALTH_HICCUP       (1 << 1) // Bit 1: Short-circuit protection entered hiccup mode (TPS6286x)
+#define THUNDERVOLT_HEALTH_UVLO         (1 << 2) // Bit 2: Input undervoltage lockout (TPS6286x)
+#define THUNDERVOLT_HEALTH_PG_LOST      (1 << 3) // Bit 3: Output out of regulation (TPS6381x)
+#define THUNDERVOLT_HEALTH_NO_RESPONSE  (1 << 4) // Bit 4: The regulator didn't respond on I2C
+
+// CAL_CTRL register
+#define THUNDERVOLT_CAL_VALID           (1 << 1) // Bit 1: The calibration registers hold a calibration (R)
+#define THUNDERVOLT_CAL_REQUEST         (1 << 0) // Bit 0: Calibrate the rails on the next boot (HW2 only)
+
+// PROFILE_SELECT register
+#define THUNDERVOLT_PROFILE_BOOT        (1 << 7) // Bit 7: Also make the profile the boot default (W)
+#define THUNDERVOLT_PROFILE_SLOT        0x03     // Bits 0-1: Profile slot
+#define THUNDERVOLT_PROFILE_NONE        0xFF     // No profile is active
+
+// CONFIG register bits stored in a voltage profile
+#define THUNDERVOLT_PROFILE_CONFIG      (THUNDERVOLT_GOVERNOR | THUNDERVOLT_OTSD)
+
+// Number of voltage profile slots
+#define THUNDERVOLT_NUM_PROFILES        4
+
+// MODE_CTRL register, bits [2n+1:2n] select the policy for rail n
+#define THUNDERVOLT_MODE_POWER_SAVE     0x0 // Power save mode (PFM) at light load, the regulator default
+#define THUNDERVOLT_MODE_FPWM           0x1 // Forced PWM, for the best transient response
+#define THUNDERVOLT_MODE_ADAPTIVE       0x2 // Forced PWM above the FPWM_TH current, power save below (HW2 only)
+#define THUNDERVOLT_MODE_MASK           0x3
+#define THUNDERVOLT_MODE_SHIFT(rail)    ((rail) * 2)
+
+// WINDOW register
+#define THUNDERVOLT_WINDOW_HISTORY      0x00 // Telemetry history, oldest record first
+#define THUNDERVOLT_WINDOW_BOOT_TRACE   0x01 // Boot trace, oldest event first
+#define THUNDERVOLT_WINDOW_MODE_STATS   0x02 // Regulator mode statistics, by rail then mode (power save, forced PWM)
+#define THUNDERVOLT_WINDOW_PROFILES     0x03 // Voltage profile slots, by slot
+#define THUNDERVOLT_WINDOW_FAULTS       0x04 // Fault log since reset, oldest record first
+#define THUNDERVOLT_WINDOW_FAULTS_SAVED 0x05 // Fatal faults saved to the EEPROM, oldest record first
+#define THUNDERVOLT_WINDOW_COUNTERS     0x06 // Performance counters, since reset or COUNTERS_CLEAR
+
+// Telemetry history record layout, multi-byte values are little-endian
+#define THUNDERVOLT_HIST_TEMP_MIN       0 // Minimum board temperature, in degrees C (int8)
+#define THUNDERVOLT_HIST_TEMP_MAX       1 // Maximum board temperature, in degrees C (int8)
+#define THUNDERVOLT_HIST_TEMP_AVG       2 // Average board temperature, in degrees C (int8)
+#define THUNDERVOLT_HIST_SAMPLES        3 // Number of samples in the record
+#define THUNDERVOLT_HIST_POWER_MIN      4 // Minimum board power, in mW (uint16, HW2 only)
+#define THUNDERVOLT_HIST_POWER_AVG      6 // Average board power, in mW (uint16, HW2 only)
+#define THUNDERVOLT_HIST_POWER_MAX      8 // Maximum board power, in mW (uint16, HW2 only)
+#define THUNDERVOLT_HIST_RECORD_SIZE    10
+#define THUNDERVOLT_HIST_RECORDS_PER_WINDOW (THUNDERVOLT_WINDOW_SIZE / THUNDERVOLT_HIST_RECORD_SIZE)
+
+// Boot trace entry layout, multi-byte values are little-endian
+#define THUNDERVOLT_TRACE_EVENT         0 // Event, see THUNDERVOLT_BOOT_xxx (0 if unused)
+#define THUNDERVOLT_TRACE_TIME          1 // Time since reset, in 1/32768s units (uint16)
+#define THUNDERVOLT_TRACE_ENTRY_SIZE    3
+#define THUNDERVOLT_TRACE_MAX_ENTRIES   16
+
+// Regulator mode statistics entry layout, multi-byte values are little-endian (HW2 only)
+#define THUNDERVOLT_MODE_STATS_SAMPLES  0 // Number of samples taken in this mode, saturating (uint16)
+#define THUNDERVOLT_MODE_STATS_CURRENT  2 // Average rail current in this mode, in mA (uint16)
+#define THUNDERVOLT_MODE_STATS_POWER    4 // Average rail power in this mode, in mW (uint16)
+#define THUNDERVOLT_MODE_STATS_SIZE     6
+
+// Voltage profile slot layout, multi-byte values are little-endian
+#define THUNDERVOLT_PROFILE_VOLTAGE     0 // Rail voltages, in mV, by rail (uint16 x4)
+#define THUNDERVOLT_PROFILE_OTSD_TEMP   8 // Over-temperature shutdown temperature, in degrees C (int8)
+#define THUNDERVOLT_PROFILE_FLAGS       9 // CONFIG register bits in THUNDERVOLT_PROFILE_CONFIG, 0xFF if the slot is empty
+#define THUNDERVOLT_PROFILE_SIZE        10
+
+// Fault log record layout, multi-byte values are little-endian
+#define THUNDERVOLT_FAULT_EVENT         0 // Event, see THUNDERVOLT_FAULT_xxx (0 if unused)
+#define THUNDERVOLT_FAULT_TIME          1 // Time since reset, in ms (uint32)
+#define THUNDERVOLT_FAULT_ADDR          5 // I2C address of the device involved, 0 if none
+#define THUNDERVOLT_FAULT_DATA          6 // Register snapshot, depends on the event
+#define THUNDERVOLT_FAULT_TEMP          7 // Last board temperature, in degrees C (int8, THUNDERVOLT_FAULT_TEMP_UNKNOWN if none)
+#define THUNDERVOLT_FAULT_RECORD_SIZE   8
+#define THUNDERVOLT_FAULT_MAX_RECORDS   16 // Records kept since reset
+#define THUNDERVOLT_FAULT_MAX_SAVED     8 // Saved records kept in the EEPROM
+#define THUNDERVOLT_FAULT_TEMP_UNKNOWN  -128
+
+// Performance counter layout, multi-byte values are little-endian and saturate at their maximum
+// The counters are latched when offset 0 is read, so read them in a single burst starting there
+#define THUNDERVOLT_COUNT_TRANSACTIONS  0 // I2C target transactions addressed to us (uint32)
+#define THUNDERVOLT_COUNT_BYTES         4 // I2C target data bytes received and sent (uint32)
+#define THUNDERVOLT_COUNT_REJECTED      8 // Register accesses rejected, NACKed or out of bounds (uint16)
+#define THUNDERVOLT_COUNT_STRETCHES     10 // TWI interrupts holding the clock for over a byte time at 400kHz (uint16)
+#define THUNDERVOLT_COUNT_ISR_MAX       12 // Longest interrupt handler, in CPU cycles (uint16)
+#define THUNDERVOLT_COUNT_EEPROM_WRITES 14 // EEPROM bytes written (uint32)
+#define THUNDERVOLT_COUNT_BUS_ERRORS    18 // I2C controller transfers which failed (uint16)
+#define THUNDERVOLT_COUNT_ISR_OVERRUNS  20 // Interrupt handlers which ran over their cycle budget (uint16)
+#define THUNDERVOLT_COUNT_SIZE          22
+
+// Fault events, and the register snapshot they record
+#define THUNDERVOLT_FAULT_RESET         1 // Firmware started, DATA is the RSTCTRL.RSTFR reset flags
+#define THUNDERVOLT_FAULT_SCAN_FAILED   2 // Device missing on I2C at boot (saved), DATA is the STATUS register
+#define THUNDERVOLT_FAULT_OTSD          3 // Over-temperature shutdown (saved), DATA is the OTSD_TEMP register
+#define THUNDERVOLT_FAULT_PEC           4 // Write discarded due to a PEC mismatch, DATA is the register address
+#define THUNDERVOLT_FAULT_REGULATOR     5 // Regulator fault latched (saved), DATA is its STATUS register
+
+// Boot trace events
+#define THUNDERVOLT_BOOT_RESET          1 // Clocks and RTC running
+#define THUNDERVOLT_BOOT_REGS_LOADED    2 // Registers loaded from EEPROM
+#define THUNDERVOLT_BOOT_EN_HIGH        3 // Regulators enabled
+#define THUNDERVOLT_BOOT_POWER_GOOD     4 // All regulators and the TMP responding on I2C
+#define THUNDERVOLT_BOOT_RAILS_SET      5 // Rail voltages and OTSD limit programmed
+#define THUNDERVOLT_BOOT_U10_RELEASED   6 // U10 deasserted, Hollywood released from reset
+#define THUNDERVOLT_BOOT_TARGET_READY   7 // Listening for I2C commands
+#define THUNDERVOLT_BOOT_SCAN_FAILED    8 // Devices missing on I2C, regulators shut down
+#define THUNDERVOLT_BOOT_CALIBRATED     9 // Rail setpoints calibrated
+
 // Stock voltages for each rail, in mV
 #define THUNDERVOLT_STOCK_VOLTAGE_1V0   1000
 #define THUNDERVOLT_STOCK_VOLTAGE_1V15  1150
@@ -42,9 +222,35 @@
 #define THUNDERVOLT_MIN_VOLTAGE_1V8     1300
 #define THUNDERVOLT_MIN_VOLTAGE_3V3     2950
 
+// Largest correction a calibration can make beyond a rail's voltage range, in mV
+// Calibrated setpoints are clamped to the range widened by this much, whatever the calibration registers hold
+#define THUNDERVOLT_CAL_MAX_TRIM        25
+
 // Default over-temperature limit, in degrees C
 #define THUNDERVOLT_DEFAULT_OTSD_LIMIT  70
 
+// Default telemetry settings, one history record every 10 seconds
+#define THUNDERVOLT_DEFAULT_TELEM_PERIOD    10 // 100ms
+#define THUNDERVOLT_DEFAULT_TELEM_SAMPLES   100
+
+// Default U10 hold time after regulator power-good, in ms
+#define THUNDERVOLT_DEFAULT_U10_DELAY   200
+
+// Default forced PWM threshold for the adaptive regulator mode, in 20mA units
+#define THUNDERVOLT_DEFAULT_FPWM_TH     25 // 500mA
+
+// Default low battery threshold, in 20mV units
+#define THUNDERVOLT_DEFAULT_BATT_LOW_TH 175 // 3.5V
+
+// Default over-temperature shutdown sensor configuration, fastest conversion rate and a single fault
+#define THUNDERVOLT_DEFAULT_OTSD_CTRL   0x00
+
+// Default thermal governor margin, in degrees C
+#define THUNDERVOLT_DEFAULT_GOV_MARGIN  10
+
+// Number of thermal governor throttle steps, each one moves the rails 1/8 of the way to stock
+#define THUNDERVOLT_THROTTLE_MAX        8
+
 // Hardware variants
 enum {
   THUNDERVOLT_HW1 = 1,
@@ -60,11 +266,74 @@ enum {
   THUNDERVOLT_RAIL_3V3,
 };
 
+// Telemetry history record
+struct thundervolt_history_record {
+  int8_t temp_min;
+  int8_t temp_max;
+  int8_t temp_avg;
+  uint8_t samples;
+  uint16_t power_min;
+  uint16_t power_avg;
+  uint16_t power_max;
+};
+
+// Setpoint calibration for a rail
+// The measured voltage is setpoint + offset + gain * (setpoint - stock voltage) / 1000
+struct thundervolt_calibration {
+  int8_t offset;
+  int8_t gain;
+};
+
+// Regulator mode statistics, for one rail in one mode
+struct thundervolt_mode_stats {
+  uint16_t samples;
+  uint16_t current_avg;
+  uint16_t power_avg;
+};
+
+// Voltage profile
+struct thundervolt_profile {
+  bool valid;
+  uint16_t voltage[THUNDERVOLT_RAIL_3V3 + 1];
+  int8_t otsd_temp;
+  bool otsd_enabled;
+  bool governor_enabled;
+};
+
+// Performance counters
+struct thundervolt_counters {
+  uint32_t transactions;
+  uint32_t bytes;
+  uint16_t rejected;
+  uint16_t stretches;
+  uint16_t isr_max_cycles;
+  uint32_t eeprom_writes;
+  uint16_t bus_errors;
+  uint16_t isr_overruns;
+};
+
+// Fault log record
+struct thundervolt_fault {
+  uint8_t event;
+  uint32_t time_ms;
+  uint8_t addr;
+  uint8_t data;
+  int8_t temp;
+};
+
+// Boot trace event
+struct thundervolt_boot_event {
+  uint8_t event;
+  uint32_t time_us;
+};
+
 // Error codes
 enum {
   THUNDERVOLT_ERR_INVALID_VOLTAGE = 10,
   THUNDERVOLT_ERR_INVALID_RAIL,
   THUNDERVOLT_ERR_NOT_SUPPORTED,
+  THUNDERVOLT_ERR_INVALID_PROFILE,
+  THUNDERVOLT_ERR_TOO_LONG,
 };
 
 // Get the hardware revision of Thundervolt
@@ -73,12 +342,35 @@ int thundervolt_get_hardware_revision(uint8_t *hw_rev);
 // Returns true if all regulators and TMP are accessible over i2c. Only usable in i2c controller mode.
 bool thundervolt_i2c_scan();
 
+// Returns the I2C address of the first regulator or TMP that doesn't respond, 0 if they all respond.
+// Only usable in i2c controller mode.
+uint8_t thundervolt_i2c_find_missing();
+
+// Read the STATUS register of the specified rail's regulator, decoded into THUNDERVOLT_HEALTH_xxx flags.
+// Also gets the regulator's I2C address, and its raw STATUS register (0 if it didn't respond).
+// A NACK is reported as THUNDERVOLT_HEALTH_NO_RESPONSE, other bus errors are returned without a health reading.
+// Only usable in i2c controller mode.
+int thundervolt_get_regulator_health(uint8_t rail, uint8_t *health, uint8_t *addr, uint8_t *status);
+
+// Get the allowed voltage range for the specified rail, in mV
+int thundervolt_get_voltage_range(uint8_t rail, uint16_t *min, uint16_t *max);
+
 // Get the current voltage for the specified rail, in mV
 int thundervolt_get_voltage(uint8_t rail, uint16_t *voltage);
 
 // Set the voltage for the specified rail, in mV
 int thundervolt_set_voltage(uint8_t rail, uint16_t voltage);
 
+// Set the calibration applied by thundervolt_get_voltage and thundervolt_set_voltage for the specified rail
+// The homebrew loads the calibration from the Thundervolt, so this is only needed by the firmware
+int thundervolt_set_calibration(uint8_t rail, const struct thundervolt_calibration *cal);
+
+// Force PWM operation on the specified rail, or allow power save mode at light load
+int thundervolt_set_forced_pwm(uint8_t rail, bool enable);
+
+// Get the voltage measured by the power monitor for the specified rail, in mV (HW2 only)
+int thundervolt_get_measured_voltage(uint8_t rail, uint16_t *voltage);
+
 // Get the current for the specified rail, in mA
 int thundervolt_get_current(uint8_t rail, uint16_t *current);
 
@@ -88,12 +380,21 @@ int thundervolt_get_power(uint8_t rail, uint32_t *power);
 // Get the temperture of the device, in degrees C
 int thundervolt_get_temp(float *temp);
 
+// Get the hottest temperature on the board, including the power monitor dies on HW2, in degrees C
+int thundervolt_get_max_temp(float *temp);
+
 // Get the over-temperature limit, in degrees C
 int thundervolt_get_otsd_limit(int8_t *temp);
 
 // Set the over-temperature limit, in degrees C
 int thundervolt_set_otsd_limit(int8_t temp);
 
+// Configure the temperature sensor for over-temperature shutdown, using OTSD_CTRL register values
+int thundervolt_configure_otsd(uint8_t ctrl);
+
+// Get the worst-case over-temperature shutdown latency for an OTSD_CTRL register value, in ms
+uint16_t thundervolt_get_otsd_worst_case_latency(uint8_t ctrl);
+
 // Check if this hardware variant supports power monitoring
 bool thundervolt_has_power_monitoring();
 
@@ -129,6 +430,15 @@ int thundervolt_get_persisted_otsd_limit(int8_t *temp);
 // Set the persisted over-temperature limit, in degrees C
 int thundervolt_set_persisted_otsd_limit(int8_t temp);
 
+// Get the persisted over-temperature shutdown sensor configuration (OTSD_CTRL register value)
+int thundervolt_get_persisted_otsd_ctrl(uint8_t *ctrl);
+
+// Set the persisted over-temperature shutdown sensor configuration (OTSD_CTRL register value)
+int thundervolt_set_persisted_otsd_ctrl(uint8_t ctrl);
+
+// Get the worst-case over-temperature shutdown latency reported by Thundervolt, in ms
+int thundervolt_get_otsd_latency(uint16_t *latency);
+
 // Get the software revision of Thundervolt
 int thundervolt_get_software_revision(uint8_t *sw_rev);
 
@@ -137,4 +447,122 @@ int thundervolt_get_led_enabled(bool *enable);
 
 // Enable or disable the LED
 int thundervolt_set_led_enabled(bool enable);
+
+// Enable or disable SMBus Packet Error Checking on all Thundervolt register accesses
+// The Thundervolt keeps the setting until it resets, the first access after a homebrew restart reads it back.
+// With PEC enabled, writes longer than THUNDERVOLT_PEC_WRITE_MAX fail with THUNDERVOLT_ERR_TOO_LONG.
+int thundervolt_set_pec_enabled(bool enable);
+
+// Check if SMBus Packet Error Checking is enabled
+bool thundervolt_get_pec_enabled();
+
+// Fetch and consume up to max_records telemetry history records, oldest first
+int thundervolt_get_history(struct thundervolt_history_record *records, uint8_t max_records, uint8_t *num_records);
+
+// Fetch up to max_events boot trace events, in the order they happened
+int thundervolt_get_boot_trace(struct thundervolt_boot_event *events, uint8_t max_events, uint8_t *num_events);
+
+// Fetch up to max_faults fault records, oldest first, from the log since reset or the faults saved to the EEPROM
+int thundervolt_get_faults(bool saved, struct thundervolt_fault *faults, uint8_t max_faults, uint8_t *num_faults);
+
+// Get the regulator faults latched by the firmware, as THUNDERVOLT_HEALTH_xxx flags for each rail
+int thundervolt_get_regulator_faults(uint8_t faults[THUNDERVOLT_RAIL_3V3 + 1]);
+
+// Clear the regulator faults latched by the firmware
+int thundervolt_clear_regulator_faults();
+
+// Get the performance counters
+int thundervolt_get_counters(struct thundervolt_counters *counters);
+
+// Reset the performance counters
+int thundervolt_clear_counters();
+
+// Get the U10 hold time after regulator power-good, in ms
+int thundervolt_get_u10_delay(uint8_t *delay);
+
+// Set the U10 hold time after regulator power-good, in ms (persisted)
+int thundervolt_set_u10_delay(uint8_t delay);
+
+// Check if the thermal governor is enabled
+int thundervolt_get_governor_enabled(bool *enable);
+
+// Enable or disable the thermal governor
+int thundervolt_set_governor_enabled(bool enable);
+
+// Get the persisted thermal governor margin below the over-temperature limit, in degrees C
+int thundervolt_get_persisted_governor_margin(uint8_t *margin);
+
+// Set the persisted thermal governor margin below the over-temperature limit, in degrees C
+int thundervolt_set_persisted_governor_margin(uint8_t margin);
+
+// Get the thermal governor throttle step, from 0 (not throttling) to THUNDERVOLT_THROTTLE_MAX (stock voltages)
+int thundervolt_get_throttle(uint8_t *throttle);
+
+// Get the persisted load-line gain for the specified rail, in mV/A (HW2 only)
+int thundervolt_get_persisted_avp_gain(uint8_t rail, uint8_t *gain);
+
+// Set the persisted load-line gain for the specified rail, in mV/A, 0 to disable (HW2 only)
+int thundervolt_set_persisted_avp_gain(uint8_t rail, uint8_t gain);
+
+// Calibrate the rail setpoints against the power monitors on the next boot (HW2 only)
+int thundervolt_request_calibration();
+
+// Get the calibration applied to the specified rail, all zero if the board hasn't been calibrated
+int thundervolt_get_calibration(uint8_t rail, struct thundervolt_calibration *cal);
+
+// Get the persisted regulator mode policy for the specified rail, see THUNDERVOLT_MODE_xxx
+int thundervolt_get_persisted_mode(uint8_t rail, uint8_t *mode);
+
+// Set the persisted regulator mode policy for the specified rail, see THUNDERVOLT_MODE_xxx
+int thundervolt_set_persisted_mode(uint8_t rail, uint8_t mode);
+
+// Get the persisted forced PWM threshold for the adaptive mode on the specified rail, in mA
+int thundervolt_get_persisted_fpwm_threshold(uint8_t rail, uint16_t *current);
+
+// Set the persisted forced PWM threshold for the adaptive mode on the specified rail, in mA (20mA resolution)
+int thundervolt_set_persisted_fpwm_threshold(uint8_t rail, uint16_t current);
+
+// Check if the specified rail is currently running in forced PWM
+int thundervolt_get_forced_pwm(uint8_t rail, bool *enabled);
+
+// Fetch the regulator mode statistics for the specified rail, indexed by mode (power save, forced PWM) (HW2 only)
+int thundervolt_get_mode_stats(uint8_t rail, struct thundervolt_mode_stats stats[2]);
+
+// Get the active voltage profile slot, THUNDERVOLT_PROFILE_NONE if the settings don't come from a profile
+int thundervolt_get_active_profile(uint8_t *slot);
+
+// Switch to a voltage profile, ramping the rails to its voltages, and optionally make it the boot default
+// The persisted voltages only change when the profile becomes the boot default
+// Rejected in safe mode, and for empty slots
+int thundervolt_select_profile(uint8_t slot, bool boot_default);
+
+// Save the persisted voltages, over-temperature limit, OTSD and governor settings to a voltage profile slot
+int thundervolt_save_profile(uint8_t slot);
+
+// Read a voltage profile slot, valid is false if the slot is empty
+int thundervolt_get_profile(uint8_t slot, struct thundervolt_profile *profile);
+
+// Get the ATtiny supply voltage (the always-on 1.8V rail, not the battery), in mV
+int thundervolt_get_supply_voltage(uint16_t *voltage);
+
+// Report the battery voltage to the Thundervolt, in mV, 0 if unknown
+int thundervolt_set_battery_voltage(uint16_t voltage);
+
+// Get the estimated battery state of charge, in percent, 0xFF if the battery voltage hasn't been reported
+int thundervolt_get_battery_soc(uint8_t *soc);
+
+// Check if the battery is below the low battery threshold
+int thundervolt_get_battery_low(bool *low);
+
+// Get the persisted low battery threshold, in mV, 0 if disabled
+int thundervolt_get_persisted_battery_threshold(uint16_t *voltage);
+
+// Set the persisted low battery threshold, in mV (20mV resolution), 0 to disable
+int thundervolt_set_persisted_battery_threshold(uint16_t voltage);
+
+// Get the persisted voltage offset applied to the specified rail on low battery, in mV
+int thundervolt_get_persisted_battery_offset(uint8_t rail, int8_t *offset);
+
+// Set the persisted voltage offset applied to the specified rail on low battery, in mV
+int thundervolt_set_persisted_battery_offset(uint8_t rail, int8_t offset);
 #endif // HW_RVL
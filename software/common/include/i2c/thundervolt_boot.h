@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// I2C address of the bootloader, distinct from the application so the homebrew can tell them apart
+#define THUNDERVOLT_BOOT_I2C_ADDR           0x30
+
+// Bootloader registers
+#define THUNDERVOLT_BOOT_REG_STATUS         0x00 // Status register (R)
+#define THUNDERVOLT_BOOT_REG_ERROR          0x01 // Error from the last command, see THUNDERVOLT_BOOT_ERROR_xxx (R)
+#define THUNDERVOLT_BOOT_REG_VERSION        0x02 // Bootloader version (R)
+#define THUNDERVOLT_BOOT_REG_APP_PAGES      0x03 // Number of flash pages available for the application (R)
+#define THUNDERVOLT_BOOT_REG_IMAGE_PAGES    0x04 // Number of pages in the installed image, 0 if there is no valid image (R)
+#define THUNDERVOLT_BOOT_REG_IMAGE_CRC_L    0x05 // CRC of the installed image [7:0] (R)
+#define THUNDERVOLT_BOOT_REG_IMAGE_CRC_H    0x06 // CRC of the installed image [15:8] (R)
+#define THUNDERVOLT_BOOT_REG_PAGE           0x07 // Page number, or number of pages for FINISH (RW)
+#define THUNDERVOLT_BOOT_REG_CRC_L          0x08 // CRC of the page buffer or image [7:0] (RW)
+#define THUNDERVOLT_BOOT_REG_CRC_H          0x09 // CRC of the page buffer or image [15:8] (RW)
+#define THUNDERVOLT_BOOT_REG_CMD            0x0A // Command, started at the stop condition (W)
+#define THUNDERVOLT_BOOT_REG_BUFFER         0x40 // Page buffer (RW)
+#define THUNDERVOLT_BOOT_NUM_REGISTERS      0x80 // Number of registers
+
+// STATUS register
+#define THUNDERVOLT_BOOT_IMAGE_VALID        (1 << 7) // Bit 7: The installed image passed its CRC check
+#define THUNDERVOLT_BOOT_BUSY               (1 << 0) // Bit 0: A command is running
+
+// Commands
+#define THUNDERVOLT_BOOT_CMD_WRITE          0x01 // Program the buffer to PAGE, if it matches CRC, and verify it
+#define THUNDERVOLT_BOOT_CMD_READ           0x02 // Read PAGE into the buffer, and its CRC into CRC
+#define THUNDERVOLT_BOOT_CMD_FINISH         0x03 // Check the first PAGE pages against CRC, and mark the image valid
+#define THUNDERVOLT_BOOT_CMD_START          0x04 // Reset, and start the application if the image is valid
+
+// Command errors
+#define THUNDERVOLT_BOOT_ERROR_NONE         0x00
+#define THUNDERVOLT_BOOT_ERROR_CRC          0x01 // The page buffer didn't match the CRC
+#define THUNDERVOLT_BOOT_ERROR_PAGE         0x02 // The page is outside the application section
+#define THUNDERVOLT_BOOT_ERROR_VERIFY       0x03 // The flash didn't match the CRC after programming
+#define THUNDERVOLT_BOOT_ERROR_COMMAND      0x04 // Unknown command
+
+// Flash page size, in bytes
+#define THUNDERVOLT_BOOT_PAGE_SIZE          64
+
+// Time the bootloader doesn't respond for while programming a page, in ms
+// The CPU is halted during the erase and write, so the bus mustn't be used until it's done
+#define THUNDERVOLT_BOOT_WRITE_TIME_MS      5
+
+// Value written to the application's BOOTLOADER register to enter the bootloader
+#define THUNDERVOLT_BOOT_ENTER              0xB7
+
+// Bootloader information
+struct thundervolt_boot_info {
+  uint8_t version;
+  uint8_t app_pages;
+  uint8_t image_pages;
+  uint16_t image_crc;
+};
+
+// Update stages, reported to the progress callback
+enum {
+  THUNDERVOLT_BOOT_STAGE_BACKUP,
+  THUNDERVOLT_BOOT_STAGE_WRITE,
+  THUNDERVOLT_BOOT_STAGE_RESTORE,
+};
+
+// Update progress callback, called after each page
+typedef void (*thundervolt_boot_progress_fn)(uint8_t stage, uint16_t done, uint16_t total, void *ctx);
+
+// Error codes
+enum {
+  THUNDERVOLT_BOOT_ERR_TIMEOUT = 20,
+  THUNDERVOLT_BOOT_ERR_FAILED,
+  THUNDERVOLT_BOOT_ERR_TOO_LARGE,
+  THUNDERVOLT_BOOT_ERR_NO_MEMORY,
+  THUNDERVOLT_BOOT_ERR_RESTORED,
+};
+
+//
+// Functions only available in homebrew mode
+//
+
+#ifdef HW_RVL
+// Check if the bootloader is running and present on the I2C bus
+bool thundervolt_boot_is_present();
+
+// Ask the application to hand over to the bootloader, and wait for the bootloader to respond
+// The console keeps running, the regulators are left at their current voltages
+int thundervolt_boot_enter();
+
+// Get the bootloader version, and the installed image
+int thundervolt_boot_get_info(struct thundervolt_boot_info *info);
+
+// Read a page of the installed image
+int thundervolt_boot_read_page(uint8_t page, uint8_t *data);
+
+// Program and verify a page of a new image, invalidating the installed image until thundervolt_boot_finish
+int thundervolt_boot_write_page(uint8_t page, const uint8_t *data);
+
+// Check the first pages of the flash against the image CRC, and mark the image valid if it matches
+int thundervolt_boot_finish(uint8_t pages, uint16_t crc);
+
+// Reset the Thundervolt into the installed image, this power cycles the console
+int thundervolt_boot_start_app();
+
+// Install a new image, backing up the installed image first and restoring it if the update fails
+// Returns -THUNDERVOLT_BOOT_ERR_RESTORED if the update failed but the previous image was restored
+int thundervolt_boot_update(const uint8_t *image, uint32_t len, thundervolt_boot_progress_fn progress, void *ctx);
+#endif
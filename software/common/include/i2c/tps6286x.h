@@ -63,6 +63,12 @@ int tps6286x_enable(uint8_t addr, bool enabled);
 // Set slew rate using TPS6286X_SLEW_RATE__xxx values
 int tps6286x_set_slew_rate(uint8_t addr, uint8_t slew_rate);
 
+// Force PWM operation, or allow power save mode (PFM) at light load (default)
+int tps6286x_set_forced_pwm(uint8_t addr, bool enabled);
+
+// Get the STATUS register, HICCUP and UVLO report events since the last read and are cleared by reading
+int tps6286x_get_status(uint8_t addr, uint8_t *status);
+
 // Get voltage in mV when VSET is LOW
 int tps6286x_get_vout1(uint8_t addr, uint8_t chip_type, uint16_t *voltage);
 
@@ -53,9 +53,15 @@ bool tps6381x_is_present();
 // Set slew rate using TPS6381X_SLEW_RATE_xxx values
 int tps6381x_set_slew_rate(uint8_t slew_rate);
 
+// Force PWM operation, or allow power save mode at light load (default)
+int tps6381x_set_forced_pwm(bool enable);
+
 // Enable or disable the regulator (default enabled on TPS63810, disabled on TPS63811)
 int tps6381x_enable(bool enable);
 
+// Get the STATUS register, see TPS6381X_TSD and TPS6381X_PG
+int tps6381x_get_status(uint8_t *status);
+
 // Get the current voltage range
 int tps6381x_get_range(uint8_t *range);
 
@@ -0,0 +1,58 @@
+/**
+ * Thundervolt UART telemetry stream format.
+ *
+ * Bench builds of the firmware (see env:thundervolt-hw2-stream) send a stream of
+ * binary frames on the ATtiny's USART TX pin, at 115200 baud 8N1:
+ *
+ *   SYNC  TYPE  SEQ  LEN  PAYLOAD[LEN]  CRC
+ *
+ * SEQ counts up by one for every frame sent, so gaps show frames dropped when
+ * the transmit buffer was full. CRC is the SMBus CRC-8 (see crc8.h) of TYPE
+ * through the end of the payload. Multi-byte values are little-endian, and
+ * every payload starts with the time of the frame in ms since boot (uint32).
+ */
+
+#pragma once
+
+#define THUNDERVOLT_STREAM_BAUD             115200
+#define THUNDERVOLT_STREAM_SYNC             0xA5
+
+// Frame layout
+#define THUNDERVOLT_STREAM_SYNC_OFS         0
+#define THUNDERVOLT_STREAM_TYPE_OFS         1
+#define THUNDERVOLT_STREAM_SEQ_OFS          2
+#define THUNDERVOLT_STREAM_LEN_OFS          3
+#define THUNDERVOLT_STREAM_PAYLOAD_OFS      4
+#define THUNDERVOLT_STREAM_OVERHEAD         5 // Header and CRC
+#define THUNDERVOLT_STREAM_MAX_PAYLOAD      40
+
+// Frame types
+#define THUNDERVOLT_STREAM_BOOT             0x01 // Firmware started
+#define THUNDERVOLT_STREAM_SAMPLE           0x02 // Periodic rail sample
+#define THUNDERVOLT_STREAM_OTSD             0x03 // Over-temperature shutdown
+#define THUNDERVOLT_STREAM_WRITES           0x04 // Register writes received over I2C
+
+// Common to all payloads
+#define THUNDERVOLT_STREAM_TIME             0 // Time of the frame, in ms since boot (uint32)
+
+// BOOT payload
+#define THUNDERVOLT_STREAM_BOOT_HW_REV      4 // Hardware revision, see THUNDERVOLT_HWx
+#define THUNDERVOLT_STREAM_BOOT_SW_REV      5 // Software revision
+#define THUNDERVOLT_STREAM_BOOT_SIZE        6
+
+// SAMPLE payload, the INA700 readings are only present on hardware with power monitoring
+#define THUNDERVOLT_STREAM_SAMPLE_TEMP      4 // Board temperature, in 0.01°C (int16)
+#define THUNDERVOLT_STREAM_SAMPLE_DROPPED   6 // Frames and register writes dropped since the last sample
+#define THUNDERVOLT_STREAM_SAMPLE_VOUT      7 // Regulator setpoints, in mV (4 x uint16)
+#define THUNDERVOLT_STREAM_SAMPLE_VBUS      15 // INA700 bus voltages, in mV (4 x uint16)
+#define THUNDERVOLT_STREAM_SAMPLE_CURRENT   23 // INA700 currents, in mA (4 x uint16)
+#define THUNDERVOLT_STREAM_SAMPLE_SIZE      15
+#define THUNDERVOLT_STREAM_SAMPLE_SIZE_PM   31
+#define THUNDERVOLT_STREAM_NO_READING       0xFFFF // Sent in place of a voltage or current that couldn't be read
+
+// OTSD payload
+#define THUNDERVOLT_STREAM_OTSD_LIMIT       4 // Over-temperature limit that was exceeded, in °C (int8)
+#define THUNDERVOLT_STREAM_OTSD_SIZE        5
+
+// WRITES payload, followed by (register, value) pairs up to the end of the payload
+#define THUNDERVOLT_STREAM_WRITES_DATA      4
@@ -0,0 +1,16 @@
+#include "crc16.h"
+
+uint16_t crc16_update(uint16_t crc, uint8_t data)
+{
+  crc ^= (uint16_t)data << 8;
+  for (uint8_t i = 0; i < 8; i++) { crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1; }
+
+  return crc;
+}
+
+uint16_t crc16_update_buf(uint16_t crc, const uint8_t *buf, uint32_t len)
+{
+  while (len--) { crc = crc16_update(crc, *buf++); }
+
+  return crc;
+}
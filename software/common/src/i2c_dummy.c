@@ -49,6 +49,9 @@ struct i2c_device {
 static struct i2c_device devices[16];
 static uint8_t num_devices = 0;
 
+// Number of failed transfers
+static uint16_t errors = 0;
+
 // Handle generic pass-through byte reads for 8-bit registers
 static uint8_t reg8_read_byte(struct i2c_device *device)
 {
@@ -159,13 +162,18 @@ static int i2c_write_byte(struct i2c_device *device, uint8_t data)
 }
 
 // Dummy device registers
-static uint8_t thundervolt_regs[]   = {0x04, 0x00, 0xE8, 0x03, 0x7E, 0x04, 0x08,
-                                       0x07, 0xE4, 0x0C, 0x46, 0x01, 0x01};
-static uint8_t tps6286x_1v0_regs[]  = {0x00, 0x78, 0x78, 0x00, 0x00, 0x00};
-static uint8_t tps6286x_1v15_regs[] = {0x00, 0x96, 0x96, 0x00, 0x00, 0x00};
-static uint8_t tps6286x_1v8_regs[]  = {0x00, 0x64, 0x64, 0x00, 0x00, 0x00};
-static uint8_t tps6381x_regs[]      = {0x00, 0x00, 0x00, 0x04, 0x3C, 0x42};
-static uint16_t tmp1075_regs[]      = {0x3000, 0x00FF, 0x4100, 0x4600};
+static uint8_t thundervolt_regs[256] = {0x04, 0x00, 0xE8, 0x03, 0x7E, 0x04, 0x08, 0x07, 0xE4,
+                                         0x0C, 0x46, 0x01, 0x01, 0x00, 0x0A, 0x64, 0x00,
+                                         0x00, 0x00, 0xC8, 0x00, 0x38, 0x00, 0x0A, 0x00,
+                                         0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                         0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x19, 0x19, 0x19,
+                                         0x19, 0x00, 0x08, 0x07, 0x00, 0x00, 0xFF, 0xAF, 0x00,
+                                         0x00, 0x00, 0x00, 0xFF, 0x00, 0x00};
+static uint8_t tps6286x_1v0_regs[]   = {0x00, 0x78, 0x78, 0x00, 0x00, 0x00};
+static uint8_t tps6286x_1v15_regs[]  = {0x00, 0x96, 0x96, 0x00, 0x00, 0x00};
+static uint8_t tps6286x_1v8_regs[]   = {0x00, 0x64, 0x64, 0x00, 0x00, 0x00};
+static uint8_t tps6381x_regs[]       = {0x00, 0x00, 0x00, 0x04, 0x3C, 0x42};
+static uint16_t tmp1075_regs[]       = {0x3000, 0x00FF, 0x4100, 0x4600};
 
 int i2c_configure(uint8_t mode)
 {
@@ -184,8 +192,11 @@ int i2c_configure(uint8_t mode)
 int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
 {
   struct i2c_device *device = get_i2c_device(addr);
-  if (!device)
+  if (!device) {
+    if (errors < UINT16_MAX)
+      errors++;
     return -1;
+  }
 
   // Always start with a start condition
   unsigned int flags = I2C_MSG_RESTART;
@@ -235,4 +246,14 @@ int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
   return 0;
 }
 
+uint16_t i2c_get_errors()
+{
+  return errors;
+}
+
+void i2c_clear_errors()
+{
+  errors = 0;
+}
+
 #endif
\ No newline at end of file
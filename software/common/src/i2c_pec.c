@@ -0,0 +1,57 @@
+#include <string.h>
+
+#include "crc8.h"
+#include "i2c.h"
+
+// Number of PEC mismatches seen on block reads
+static uint32_t pec_errors = 0;
+
+int i2c_reg_read_block_pec(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len)
+{
+  if (len > I2C_BLOCK_MAX)
+    return -I2C_ERR;
+
+  // Calculate the PEC for the write phase, and the read address
+  uint8_t cmd[] = {reg, len};
+  uint8_t crc   = crc8_update(0, addr << 1);
+  crc           = crc8_update_buf(crc, cmd, sizeof(cmd));
+  crc           = crc8_update(crc, (addr << 1) | I2C_MSG_READ);
+
+  int rcode = -I2C_ERR_PEC;
+  for (uint8_t attempt = 0; attempt <= I2C_PEC_RETRIES && rcode == -I2C_ERR_PEC; attempt++) {
+    // Read the block, followed by the PEC byte
+    uint8_t rx[I2C_BLOCK_MAX + 1];
+    if ((rcode = i2c_write_read(addr, cmd, sizeof(cmd), rx, len + 1)) < 0)
+      return rcode;
+
+    // The CRC over the data and the PEC byte is zero if the block arrived intact
+    if (crc8_update_buf(crc, rx, len + 1) != 0) {
+      pec_errors++;
+      rcode = -I2C_ERR_PEC;
+      continue;
+    }
+
+    memcpy(buf, rx, len);
+  }
+
+  return rcode;
+}
+
+int i2c_reg_write_block_pec(uint8_t addr, uint8_t reg, const uint8_t *buf, uint8_t len)
+{
+  if (len > I2C_BLOCK_MAX)
+    return -I2C_ERR;
+
+  // Build the message, register address first and PEC last
+  uint8_t tx[I2C_BLOCK_MAX + 2];
+  tx[0] = reg;
+  memcpy(&tx[1], buf, len);
+  tx[len + 1] = crc8_update_buf(crc8_update(0, addr << 1), tx, len + 1);
+
+  return i2c_write(addr, tx, len + 2);
+}
+
+uint32_t i2c_get_pec_errors()
+{
+  return pec_errors;
+}
@@ -5,13 +5,20 @@
 #if defined(AVR)
 
 #include <avr/io.h>
+#include <util/atomic.h>
 #include <util/delay.h>
 
 #include "i2c.h"
 
+// How long to wait for another controller to release the bus
+#define BUS_IDLE_TIMEOUT_US 5000
+
 // Is the I2C bus configured yet?
 static bool configured = false;
 
+// Number of failed transfers, read from interrupt handlers
+static volatile uint16_t errors = 0;
+
 // Calculate the value for the I2C baud rate register
 // NOTE: This is approximate, and doesn't take into account rise time
 static inline uint8_t i2c_baud(uint32_t frequency)
@@ -27,9 +34,31 @@ static inline uint8_t i2c_baud(uint32_t frequency)
 }
 
 // Wait for bus to return to idle state
-static inline void i2c_wait_for_idle()
+// Returns false if the bus is still busy after BUS_IDLE_TIMEOUT_US, for example if another controller is
+// holding SCL low, in which case the bus state is forced back to idle so the next transfer can try again
+static bool i2c_wait_for_idle()
+{
+  for (uint16_t waited = 0; (TWI0.MSTATUS & TWI_BUSSTATE_gm) != TWI_BUSSTATE_IDLE_gc; waited++) {
+    if (waited >= BUS_IDLE_TIMEOUT_US) {
+      TWI0.MSTATUS = TWI_BUSSTATE_IDLE_gc;
+      return false;
+    }
+    _delay_us(1);
+  }
+
+  return true;
+}
+
+// Recover after losing arbitration to another controller
+static inline int i2c_arbitration_lost()
 {
-  while (!(TWI0.MSTATUS & TWI_BUSSTATE_IDLE_gc));
+  // Clear the flag, the hardware has already released the bus
+  TWI0.MSTATUS = TWI_ARBLOST_bm;
+
+  // Wait for the other controller to finish its transaction
+  i2c_wait_for_idle();
+
+  return -I2C_ERR_ARBLOST;
 }
 
 // Send stop condition
@@ -53,27 +82,22 @@ int i2c_configure(uint8_t mode)
       return -I2C_ERR;
   }
 
-  // Enable the I2C controller
-  TWI0.MCTRLA = TWI_ENABLE_bm;
+  // Enable the I2C controller, with a bus timeout so we can track the bus state
+  // when sharing the bus with other controllers (and our own target mode)
+  TWI0.MCTRLA = TWI_TIMEOUT_200US_gc | TWI_ENABLE_bm;
 
   // Set the bus state to idle
   TWI0.MSTATUS = TWI_BUSSTATE_IDLE_gc;
 
-  // Wait a small amount of time for the bus to be ready
-  _delay_ms(5);
-
   // Set the configured flag
   configured = true;
 
   return 0;
 }
 
-int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
+// Perform a single attempt at a transfer
+static int i2c_transfer_once(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
 {
-  // Check if the I2C bus is configured
-  if (!configured)
-    return -I2C_ERR;
-
   // Always start with a start condition
   unsigned int flags = I2C_MSG_RESTART;
 
@@ -101,9 +125,8 @@ int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
 
       // Check for errors
       if (TWI0.MSTATUS & TWI_ARBLOST_bm) {
-        // Arbitration lost
-        i2c_wait_for_idle();
-        return -I2C_ERR;
+        // Arbitration lost, another controller addressed a device at the same time
+        return i2c_arbitration_lost();
       } else if (TWI0.MSTATUS & TWI_RXACK_bm) {
         // Address not acknowledged by client
         i2c_stop();
@@ -119,8 +142,10 @@ int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
     if (flags & I2C_MSG_READ) {
       // Read
       while (buf < buf_end) {
-        // Wait for read interrupt flag
-        while (!(TWI0.MSTATUS & TWI_RIF_bm));
+        // Wait for read interrupt flag, or write interrupt flag if arbitration was lost
+        while (!(TWI0.MSTATUS & (TWI_RIF_bm | TWI_WIF_bm)));
+        if (TWI0.MSTATUS & TWI_ARBLOST_bm)
+          return i2c_arbitration_lost();
 
         // Read byte
         *buf++ = TWI0.MDATA;
@@ -143,7 +168,9 @@ int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
         while (!(TWI0.MSTATUS & TWI_WIF_bm));
 
         // Check for errors
-        if (TWI0.MSTATUS & (TWI_ARBLOST_bm | TWI_BUSERR_bm))
+        if (TWI0.MSTATUS & TWI_ARBLOST_bm)
+          return i2c_arbitration_lost();
+        if (TWI0.MSTATUS & TWI_BUSERR_bm)
           return -I2C_ERR;
 
         // Check for NACK
@@ -164,4 +191,42 @@ int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
   return 0;
 }
 
+int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
+{
+  // Check if the I2C bus is configured
+  if (!configured)
+    return -I2C_ERR;
+
+  // Requeue the transfer if another controller wins arbitration
+  int rcode;
+  uint8_t attempts = 0;
+  do {
+    // Wait for any other controller (or a transaction with our target) to finish
+    if (!i2c_wait_for_idle()) {
+      rcode = -I2C_ERR_BUSY;
+      break;
+    }
+
+    rcode = i2c_transfer_once(addr, msgs, num_msgs);
+  } while (rcode == -I2C_ERR_ARBLOST && attempts++ < I2C_ARBLOST_RETRIES);
+
+  if (rcode < 0 && errors < UINT16_MAX) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { errors++; }
+  }
+
+  return rcode;
+}
+
+uint16_t i2c_get_errors()
+{
+  uint16_t count;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { count = errors; }
+  return count;
+}
+
+void i2c_clear_errors()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { errors = 0; }
+}
+
 #endif // defined(AVR)
\ No newline at end of file
@@ -28,12 +28,18 @@
 // Convert nanoseconds to ticks, adjust for function call overhead, rise times
 #define NS_TO_TICKS(ticks) (nanosecs_to_ticks(ticks) - 18)
 
+// How long to wait for another controller to release the bus
+#define BUS_FREE_TIMEOUT_US 5000
+
 // Drive modes for SCL line
 enum { I2C_DRIVE_PUSH_PULL, I2C_DRIVE_OPEN_DRAIN };
 
 // Is the I2C bus configured yet?
 static bool configured = false;
 
+// Number of failed transfers
+static uint16_t errors = 0;
+
 // Configured I2C timings (in ticks)
 static uint32_t delay; // Half SCL period
 static uint32_t half_delay; // Quarter SCL period
@@ -86,6 +92,19 @@ static inline bool i2c_get_sda()
   return HW_GPIOB_IN & GPIO_AVE_SDA;
 }
 
+// Stop driving the bus after losing arbitration, so the winning controller can continue
+// NOTE: Only possible with open-drain SCL, in push/pull mode we have to keep driving SCL high
+static inline void i2c_release_bus()
+{
+  HW_GPIOB_DIR &= ~GPIO_AVE_SDA;
+
+  if (drive_mode == I2C_DRIVE_OPEN_DRAIN) {
+    HW_GPIOB_DIR &= ~GPIO_AVE_SCL;
+  } else {
+    HW_GPIOB_OUT |= GPIO_AVE_SCL;
+  }
+}
+
 // Delay for a number of ticks
 static inline void i2c_delay(unsigned int ticks)
 {
@@ -93,6 +112,29 @@ static inline void i2c_delay(unsigned int ticks)
   while (gettick() - start < ticks);
 }
 
+// Wait for the bus to be free, with both lines released for a full SCL period
+static bool i2c_wait_for_bus_free()
+{
+  uint32_t start   = gettick();
+  uint32_t free_at = start;
+  uint32_t timeout = microsecs_to_ticks(BUS_FREE_TIMEOUT_US);
+  uint32_t lines   = GPIO_AVE_SCL | GPIO_AVE_SDA;
+
+  HW_GPIOB_DIR &= ~GPIO_AVE_SDA;
+  while (gettick() - start < timeout) {
+    uint32_t now = gettick();
+
+    // Restart the bus free period whenever another controller pulls a line low
+    if ((HW_GPIOB_IN & lines) != lines) {
+      free_at = now;
+    } else if (now - free_at >= 2 * delay) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 // I2C start condition
 static inline void i2c_start()
 {
@@ -103,8 +145,8 @@ static inline void i2c_start()
   i2c_delay(half_delay);
 }
 
-// I2C repeated start condition
-static inline void i2c_repeated_start()
+// I2C repeated start condition, returns false if arbitration was lost
+static inline bool i2c_repeated_start()
 {
   i2c_set_sda(1);
   i2c_delay(half_delay);
@@ -112,7 +154,12 @@ static inline void i2c_repeated_start()
   i2c_set_scl(1);
   i2c_delay(half_delay);
 
+  // Another controller is driving SDA, so it owns the bus
+  if (!i2c_get_sda())
+    return false;
+
   i2c_start();
+  return true;
 }
 
 // I2C stop condition
@@ -128,8 +175,8 @@ static inline void i2c_stop()
   i2c_delay(delay);
 }
 
-// Write a single bit
-static inline void i2c_write_bit(int bit)
+// Write a single bit, returns false if arbitration was lost
+static inline bool i2c_write_bit(int bit)
 {
   i2c_set_sda(bit);
   i2c_delay(half_delay);
@@ -137,8 +184,14 @@ static inline void i2c_write_bit(int bit)
   i2c_set_scl(1);
   i2c_delay(delay);
 
+  // We released SDA but it reads back low, another controller is sending a 0
+  if (bit && !i2c_get_sda())
+    return false;
+
   i2c_set_scl(0);
   i2c_delay(half_delay);
+
+  return true;
 }
 
 // Read a single bit
@@ -158,16 +211,19 @@ static inline int i2c_read_bit()
   return bit;
 }
 
-// Write a single byte
+// Write a single byte, returns 0 on ACK, negative error code on NACK or arbitration loss
 static inline int i2c_write_byte(uint8_t data)
 {
   for (uint8_t i = 0; i < 8; i++) {
-    i2c_write_bit(data & 0x80); // write the most-significant bit
+    // Write the most-significant bit
+    if (!i2c_write_bit(data & 0x80))
+      return -I2C_ERR_ARBLOST;
+
     data <<= 1;
   }
 
-  // Return inverted ACK bit - 'true' for ACK, 'false' for NACK
-  return !i2c_read_bit();
+  // Check the ACK bit
+  return i2c_read_bit() ? -I2C_ERR : 0;
 }
 
 // Read a single byte
@@ -205,7 +261,10 @@ static inline int i2c_bitbang_transfer(uint8_t addr, struct i2c_msg *msgs, uint8
     if (flags & I2C_MSG_RESTART) {
       i2c_start();
     } else if (msgs->flags & I2C_MSG_RESTART) {
-      i2c_repeated_start();
+      if (!i2c_repeated_start()) {
+        i2c_release_bus();
+        return -I2C_ERR_ARBLOST;
+      }
     }
 
     // Get flags for new message
@@ -217,12 +276,15 @@ static inline int i2c_bitbang_transfer(uint8_t addr, struct i2c_msg *msgs, uint8
       uint8_t addr_rw = (addr << 1) | (flags & I2C_MSG_READ);
 
       // Send address
-      int ack = i2c_write_byte(addr_rw);
+      int rcode = i2c_write_byte(addr_rw);
 
-      // Check for NACK
-      if (!ack) {
+      // Check for arbitration loss or NACK
+      if (rcode == -I2C_ERR_ARBLOST) {
+        i2c_release_bus();
+        return rcode;
+      } else if (rcode < 0) {
         i2c_stop();
-        return -I2C_ERR;
+        return rcode;
       }
 
       flags &= ~I2C_MSG_RESTART;
@@ -238,18 +300,24 @@ static inline int i2c_bitbang_transfer(uint8_t addr, struct i2c_msg *msgs, uint8
         *buf++ = i2c_read_byte();
 
         // ACK the byte, except for the last one
-        i2c_write_bit(buf == buf_end);
+        if (!i2c_write_bit(buf == buf_end)) {
+          i2c_release_bus();
+          return -I2C_ERR_ARBLOST;
+        }
       }
     } else {
       // Write
       while (buf < buf_end) {
         // Write byte
-        int ack = i2c_write_byte(*buf++);
+        int rcode = i2c_write_byte(*buf++);
 
-        // Check for NACK
-        if (!ack) {
+        // Check for arbitration loss or NACK
+        if (rcode == -I2C_ERR_ARBLOST) {
+          i2c_release_bus();
+          return rcode;
+        } else if (rcode < 0) {
           i2c_stop();
-          return -I2C_ERR;
+          return rcode;
         }
       }
     }
@@ -329,17 +397,36 @@ int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
   if (!configured)
     return -I2C_ERR;
 
-  // Disable interrupts
-  uint32_t level;
-  _CPU_ISR_Disable(level);
+  int result = -I2C_ERR_ARBLOST;
+  for (uint8_t attempt = 0; attempt <= I2C_ARBLOST_RETRIES && result == -I2C_ERR_ARBLOST; attempt++) {
+    // Wait for any other controller to finish, with interrupts enabled since this can take up to
+    // BUS_FREE_TIMEOUT_US. A controller that starts after the wait shows up as lost arbitration.
+    if (!i2c_wait_for_bus_free()) {
+      result = -I2C_ERR_BUSY;
+      break;
+    }
 
-  // Perform the transfer
-  int result = i2c_bitbang_transfer(addr, msgs, num_msgs);
+    // Only the transfer itself runs with interrupts disabled, so the bit timings hold
+    uint32_t level;
+    _CPU_ISR_Disable(level);
+    result = i2c_bitbang_transfer(addr, msgs, num_msgs);
+    _CPU_ISR_Restore(level);
+  }
 
-  // Re-enable interrupts
-  _CPU_ISR_Restore(level);
+  if (result < 0 && errors < UINT16_MAX)
+    errors++;
 
   return result;
 }
 
+uint16_t i2c_get_errors()
+{
+  return errors;
+}
+
+void i2c_clear_errors()
+{
+  errors = 0;
+}
+
 #endif // defined(HW_RVL)
\ No newline at end of file
@@ -35,7 +35,7 @@ static int ina700_reg_read_24(uint8_t addr, uint8_t reg, uint32_t *value)
     return rcode;
 
   // Combine the three bytes into a big-endian value
-  *value = (buf[0] << 16) | (buf[1] << 8) | buf[2];
+  *value = ((uint32_t)buf[0] << 16) | ((uint32_t)buf[1] << 8) | buf[2];
 
   return 0;
 }
@@ -66,12 +66,12 @@ int ina700_get_bus_voltage(uint8_t addr, uint16_t *voltage)
     return rcode;
 
   // Convert the raw register value to mV
-  *voltage = (regval * INA700_BUS_VOLTAGE_LSB) / 1000;
+  *voltage = ((uint32_t)regval * INA700_BUS_VOLTAGE_LSB) / 1000;
 
   return 0;
 }
 
-int ina700_get_temp(uint8_t addr, uint16_t *temp)
+int ina700_get_temp(uint8_t addr, float *temp)
 {
   int rcode;
 
@@ -80,8 +80,8 @@ int ina700_get_temp(uint8_t addr, uint16_t *temp)
   if ((rcode = ina700_reg_read_16(addr, INA700_REG_DIETEMP, &regval)) < 0)
     return rcode;
 
-  // Convert the raw register value to mC
-  *temp = regval * INA700_DIE_TEMP_LSB;
+  // Convert the raw register value to degrees C, the temperature is a signed 12-bit value in bits 15:4
+  *temp = ((int16_t)regval >> 4) * (INA700_DIE_TEMP_LSB / 1000.0f);
 
   return 0;
 }
@@ -96,7 +96,7 @@ int ina700_get_current(uint8_t addr, uint16_t *current)
     return rcode;
 
   // Convert the raw register value to mA
-  *current = (regval * INA700_CURRENT_LSB) / 1000;
+  *current = ((uint32_t)regval * INA700_CURRENT_LSB) / 1000;
 
   return 0;
 }
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "i2c.h"
 #include "i2c/ina700.h"
 #include "i2c/tmp1075.h"
@@ -13,12 +15,20 @@
 #define THUNDERVOLT_ADDR_HW2_REG_1V15   0x43
 #define THUNDERVOLT_ADDR_REG_1V8        0x41
 #define THUNDERVOLT_ADDR_REG_3V3        0x75
-#define THUNDERVOLT_ADDR_TMP            0x49
 #define THUNDERVOLT_ADDR_INA_1V0        0x44
 #define THUNDERVOLT_ADDR_INA_1V15       0x45
 #define THUNDERVOLT_ADDR_INA_1V8        0x46
 #define THUNDERVOLT_ADDR_INA_3V3        0x47
 
+// Setpoint calibration for each rail
+static struct thundervolt_calibration calibration[THUNDERVOLT_RAIL_3V3 + 1];
+
+#ifdef HW_RVL
+// The calibration is loaded from the Thundervolt on first use
+static bool calibration_loaded = false;
+static int load_calibration();
+#endif
+
 // Get the I2C address of the specified regulator rail
 static int get_regulator_i2c_addr(uint8_t rail)
 {
@@ -96,18 +106,11 @@ static int get_vpers_reg_addr(uint8_t rail)
 // Check if the specified voltage is valid for the given rail
 static bool is_valid_voltage(uint8_t rail, uint16_t voltage)
 {
-  switch (rail) {
-    case THUNDERVOLT_RAIL_1V0:
-      return voltage >= THUNDERVOLT_MIN_VOLTAGE_1V0 && voltage <= THUNDERVOLT_STOCK_VOLTAGE_1V0;
-    case THUNDERVOLT_RAIL_1V15:
-      return voltage >= THUNDERVOLT_MIN_VOLTAGE_1V15 && voltage <= THUNDERVOLT_STOCK_VOLTAGE_1V15;
-    case THUNDERVOLT_RAIL_1V8:
-      return voltage >= THUNDERVOLT_MIN_VOLTAGE_1V8 && voltage <= THUNDERVOLT_STOCK_VOLTAGE_1V8;
-    case THUNDERVOLT_RAIL_3V3:
-      return voltage >= THUNDERVOLT_MIN_VOLTAGE_3V3 && voltage <= THUNDERVOLT_STOCK_VOLTAGE_3V3;
-    default:
-      return false;
-  }
+  uint16_t min, max;
+  if (thundervolt_get_voltage_range(rail, &min, &max) != 0)
+    return false;
+
+  return voltage >= min && voltage <= max;
 }
 
 int thundervolt_get_hardware_revision(uint8_t *hw_rev)
@@ -130,6 +133,30 @@ int thundervolt_get_hardware_revision(uint8_t *hw_rev)
   return 0;
 }
 
+int thundervolt_get_voltage_range(uint8_t rail, uint16_t *min, uint16_t *max)
+{
+  switch (rail) {
+    case THUNDERVOLT_RAIL_1V0:
+      *min = THUNDERVOLT_MIN_VOLTAGE_1V0;
+      *max = THUNDERVOLT_STOCK_VOLTAGE_1V0;
+      return 0;
+    case THUNDERVOLT_RAIL_1V15:
+      *min = THUNDERVOLT_MIN_VOLTAGE_1V15;
+      *max = THUNDERVOLT_STOCK_VOLTAGE_1V15;
+      return 0;
+    case THUNDERVOLT_RAIL_1V8:
+      *min = THUNDERVOLT_MIN_VOLTAGE_1V8;
+      *max = THUNDERVOLT_STOCK_VOLTAGE_1V8;
+      return 0;
+    case THUNDERVOLT_RAIL_3V3:
+      *min = THUNDERVOLT_MIN_VOLTAGE_3V3;
+      *max = THUNDERVOLT_STOCK_VOLTAGE_3V3;
+      return 0;
+    default:
+      return -THUNDERVOLT_ERR_INVALID_RAIL;
+  }
+}
+
 bool thundervolt_i2c_scan()
 {
   return tps6286x_is_present(get_regulator_i2c_addr(THUNDERVOLT_RAIL_1V0)) &&
@@ -138,7 +165,87 @@ bool thundervolt_i2c_scan()
          tmp1075_is_present(THUNDERVOLT_ADDR_TMP);
 }
 
-int thundervolt_get_voltage(uint8_t rail, uint16_t *voltage)
+uint8_t thundervolt_i2c_find_missing()
+{
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_1V8; i++) {
+    int addr = get_regulator_i2c_addr(i);
+    if (!tps6286x_is_present(addr))
+      return addr;
+  }
+
+  if (!tps6381x_is_present())
+    return THUNDERVOLT_ADDR_REG_3V3;
+
+  if (!tmp1075_is_present(THUNDERVOLT_ADDR_TMP))
+    return THUNDERVOLT_ADDR_TMP;
+
+  return 0;
+}
+
+int thundervolt_get_regulator_health(uint8_t rail, uint8_t *health, uint8_t *addr, uint8_t *status)
+{
+  int reg_addr = get_regulator_i2c_addr(rail);
+  if (reg_addr < 0)
+    return reg_addr;
+
+  *addr   = reg_addr;
+  *status = 0;
+
+  int rcode = rail == THUNDERVOLT_RAIL_3V3 ? tps6381x_get_status(status) : tps6286x_get_status(reg_addr, status);
+  // Only a NACK means the regulator itself didn't respond, a lost arbitration or busy bus says nothing about it
+  if (rcode == -I2C_ERR) {
+    *health = THUNDERVOLT_HEALTH_NO_RESPONSE;
+    return 0;
+  }
+  if (rcode < 0)
+    return rcode;
+
+  // The TPS6381x reports power-good, rather than faults
+  if (rail == THUNDERVOLT_RAIL_3V3) {
+    *health = (*status & TPS6381X_TSD ? THUNDERVOLT_HEALTH_THERM : 0) |
+              (*status & TPS6381X_PG ? 0 : THUNDERVOLT_HEALTH_PG_LOST);
+  } else {
+    *health = (*status & TPS6286X_THERM ? THUNDERVOLT_HEALTH_THERM : 0) |
+              (*status & TPS6286X_HICCUP ? THUNDERVOLT_HEALTH_HICCUP : 0) |
+              (*status & TPS6286X_UVLO ? THUNDERVOLT_HEALTH_UVLO : 0);
+  }
+
+  return 0;
+}
+
+// Convert a regulator setpoint to the calibrated output voltage, in mV
+static uint16_t setpoint_to_voltage(uint8_t rail, uint16_t setpoint)
+{
+  uint16_t min, stock;
+  thundervolt_get_voltage_range(rail, &min, &stock);
+
+  const struct thundervolt_calibration *cal = &calibration[rail];
+  return setpoint + cal->offset + ((int32_t)cal->gain * ((int32_t)setpoint - stock)) / 1000;
+}
+
+// Convert a calibrated output voltage to a regulator setpoint, in mV
+static uint16_t voltage_to_setpoint(uint8_t rail, uint16_t voltage)
+{
+  uint16_t min, stock;
+  thundervolt_get_voltage_range(rail, &min, &stock);
+
+  // Solve voltage = setpoint + offset + gain * (setpoint - stock) / 1000 for the setpoint, rounding to the nearest mV
+  const struct thundervolt_calibration *cal = &calibration[rail];
+  int32_t num                               = 1000 * ((int32_t)voltage - cal->offset) + (int32_t)cal->gain * stock;
+  int32_t den                               = 1000 + cal->gain;
+  int32_t setpoint                          = (num + den / 2) / den;
+
+  // Never let the calibration take the regulator more than a trim outside the rail's range
+  if (setpoint > stock + THUNDERVOLT_CAL_MAX_TRIM)
+    return stock + THUNDERVOLT_CAL_MAX_TRIM;
+  if (setpoint < min - THUNDERVOLT_CAL_MAX_TRIM)
+    return min - THUNDERVOLT_CAL_MAX_TRIM;
+
+  return setpoint;
+}
+
+// Get the regulator setpoint for the specified rail, in mV
+static int get_setpoint(uint8_t rail, uint16_t *voltage)
 {
   switch (rail) {
     case THUNDERVOLT_RAIL_1V0:
@@ -159,11 +266,9 @@ int thundervolt_get_voltage(uint8_t rail, uint16_t *voltage)
   }
 }
 
-int thundervolt_set_voltage(uint8_t rail, uint16_t voltage)
+// Set the regulator setpoint for the specified rail, in mV
+static int set_setpoint(uint8_t rail, uint16_t voltage)
 {
-  if (!is_valid_voltage(rail, voltage))
-    return -THUNDERVOLT_ERR_INVALID_VOLTAGE;
-
   switch (rail) {
     case THUNDERVOLT_RAIL_1V0:
     case THUNDERVOLT_RAIL_1V15: {
@@ -183,6 +288,84 @@ int thundervolt_set_voltage(uint8_t rail, uint16_t voltage)
   }
 }
 
+int thundervolt_get_voltage(uint8_t rail, uint16_t *voltage)
+{
+  int rcode;
+
+#ifdef HW_RVL
+  if ((rcode = load_calibration()) < 0)
+    return rcode;
+#endif
+
+  uint16_t setpoint;
+  if ((rcode = get_setpoint(rail, &setpoint)) != 0)
+    return rcode;
+
+  *voltage = setpoint_to_voltage(rail, setpoint);
+
+  return 0;
+}
+
+int thundervolt_set_voltage(uint8_t rail, uint16_t voltage)
+{
+  if (!is_valid_voltage(rail, voltage))
+    return -THUNDERVOLT_ERR_INVALID_VOLTAGE;
+
+#ifdef HW_RVL
+  int rcode;
+  if ((rcode = load_calibration()) < 0)
+    return rcode;
+#endif
+
+  // Apply the board's calibration, so the rail runs at the requested voltage rather than the raw setpoint
+  return set_setpoint(rail, voltage_to_setpoint(rail, voltage));
+}
+
+int thundervolt_set_calibration(uint8_t rail, const struct thundervolt_calibration *cal)
+{
+  if (rail > THUNDERVOLT_RAIL_3V3)
+    return -THUNDERVOLT_ERR_INVALID_RAIL;
+
+  calibration[rail] = *cal;
+
+  return 0;
+}
+
+int thundervolt_set_forced_pwm(uint8_t rail, bool enable)
+{
+  switch (rail) {
+    case THUNDERVOLT_RAIL_1V0:
+    case THUNDERVOLT_RAIL_1V15:
+    case THUNDERVOLT_RAIL_1V8: {
+      // Determine I2C address based on HW revision
+      int addr = get_regulator_i2c_addr(rail);
+      if (addr < 0)
+        return addr;
+
+      return tps6286x_set_forced_pwm(addr, enable);
+    }
+    case THUNDERVOLT_RAIL_3V3:
+      return tps6381x_set_forced_pwm(enable);
+    default:
+      return -THUNDERVOLT_ERR_INVALID_RAIL;
+  }
+}
+
+int thundervolt_get_measured_voltage(uint8_t rail, uint16_t *voltage)
+{
+  // Check if power monitoring is supported
+  if (!thundervolt_has_power_monitoring())
+    return -THUNDERVOLT_ERR_NOT_SUPPORTED;
+
+  // Determine I2C address based on rail
+  int addr = get_power_monitor_i2c_addr(rail);
+  if (addr < 0)
+    return addr;
+
+  // Read the bus voltage from the INA700
+  return ina700_get_bus_voltage(addr, voltage);
+}
+
 int thundervolt_get_current(uint8_t rail, uint16_t *current)
 {
   // Check if power monitoring is supported
@@ -219,6 +402,27 @@ int thundervolt_get_temp(float *temp)
   return tmp1075_get_temp(THUNDERVOLT_ADDR_TMP, temp);
 }
 
+int thundervolt_get_max_temp(float *temp)
+{
+  int rcode;
+
+  // Start with the board temperature from the TMP1075
+  if ((rcode = thundervolt_get_temp(temp)) != 0)
+    return rcode;
+
+  if (!thundervolt_has_power_monitoring())
+    return 0;
+
+  // The INA700s sit next to the regulators, so their dies can run hotter than the TMP1075
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    float die_temp;
+    if (ina700_get_temp(get_power_monitor_i2c_addr(i), &die_temp) == 0 && die_temp > *temp)
+      *temp = die_temp;
+  }
+
+  return 0;
+}
+
 int thundervolt_get_otsd_limit(int8_t *temp)
 {
   // Read the high limit from the TMP1075
@@ -242,6 +446,45 @@ int thundervolt_set_otsd_limit(int8_t temp)
   return tmp1075_set_low_limit(THUNDERVOLT_ADDR_TMP, temp - 5.0f);
 }
 
+int thundervolt_configure_otsd(uint8_t ctrl)
+{
+  // TMP1075 settings for each OTSD_CTRL rate and fault count field value
+  static const uint16_t conv_rates[]   = {TMP1075_CONV_RATE_27_5, TMP1075_CONV_RATE_55, TMP1075_CONV_RATE_110,
+                                          TMP1075_CONV_RATE_220};
+  static const uint16_t fault_counts[] = {TMP1075_FAULT_COUNT_1, TMP1075_FAULT_COUNT_2, TMP1075_FAULT_COUNT_3,
+                                          TMP1075_FAULT_COUNT_4};
+
+  int rcode;
+
+  uint8_t rate   = ctrl & THUNDERVOLT_OTSD_RATE;
+  uint8_t faults = (ctrl & THUNDERVOLT_OTSD_FAULTS) >> THUNDERVOLT_OTSD_FAULTS_SHIFT;
+
+  if ((rcode = tmp1075_set_conversion_rate(THUNDERVOLT_ADDR_TMP, conv_rates[rate])) != 0)
+    return rcode;
+
+  if ((rcode = tmp1075_set_fault_count(THUNDERVOLT_ADDR_TMP, fault_counts[faults])) != 0)
+    return rcode;
+
+  return tmp1075_set_alert_mode(THUNDERVOLT_ADDR_TMP, (ctrl & THUNDERVOLT_OTSD_INTERRUPT)
+                                                          ? TMP1075_ALERT_MODE_INTERRUPT
+                                                          : TMP1075_ALERT_MODE_COMPARATOR);
+}
+
+uint16_t thundervolt_get_otsd_worst_case_latency(uint8_t ctrl)
+{
+  // Conversion periods, rounded up to whole ms, and the fault counts, using the slower of
+  // the TMP1075 and TMP1075N for each setting since the board may be fitted with either
+  static const uint8_t period_ms[] = {28, 55, 110, 220};
+  static const uint8_t faults[]    = {1, 2, 4, 6};
+
+  // The limit may be crossed just after a conversion starts, so the first fault is only
+  // seen one conversion later. The ALERT interrupt then drops EN within a few microseconds.
+  uint8_t period = period_ms[ctrl & THUNDERVOLT_OTSD_RATE];
+  uint8_t count  = faults[(ctrl & THUNDERVOLT_OTSD_FAULTS) >> THUNDERVOLT_OTSD_FAULTS_SHIFT];
+
+  return (count + 1) * period;
+}
+
 bool thundervolt_has_power_monitoring()
 {
   // Get the hardware revision
@@ -255,18 +498,168 @@ bool thundervolt_has_power_monitoring()
 }
 
 #ifdef HW_RVL
+// Whether SMBus Packet Error Checking is enabled on the Thundervolt
+static bool pec_enabled = false;
+
+// Whether pec_enabled has been read back from the Thundervolt, which keeps PEC enabled across homebrew restarts
+static bool pec_synced = false;
+
+// Pick up the PEC mode the Thundervolt is already in, a plain single register read works in either mode
+static int sync_pec()
+{
+  if (pec_synced)
+    return 0;
+
+  uint8_t bus_ctrl;
+  int rcode = i2c_reg_read_block(THUNDERVOLT_I2C_ADDR, THUNDERVOLT_REG_BUS_CTRL, &bus_ctrl, 1);
+  if (rcode < 0)
+    return rcode;
+
+  pec_enabled = bus_ctrl & THUNDERVOLT_BUS_PEC;
+  pec_synced  = true;
+
+  return 0;
+}
+
+// Read a block of Thundervolt registers, with PEC if enabled
+static int read_regs(uint8_t reg, uint8_t *buf, uint8_t len)
+{
+  int rcode;
+  if ((rcode = sync_pec()) < 0)
+    return rcode;
+
+  if (pec_enabled)
+    return i2c_reg_read_block_pec(THUNDERVOLT_I2C_ADDR, reg, buf, len);
+
+  return i2c_reg_read_block(THUNDERVOLT_I2C_ADDR, reg, buf, len);
+}
+
+// Write a block of Thundervolt registers, with PEC if enabled
+static int write_regs(uint8_t reg, const uint8_t *buf, uint8_t len)
+{
+  int rcode;
+
+  if (len > I2C_BLOCK_MAX)
+    return -I2C_ERR;
+
+  if ((rcode = sync_pec()) < 0)
+    return rcode;
+
+  if (!pec_enabled) {
+    uint8_t tx[I2C_BLOCK_MAX + 1];
+    tx[0] = reg;
+    memcpy(&tx[1], buf, len);
+    return i2c_write(THUNDERVOLT_I2C_ADDR, tx, len + 1);
+  }
+
+  // The Thundervolt NACKs PEC writes that don't fit its buffer, refuse them up front with a clear error
+  if (len > THUNDERVOLT_PEC_WRITE_MAX)
+    return -THUNDERVOLT_ERR_TOO_LONG;
+
+  // The Thundervolt silently discards writes with a bad PEC, so check its error counter to
+  // find out if the write was applied, and retry if it wasn't. The counter wraps, so any change means
+  // a discard, and at most one write can be discarded between two readings.
+  uint8_t errors_before, errors_after;
+  if ((rcode = read_regs(THUNDERVOLT_REG_PEC_ERRORS, &errors_before, 1)) < 0)
+    return rcode;
+
+  for (uint8_t attempt = 0; attempt <= I2C_PEC_RETRIES; attempt++) {
+    if ((rcode = i2c_reg_write_block_pec(THUNDERVOLT_I2C_ADDR, reg, buf, len)) < 0)
+      return rcode;
+
+    if ((rcode = read_regs(THUNDERVOLT_REG_PEC_ERRORS, &errors_after, 1)) < 0)
+      return rcode;
+
+    if (errors_after == errors_before)
+      return 0;
+
+    errors_before = errors_after;
+  }
+
+  return -I2C_ERR_PEC;
+}
+
+static inline int read_reg(uint8_t reg, uint8_t *value)
+{
+  return read_regs(reg, value, 1);
+}
+
+static inline int write_reg(uint8_t reg, uint8_t value)
+{
+  return write_regs(reg, &value, 1);
+}
+
+// Read-modify-write a Thundervolt register
+static int update_reg(uint8_t reg, uint8_t mask, uint8_t value)
+{
+  int rcode;
+
+  uint8_t old_value;
+  if ((rcode = read_reg(reg, &old_value)) < 0)
+    return rcode;
+
+  uint8_t new_value = (old_value & ~mask) | (value & mask);
+  if (new_value == old_value)
+    return 0;
+
+  return write_reg(reg, new_value);
+}
+
+// Load the setpoint calibration from the Thundervolt, it only changes when the Thundervolt reboots
+static int load_calibration()
+{
+  if (calibration_loaded)
+    return 0;
+
+  uint8_t buf[THUNDERVOLT_REG_CAL_GAIN_3V3 - THUNDERVOLT_REG_CAL_CTRL + 1];
+  int rcode = read_regs(THUNDERVOLT_REG_CAL_CTRL, buf, sizeof(buf));
+  if (rcode < 0)
+    return rcode;
+
+  // Boards which haven't been calibrated, or firmware without calibration support, get no correction
+  bool valid = buf[0] != 0xFF && (buf[0] & THUNDERVOLT_CAL_VALID);
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    calibration[i].offset = valid ? (int8_t)buf[THUNDERVOLT_REG_CAL_OFFSET_1V0 - THUNDERVOLT_REG_CAL_CTRL + i] : 0;
+    calibration[i].gain   = valid ? (int8_t)buf[THUNDERVOLT_REG_CAL_GAIN_1V0 - THUNDERVOLT_REG_CAL_CTRL + i] : 0;
+  }
+
+  calibration_loaded = true;
+
+  return 0;
+}
+
 bool thundervolt_is_present()
 {
   return i2c_detect(THUNDERVOLT_I2C_ADDR);
 }
 
+int thundervolt_set_pec_enabled(bool enable)
+{
+  int rcode;
+
+  // Write the BUS_CTRL register in the current mode, the new mode applies from the next transaction
+  if ((rcode = write_reg(THUNDERVOLT_REG_BUS_CTRL, enable ? THUNDERVOLT_BUS_PEC : 0)) < 0)
+    return rcode;
+
+  pec_enabled = enable;
+  pec_synced  = true;
+
+  return 0;
+}
+
+bool thundervolt_get_pec_enabled()
+{
+  sync_pec();
+  return pec_enabled;
+}
+
 int thundervolt_get_safemode_enabled(bool *safemode)
 {
   int rcode;
 
   // Read the status register
   uint8_t status;
-  if ((rcode = i2c_reg_read_byte(THUNDERVOLT_I2C_ADDR, THUNDERVOLT_REG_STATUS, &status)) != 0)
+  if ((rcode = read_reg(THUNDERVOLT_REG_STATUS, &status)) != 0)
     return rcode;
 
   // Extract the safe mode bit
@@ -283,7 +676,14 @@ int thundervolt_get_persisted_voltage(uint8_t rail, uint16_t *voltage)
     return reg;
 
   // Read the persisted voltage from the VPERS register
-  return i2c_reg_read_word(THUNDERVOLT_I2C_ADDR, reg, voltage);
+  uint8_t buf[2];
+  int rcode = read_regs(reg, buf, sizeof(buf));
+  if (rcode < 0)
+    return rcode;
+
+  *voltage = buf[0] | (buf[1] << 8);
+
+  return 0;
 }
 
 int thundervolt_set_persisted_voltage(uint8_t rail, uint16_t voltage)
@@ -298,18 +698,19 @@ int thundervolt_set_persisted_voltage(uint8_t rail, uint16_t voltage)
     return reg;
 
   // Write the voltage to the VPERS register
-  return i2c_reg_write_word(THUNDERVOLT_I2C_ADDR, reg, voltage);
+  uint8_t buf[] = {voltage & 0xFF, voltage >> 8};
+  return write_regs(reg, buf, sizeof(buf));
 }
 
 int thundervolt_clear_persisted_values()
 {
-  return i2c_reg_update_byte(THUNDERVOLT_I2C_ADDR, THUNDERVOLT_REG_CONFIG, THUNDERVOLT_CLEAR, THUNDERVOLT_CLEAR);
+  return update_reg(THUNDERVOLT_REG_CONFIG, THUNDERVOLT_CLEAR, THUNDERVOLT_CLEAR);
 }
 
 int thundervolt_get_otsd_enabled(bool *enable)
 {
   uint8_t config;
-  int rcode = i2c_reg_read_byte(THUNDERVOLT_I2C_ADDR, THUNDERVOLT_REG_CONFIG, &config);
+  int rcode = read_reg(THUNDERVOLT_REG_CONFIG, &config);
   if (rcode < 0)
     return rcode;
 
@@ -320,8 +721,7 @@ int thundervolt_get_otsd_enabled(bool *enable)
 
 int thundervolt_set_otsd_enabled(bool enable)
 {
-  return i2c_reg_update_byte(THUNDERVOLT_I2C_ADDR, THUNDERVOLT_REG_CONFIG, THUNDERVOLT_OTSD,
-                             enable ? THUNDERVOLT_OTSD : 0);
+  return update_reg(THUNDERVOLT_REG_CONFIG, THUNDERVOLT_OTSD, enable ? THUNDERVOLT_OTSD : 0);
 }
 
 int thundervolt_get_persisted_otsd_limit(int8_t *temp)
@@ -330,7 +730,7 @@ int thundervolt_get_persisted_otsd_limit(int8_t *temp)
 
   // Read the over-temperature limit from the device
   uint8_t reg_val;
-  rcode = i2c_reg_read_byte(THUNDERVOLT_I2C_ADDR, THUNDERVOLT_REG_OTSD_TEMP, &reg_val);
+  rcode = read_reg(THUNDERVOLT_REG_OTSD_TEMP, &reg_val);
   if (rcode < 0)
     return rcode;
 
@@ -341,18 +741,40 @@ int thundervolt_get_persisted_otsd_limit(int8_t *temp)
 
 int thundervolt_set_persisted_otsd_limit(int8_t temp)
 {
-  return i2c_reg_write_byte(THUNDERVOLT_I2C_ADDR, THUNDERVOLT_REG_OTSD_TEMP, (uint8_t)temp);
+  return write_reg(THUNDERVOLT_REG_OTSD_TEMP, (uint8_t)temp);
+}
+
+int thundervolt_get_persisted_otsd_ctrl(uint8_t *ctrl)
+{
+  return read_reg(THUNDERVOLT_REG_OTSD_CTRL, ctrl);
+}
+
+int thundervolt_set_persisted_otsd_ctrl(uint8_t ctrl)
+{
+  return write_reg(THUNDERVOLT_REG_OTSD_CTRL, ctrl);
+}
+
+int thundervolt_get_otsd_latency(uint16_t *latency)
+{
+  uint8_t buf[2];
+  int rcode = read_regs(THUNDERVOLT_REG_OTSD_LATENCY_L, buf, sizeof(buf));
+  if (rcode < 0)
+    return rcode;
+
+  *latency = buf[0] | (buf[1] << 8);
+
+  return 0;
 }
 
 int thundervolt_get_software_revision(uint8_t *sw_rev)
 {
-  return i2c_reg_read_byte(THUNDERVOLT_I2C_ADDR, THUNDERVOLT_REG_SWREV, sw_rev);
+  return read_reg(THUNDERVOLT_REG_SWREV, sw_rev);
 }
 
 int thundervolt_get_led_enabled(bool *enable)
 {
   uint8_t config;
-  int rcode = i2c_reg_read_byte(THUNDERVOLT_I2C_ADDR, THUNDERVOLT_REG_CONFIG, &config);
+  int rcode = read_reg(THUNDERVOLT_REG_CONFIG, &config);
   if (rcode < 0)
     return rcode;
 
@@ -363,7 +785,466 @@ int thundervolt_get_led_enabled(bool *enable)
 
 int thundervolt_set_led_enabled(bool enable)
 {
-  return i2c_reg_update_byte(THUNDERVOLT_I2C_ADDR, THUNDERVOLT_REG_CONFIG, THUNDERVOLT_LED,
-                             enable ? THUNDERVOLT_LED : 0);
+  return update_reg(THUNDERVOLT_REG_CONFIG, THUNDERVOLT_LED, enable ? THUNDERVOLT_LED : 0);
+}
+
+int thundervolt_get_history(struct thundervolt_history_record *records, uint8_t max_records, uint8_t *num_records)
+{
+  int rcode;
+
+  *num_records = 0;
+
+  // Map the telemetry history into the register window
+  if ((rcode = write_reg(THUNDERVOLT_REG_WINDOW, THUNDERVOLT_WINDOW_HISTORY)) < 0)
+    return rcode;
+
+  // Find out how many records are available
+  uint8_t available;
+  if ((rcode = read_reg(THUNDERVOLT_REG_HIST_COUNT, &available)) < 0)
+    return rcode;
+
+  if (available > max_records)
+    available = max_records;
+
+  // Read the records a window at a time, consuming them as we go
+  while (*num_records < available) {
+    uint8_t count = available - *num_records;
+    if (count > THUNDERVOLT_HIST_RECORDS_PER_WINDOW)
+      count = THUNDERVOLT_HIST_RECORDS_PER_WINDOW;
+
+    // Read the oldest records in a single burst
+    uint8_t buf[THUNDERVOLT_HIST_RECORDS_PER_WINDOW * THUNDERVOLT_HIST_RECORD_SIZE];
+    if ((rcode = read_regs(THUNDERVOLT_REG_WINDOW_BASE, buf, count * THUNDERVOLT_HIST_RECORD_SIZE)) < 0)
+      return rcode;
+
+    // Decode the records, they are packed little-endian
+    for (uint8_t i = 0; i < count; i++) {
+      uint8_t *raw                              = &buf[i * THUNDERVOLT_HIST_RECORD_SIZE];
+      struct thundervolt_history_record *record = &records[(*num_records)++];
+
+      record->temp_min  = (int8_t)raw[THUNDERVOLT_HIST_TEMP_MIN];
+      record->temp_max  = (int8_t)raw[THUNDERVOLT_HIST_TEMP_MAX];
+      record->temp_avg  = (int8_t)raw[THUNDERVOLT_HIST_TEMP_AVG];
+      record->samples   = raw[THUNDERVOLT_HIST_SAMPLES];
+      record->power_min = raw[THUNDERVOLT_HIST_POWER_MIN] | (raw[THUNDERVOLT_HIST_POWER_MIN + 1] << 8);
+      record->power_avg = raw[THUNDERVOLT_HIST_POWER_AVG] | (raw[THUNDERVOLT_HIST_POWER_AVG + 1] << 8);
+      record->power_max = raw[THUNDERVOLT_HIST_POWER_MAX] | (raw[THUNDERVOLT_HIST_POWER_MAX + 1] << 8);
+    }
+
+    // Consume the records we just read
+    if ((rcode = write_reg(THUNDERVOLT_REG_HIST_POP, count)) < 0)
+      return rcode;
+  }
+
+  return 0;
+}
+
+int thundervolt_get_boot_trace(struct thundervolt_boot_event *events, uint8_t max_events, uint8_t *num_events)
+{
+  int rcode;
+
+  *num_events = 0;
+
+  // Map the boot trace into the register window
+  if ((rcode = write_reg(THUNDERVOLT_REG_WINDOW, THUNDERVOLT_WINDOW_BOOT_TRACE)) < 0)
+    return rcode;
+
+  // Read the whole trace in a single burst
+  uint8_t buf[THUNDERVOLT_TRACE_MAX_ENTRIES * THUNDERVOLT_TRACE_ENTRY_SIZE];
+  if ((rcode = read_regs(THUNDERVOLT_REG_WINDOW_BASE, buf, sizeof(buf))) < 0)
+    return rcode;
+
+  // Decode the events, stopping at the first unused entry
+  for (uint8_t i = 0; i < THUNDERVOLT_TRACE_MAX_ENTRIES && *num_events < max_events; i++) {
+    uint8_t *raw = &buf[i * THUNDERVOLT_TRACE_ENTRY_SIZE];
+    if (raw[THUNDERVOLT_TRACE_EVENT] == 0)
+      break;
+
+    // Convert the timestamp from 1/32768s units to microseconds
+    uint16_t ticks = raw[THUNDERVOLT_TRACE_TIME] | (raw[THUNDERVOLT_TRACE_TIME + 1] << 8);
+
+    struct thundervolt_boot_event *event = &events[(*num_events)++];
+    event->event                         = raw[THUNDERVOLT_TRACE_EVENT];
+    event->time_us                       = (uint32_t)ticks * 15625 / 512;
+  }
+
+  return 0;
+}
+
+int thundervolt_get_faults(bool saved, struct thundervolt_fault *faults, uint8_t max_faults, uint8_t *num_faults)
+{
+  int rcode;
+
+  *num_faults = 0;
+
+  // Map the fault log into the register window
+  uint8_t window = saved ? THUNDERVOLT_WINDOW_FAULTS_SAVED : THUNDERVOLT_WINDOW_FAULTS;
+  if ((rcode = write_reg(THUNDERVOLT_REG_WINDOW, window)) < 0)
+    return rcode;
+
+  // Read the whole log in a single burst
+  uint8_t max_records = saved ? THUNDERVOLT_FAULT_MAX_SAVED : THUNDERVOLT_FAULT_MAX_RECORDS;
+  uint8_t buf[THUNDERVOLT_FAULT_MAX_RECORDS * THUNDERVOLT_FAULT_RECORD_SIZE];
+  if ((rcode = read_regs(THUNDERVOLT_REG_WINDOW_BASE, buf, max_records * THUNDERVOLT_FAULT_RECORD_SIZE)) < 0)
+    return rcode;
+
+  // Decode the records, stopping at the first unused one
+  for (uint8_t i = 0; i < max_records && *num_faults < max_faults; i++) {
+    uint8_t *raw = &buf[i * THUNDERVOLT_FAULT_RECORD_SIZE];
+    if (raw[THUNDERVOLT_FAULT_EVENT] == 0)
+      break;
+
+    uint8_t *time = &raw[THUNDERVOLT_FAULT_TIME];
+
+    struct thundervolt_fault *fault = &faults[(*num_faults)++];
+    fault->event                    = raw[THUNDERVOLT_FAULT_EVENT];
+    fault->time_ms                  = time[0] | (time[1] << 8) | ((uint32_t)time[2] << 16) | ((uint32_t)time[3] << 24);
+    fault->addr                     = raw[THUNDERVOLT_FAULT_ADDR];
+    fault->data                     = raw[THUNDERVOLT_FAULT_DATA];
+    fault->temp                     = raw[THUNDERVOLT_FAULT_TEMP];
+  }
+
+  return 0;
+}
+
+// Decode a little-endian word from a buffer
+static inline uint16_t get_le16(const uint8_t *buf)
+{
+  return buf[0] | (buf[1] << 8);
+}
+
+// Decode a little-endian long from a buffer
+static inline uint32_t get_le32(const uint8_t *buf)
+{
+  return get_le16(buf) | ((uint32_t)get_le16(buf + 2) << 16);
+}
+
+int thundervolt_get_regulator_faults(uint8_t faults[THUNDERVOLT_RAIL_3V3 + 1])
+{
+  return read_regs(THUNDERVOLT_REG_HEALTH_1V0, faults, THUNDERVOLT_RAIL_3V3 + 1);
+}
+
+int thundervolt_clear_regulator_faults()
+{
+  uint8_t clear[THUNDERVOLT_RAIL_3V3 + 1] = {0xFF, 0xFF, 0xFF, 0xFF};
+  return write_regs(THUNDERVOLT_REG_HEALTH_1V0, clear, sizeof(clear));
+}
+
+int thundervolt_get_counters(struct thundervolt_counters *counters)
+{
+  int rcode;
+
+  // Map the counters into the register window
+  if ((rcode = write_reg(THUNDERVOLT_REG_WINDOW, THUNDERVOLT_WINDOW_COUNTERS)) < 0)
+    return rcode;
+
+  // Read all the counters in a single burst from offset 0, so they are latched together
+  uint8_t buf[THUNDERVOLT_COUNT_SIZE];
+  if ((rcode = read_regs(THUNDERVOLT_REG_WINDOW_BASE, buf, sizeof(buf))) < 0)
+    return rcode;
+
+  counters->transactions   = get_le32(&buf[THUNDERVOLT_COUNT_TRANSACTIONS]);
+  counters->bytes          = get_le32(&buf[THUNDERVOLT_COUNT_BYTES]);
+  counters->rejected       = get_le16(&buf[THUNDERVOLT_COUNT_REJECTED]);
+  counters->stretches      = get_le16(&buf[THUNDERVOLT_COUNT_STRETCHES]);
+  counters->isr_max_cycles = get_le16(&buf[THUNDERVOLT_COUNT_ISR_MAX]);
+  counters->eeprom_writes  = get_le32(&buf[THUNDERVOLT_COUNT_EEPROM_WRITES]);
+  counters->bus_errors     = get_le16(&buf[THUNDERVOLT_COUNT_BUS_ERRORS]);
+  counters->isr_overruns   = get_le16(&buf[THUNDERVOLT_COUNT_ISR_OVERRUNS]);
+
+  return 0;
+}
+
+int thundervolt_clear_counters()
+{
+  return write_reg(THUNDERVOLT_REG_COUNTERS_CLEAR, 1);
+}
+
+int thundervolt_get_u10_delay(uint8_t *delay)
+{
+  return read_reg(THUNDERVOLT_REG_U10_DELAY, delay);
+}
+
+int thundervolt_set_u10_delay(uint8_t delay)
+{
+  return write_reg(THUNDERVOLT_REG_U10_DELAY, delay);
+}
+
+int thundervolt_get_governor_enabled(bool *enable)
+{
+  uint8_t config;
+  int rcode = read_reg(THUNDERVOLT_REG_CONFIG, &config);
+  if (rcode < 0)
+    return rcode;
+
+  *enable = config & THUNDERVOLT_GOVERNOR;
+
+  return 0;
+}
+
+int thundervolt_set_governor_enabled(bool enable)
+{
+  return update_reg(THUNDERVOLT_REG_CONFIG, THUNDERVOLT_GOVERNOR, enable ? THUNDERVOLT_GOVERNOR : 0);
+}
+
+int thundervolt_get_persisted_governor_margin(uint8_t *margin)
+{
+  return read_reg(THUNDERVOLT_REG_GOV_MARGIN, margin);
+}
+
+int thundervolt_set_persisted_governor_margin(uint8_t margin)
+{
+  return write_reg(THUNDERVOLT_REG_GOV_MARGIN, margin);
+}
+
+int thundervolt_get_throttle(uint8_t *throttle)
+{
+  return read_reg(THUNDERVOLT_REG_THROTTLE, throttle);
+}
+
+int thundervolt_request_calibration()
+{
+  return update_reg(THUNDERVOLT_REG_CAL_CTRL, THUNDERVOLT_CAL_REQUEST, THUNDERVOLT_CAL_REQUEST);
+}
+
+int thundervolt_get_calibration(uint8_t rail, struct thundervolt_calibration *cal)
+{
+  if (rail > THUNDERVOLT_RAIL_3V3)
+    return -THUNDERVOLT_ERR_INVALID_RAIL;
+
+  int rcode;
+  if ((rcode = load_calibration()) < 0)
+    return rcode;
+
+  *cal = calibration[rail];
+
+  return 0;
+}
+
+int thundervolt_get_persisted_avp_gain(uint8_t rail, uint8_t *gain)
+{
+  if (rail > THUNDERVOLT_RAIL_3V3)
+    return -THUNDERVOLT_ERR_INVALID_RAIL;
+
+  return read_reg(THUNDERVOLT_REG_AVP_GAIN_1V0 + rail, gain);
+}
+
+int thundervolt_set_persisted_avp_gain(uint8_t rail, uint8_t gain)
+{
+  if (rail > THUNDERVOLT_RAIL_3V3)
+    return -THUNDERVOLT_ERR_INVALID_RAIL;
+
+  return write_reg(THUNDERVOLT_REG_AVP_GAIN_1V0 + rail, gain);
+}
+
+int thundervolt_get_persisted_mode(uint8_t rail, uint8_t *mode)
+{
+  if (rail > THUNDERVOLT_RAIL_3V3)
+    return -THUNDERVOLT_ERR_INVALID_RAIL;
+
+  uint8_t ctrl;
+  int rcode = read_reg(THUNDERVOLT_REG_MODE_CTRL, &ctrl);
+  if (rcode < 0)
+    return rcode;
+
+  *mode = (ctrl >> THUNDERVOLT_MODE_SHIFT(rail)) & THUNDERVOLT_MODE_MASK;
+
+  return 0;
+}
+
+int thundervolt_set_persisted_mode(uint8_t rail, uint8_t mode)
+{
+  if (rail > THUNDERVOLT_RAIL_3V3)
+    return -THUNDERVOLT_ERR_INVALID_RAIL;
+
+  return update_reg(THUNDERVOLT_REG_MODE_CTRL, THUNDERVOLT_MODE_MASK << THUNDERVOLT_MODE_SHIFT(rail),
+                    mode << THUNDERVOLT_MODE_SHIFT(rail));
+}
+
+int thundervolt_get_persisted_fpwm_threshold(uint8_t rail, uint16_t *current)
+{
+  if (rail > THUNDERVOLT_RAIL_3V3)
+    return -THUNDERVOLT_ERR_INVALID_RAIL;
+
+  uint8_t reg_val;
+  int rcode = read_reg(THUNDERVOLT_REG_FPWM_TH_1V0 + rail, &reg_val);
+  if (rcode < 0)
+    return rcode;
+
+  *current = reg_val * 20;
+
+  return 0;
+}
+
+int thundervolt_set_persisted_fpwm_threshold(uint8_t rail, uint16_t current)
+{
+  if (rail > THUNDERVOLT_RAIL_3V3)
+    return -THUNDERVOLT_ERR_INVALID_RAIL;
+
+  uint16_t reg_val = (current + 10) / 20;
+  return write_reg(THUNDERVOLT_REG_FPWM_TH_1V0 + rail, reg_val > UINT8_MAX ? UINT8_MAX : reg_val);
+}
+
+int thundervolt_get_forced_pwm(uint8_t rail, bool *enabled)
+{
+  if (rail > THUNDERVOLT_RAIL_3V3)
+    return -THUNDERVOLT_ERR_INVALID_RAIL;
+
+  uint8_t status;
+  int rcode = read_reg(THUNDERVOLT_REG_MODE_STATUS, &status);
+  if (rcode < 0)
+    return rcode;
+
+  *enabled = status & (1 << rail);
+
+  return 0;
+}
+
+int thundervolt_get_mode_stats(uint8_t rail, struct thundervolt_mode_stats stats[2])
+{
+  int rcode;
+
+  if (rail > THUNDERVOLT_RAIL_3V3)
+    return -THUNDERVOLT_ERR_INVALID_RAIL;
+
+  // Map the mode statistics into the register window
+  if ((rcode = write_reg(THUNDERVOLT_REG_WINDOW, THUNDERVOLT_WINDOW_MODE_STATS)) < 0)
+    return rcode;
+
+  // Read both modes for the rail in a single burst
+  uint8_t buf[2 * THUNDERVOLT_MODE_STATS_SIZE];
+  if ((rcode = read_regs(THUNDERVOLT_REG_WINDOW_BASE + rail * sizeof(buf), buf, sizeof(buf))) < 0)
+    return rcode;
+
+  // Decode the entries, they are packed little-endian
+  for (uint8_t i = 0; i < 2; i++) {
+    uint8_t *raw = &buf[i * THUNDERVOLT_MODE_STATS_SIZE];
+
+    stats[i].samples     = raw[THUNDERVOLT_MODE_STATS_SAMPLES] | (raw[THUNDERVOLT_MODE_STATS_SAMPLES + 1] << 8);
+    stats[i].current_avg = raw[THUNDERVOLT_MODE_STATS_CURRENT] | (raw[THUNDERVOLT_MODE_STATS_CURRENT + 1] << 8);
+    stats[i].power_avg   = raw[THUNDERVOLT_MODE_STATS_POWER] | (raw[THUNDERVOLT_MODE_STATS_POWER + 1] << 8);
+  }
+
+  return 0;
+}
+
+int thundervolt_get_active_profile(uint8_t *slot)
+{
+  return read_reg(THUNDERVOLT_REG_PROFILE_SELECT, slot);
+}
+
+int thundervolt_select_profile(uint8_t slot, bool boot_default)
+{
+  if (slot >= THUNDERVOLT_NUM_PROFILES)
+    return -THUNDERVOLT_ERR_INVALID_PROFILE;
+
+  return write_reg(THUNDERVOLT_REG_PROFILE_SELECT, slot | (boot_default ? THUNDERVOLT_PROFILE_BOOT : 0));
+}
+
+int thundervolt_save_profile(uint8_t slot)
+{
+  if (slot >= THUNDERVOLT_NUM_PROFILES)
+    return -THUNDERVOLT_ERR_INVALID_PROFILE;
+
+  return write_reg(THUNDERVOLT_REG_PROFILE_SAVE, slot);
+}
+
+int thundervolt_get_profile(uint8_t slot, struct thundervolt_profile *profile)
+{
+  int rcode;
+
+  if (slot >= THUNDERVOLT_NUM_PROFILES)
+    return -THUNDERVOLT_ERR_INVALID_PROFILE;
+
+  // Map the profile slots into the register window
+  if ((rcode = write_reg(THUNDERVOLT_REG_WINDOW, THUNDERVOLT_WINDOW_PROFILES)) < 0)
+    return rcode;
+
+  uint8_t buf[THUNDERVOLT_PROFILE_SIZE];
+  if ((rcode = read_regs(THUNDERVOLT_REG_WINDOW_BASE + slot * sizeof(buf), buf, sizeof(buf))) < 0)
+    return rcode;
+
+  // Decode the slot, empty slots have bits outside THUNDERVOLT_PROFILE_CONFIG set in their flags
+  uint8_t flags = buf[THUNDERVOLT_PROFILE_FLAGS];
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    uint8_t *raw        = &buf[THUNDERVOLT_PROFILE_VOLTAGE + i * 2];
+    profile->voltage[i] = raw[0] | (raw[1] << 8);
+  }
+
+  profile->valid            = !(flags & ~THUNDERVOLT_PROFILE_CONFIG);
+  profile->otsd_temp        = buf[THUNDERVOLT_PROFILE_OTSD_TEMP];
+  profile->otsd_enabled     = flags & THUNDERVOLT_OTSD;
+  profile->governor_enabled = flags & THUNDERVOLT_GOVERNOR;
+
+  return 0;
+}
+
+int thundervolt_get_supply_voltage(uint16_t *voltage)
+{
+  uint8_t buf[2];
+  int rcode = read_regs(THUNDERVOLT_REG_SUPPLY_L, buf, sizeof(buf));
+  if (rcode < 0)
+    return rcode;
+
+  *voltage = buf[0] | (buf[1] << 8);
+
+  return 0;
+}
+
+int thundervolt_set_battery_voltage(uint16_t voltage)
+{
+  uint8_t buf[] = {voltage & 0xFF, voltage >> 8};
+  return write_regs(THUNDERVOLT_REG_BATT_L, buf, sizeof(buf));
+}
+
+int thundervolt_get_battery_soc(uint8_t *soc)
+{
+  return read_reg(THUNDERVOLT_REG_BATT_SOC, soc);
+}
+
+int thundervolt_get_battery_low(bool *low)
+{
+  uint8_t status;
+  int rcode = read_reg(THUNDERVOLT_REG_STATUS, &status);
+  if (rcode < 0)
+    return rcode;
+
+  *low = status & THUNDERVOLT_BATT_LOW;
+
+  return 0;
+}
+
+int thundervolt_get_persisted_battery_threshold(uint16_t *voltage)
+{
+  uint8_t reg_val;
+  int rcode = read_reg(THUNDERVOLT_REG_BATT_LOW_TH, &reg_val);
+  if (rcode < 0)
+    return rcode;
+
+  *voltage = reg_val * 20;
+
+  return 0;
+}
+
+int thundervolt_set_persisted_battery_threshold(uint16_t voltage)
+{
+  uint16_t reg_val = (voltage + 10) / 20;
+  return write_reg(THUNDERVOLT_REG_BATT_LOW_TH, reg_val > UINT8_MAX ? UINT8_MAX : reg_val);
+}
+
+int thundervolt_get_persisted_battery_offset(uint8_t rail, int8_t *offset)
+{
+  if (rail > THUNDERVOLT_RAIL_3V3)
+    return -THUNDERVOLT_ERR_INVALID_RAIL;
+
+  return read_reg(THUNDERVOLT_REG_BATT_OFS_1V0 + rail, (uint8_t *)offset);
+}
+
+int thundervolt_set_persisted_battery_offset(uint8_t rail, int8_t offset)
+{
+  if (rail > THUNDERVOLT_RAIL_3V3)
+    return -THUNDERVOLT_ERR_INVALID_RAIL;
+
+  return write_reg(THUNDERVOLT_REG_BATT_OFS_1V0 + rail, (uint8_t)offset);
 }
 #endif // HW_RVL
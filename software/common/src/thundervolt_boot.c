@@ -0,0 +1,248 @@
+#ifdef HW_RVL
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ogc/lwp_watchdog.h>
+
+#include "crc16.h"
+#include "i2c.h"
+#include "i2c/thundervolt.h"
+
+#include "i2c/thundervolt_boot.h"
+
+// How long to wait for the bootloader to appear after asking the application to hand over, in ms
+#define ENTER_TIMEOUT_MS   100
+
+// How long to wait for a command to finish, in ms
+#define COMMAND_TIMEOUT_MS 50
+
+// Number of times a page is sent again after a CRC error on the bus
+#define WRITE_RETRIES      3
+
+static int read_regs(uint8_t reg, uint8_t *buf, uint8_t len)
+{
+  return i2c_reg_read_block(THUNDERVOLT_BOOT_I2C_ADDR, reg, buf, len);
+}
+
+static int write_regs(uint8_t reg, const uint8_t *buf, uint8_t len)
+{
+  uint8_t msg[1 + THUNDERVOLT_BOOT_PAGE_SIZE];
+  msg[0] = reg;
+  memcpy(&msg[1], buf, len);
+
+  return i2c_write(THUNDERVOLT_BOOT_I2C_ADDR, msg, len + 1);
+}
+
+// Start a command, and wait for the bootloader to finish it
+static int run_command(uint8_t cmd, uint8_t page, uint16_t crc)
+{
+  int rcode;
+
+  // PAGE, CRC and CMD are consecutive, so the command starts at the stop condition of this write
+  uint8_t args[] = {page, crc & 0xFF, crc >> 8, cmd};
+  if ((rcode = write_regs(THUNDERVOLT_BOOT_REG_PAGE, args, sizeof(args))) < 0)
+    return rcode;
+
+  // The CPU is halted while a page is programmed, leave the bus alone until it's done
+  if (cmd == THUNDERVOLT_BOOT_CMD_WRITE)
+    usleep(THUNDERVOLT_BOOT_WRITE_TIME_MS * 1000);
+
+  // Poll until the command has finished, failed transfers mean it's still busy
+  u64 start = gettime();
+  uint8_t status[2];
+  while (read_regs(THUNDERVOLT_BOOT_REG_STATUS, status, sizeof(status)) < 0 ||
+         (status[0] & THUNDERVOLT_BOOT_BUSY)) {
+    if (diff_msec(start, gettime()) > COMMAND_TIMEOUT_MS)
+      return -THUNDERVOLT_BOOT_ERR_TIMEOUT;
+
+    usleep(1000);
+  }
+
+  if (status[THUNDERVOLT_BOOT_REG_ERROR] != THUNDERVOLT_BOOT_ERROR_NONE)
+    return -THUNDERVOLT_BOOT_ERR_FAILED;
+
+  return 0;
+}
+
+bool thundervolt_boot_is_present()
+{
+  return i2c_detect(THUNDERVOLT_BOOT_I2C_ADDR);
+}
+
+int thundervolt_boot_enter()
+{
+  int rcode;
+
+  if (thundervolt_boot_is_present())
+    return 0;
+
+  // The application discards writes without a PEC byte while PEC is enabled
+  uint8_t value = THUNDERVOLT_BOOT_ENTER;
+  if (thundervolt_get_pec_enabled()) {
+    rcode = i2c_reg_write_block_pec(THUNDERVOLT_I2C_ADDR, THUNDERVOLT_REG_BOOTLOADER, &value, 1);
+  } else {
+    rcode = i2c_reg_write_byte(THUNDERVOLT_I2C_ADDR, THUNDERVOLT_REG_BOOTLOADER, value);
+  }
+  if (rcode < 0)
+    return rcode;
+
+  // The application saves its registers before handing over, which can take a few EEPROM writes
+  u64 start = gettime();
+  while (!thundervolt_boot_is_present()) {
+    if (diff_msec(start, gettime()) > ENTER_TIMEOUT_MS)
+      return -THUNDERVOLT_BOOT_ERR_TIMEOUT;
+
+    usleep(1000);
+  }
+
+  return 0;
+}
+
+int thundervolt_boot_get_info(struct thundervolt_boot_info *info)
+{
+  int rcode;
+
+  uint8_t buf[THUNDERVOLT_BOOT_REG_IMAGE_CRC_H - THUNDERVOLT_BOOT_REG_VERSION + 1];
+  if ((rcode = read_regs(THUNDERVOLT_BOOT_REG_VERSION, buf, sizeof(buf))) < 0)
+    return rcode;
+
+  info->version     = buf[THUNDERVOLT_BOOT_REG_VERSION - THUNDERVOLT_BOOT_REG_VERSION];
+  info->app_pages   = buf[THUNDERVOLT_BOOT_REG_APP_PAGES - THUNDERVOLT_BOOT_REG_VERSION];
+  info->image_pages = buf[THUNDERVOLT_BOOT_REG_IMAGE_PAGES - THUNDERVOLT_BOOT_REG_VERSION];
+  info->image_crc   = buf[THUNDERVOLT_BOOT_REG_IMAGE_CRC_L - THUNDERVOLT_BOOT_REG_VERSION] |
+                    (buf[THUNDERVOLT_BOOT_REG_IMAGE_CRC_H - THUNDERVOLT_BOOT_REG_VERSION] << 8);
+
+  return 0;
+}
+
+int thundervolt_boot_read_page(uint8_t page, uint8_t *data)
+{
+  int rcode;
+
+  if ((rcode = run_command(THUNDERVOLT_BOOT_CMD_READ, page, 0)) < 0)
+    return rcode;
+
+  // The bootloader leaves the CRC of the flash page in CRC, check the copy that came over the bus against it
+  uint8_t crc[2];
+  if ((rcode = read_regs(THUNDERVOLT_BOOT_REG_CRC_L, crc, sizeof(crc))) < 0)
+    return rcode;
+
+  if ((rcode = read_regs(THUNDERVOLT_BOOT_REG_BUFFER, data, THUNDERVOLT_BOOT_PAGE_SIZE)) < 0)
+    return rcode;
+
+  if (crc16_update_buf(0, data, THUNDERVOLT_BOOT_PAGE_SIZE) != (crc[0] | (crc[1] << 8)))
+    return -THUNDERVOLT_BOOT_ERR_FAILED;
+
+  return 0;
+}
+
+int thundervolt_boot_write_page(uint8_t page, const uint8_t *data)
+{
+  int rcode;
+
+  uint16_t crc = crc16_update_buf(0, data, THUNDERVOLT_BOOT_PAGE_SIZE);
+
+  // The bootloader rejects a buffer that doesn't match the CRC, so a corrupted transfer is just sent again
+  for (int i = 0; i < WRITE_RETRIES; i++) {
+    if ((rcode = write_regs(THUNDERVOLT_BOOT_REG_BUFFER, data, THUNDERVOLT_BOOT_PAGE_SIZE)) < 0)
+      continue;
+
+    if ((rcode = run_command(THUNDERVOLT_BOOT_CMD_WRITE, page, crc)) == 0)
+      break;
+  }
+
+  return rcode;
+}
+
+int thundervolt_boot_finish(uint8_t pages, uint16_t crc)
+{
+  return run_command(THUNDERVOLT_BOOT_CMD_FINISH, pages, crc);
+}
+
+int thundervolt_boot_start_app()
+{
+  // The bootloader resets straight away, so there is no status to poll
+  uint8_t cmd = THUNDERVOLT_BOOT_CMD_START;
+  return write_regs(THUNDERVOLT_BOOT_REG_CMD, &cmd, 1);
+}
+
+// Write an image and mark it valid, the last page is padded with erased flash
+static int write_image(const uint8_t *image, uint32_t len, uint8_t stage, thundervolt_boot_progress_fn progress,
+                       void *ctx)
+{
+  int rcode;
+
+  uint8_t pages = (len + THUNDERVOLT_BOOT_PAGE_SIZE - 1) / THUNDERVOLT_BOOT_PAGE_SIZE;
+  uint16_t crc  = 0;
+
+  for (uint8_t page = 0; page < pages; page++) {
+    uint32_t offset = page * THUNDERVOLT_BOOT_PAGE_SIZE;
+    uint32_t size   = len - offset < THUNDERVOLT_BOOT_PAGE_SIZE ? len - offset : THUNDERVOLT_BOOT_PAGE_SIZE;
+
+    uint8_t buf[THUNDERVOLT_BOOT_PAGE_SIZE];
+    memset(buf, 0xFF, sizeof(buf));
+    memcpy(buf, &image[offset], size);
+
+    if ((rcode = thundervolt_boot_write_page(page, buf)) < 0)
+      return rcode;
+
+    crc = crc16_update_buf(crc, buf, sizeof(buf));
+
+    if (progress)
+      progress(stage, page + 1, pages, ctx);
+  }
+
+  return thundervolt_boot_finish(pages, crc);
+}
+
+int thundervolt_boot_update(const uint8_t *image, uint32_t len, thundervolt_boot_progress_fn progress, void *ctx)
+{
+  int rcode;
+
+  struct thundervolt_boot_info info;
+  if ((rcode = thundervolt_boot_get_info(&info)) < 0)
+    return rcode;
+
+  if (len == 0 || len > (uint32_t)info.app_pages * THUNDERVOLT_BOOT_PAGE_SIZE)
+    return -THUNDERVOLT_BOOT_ERR_TOO_LARGE;
+
+  // Back up the installed image, so it can be put back if the new one doesn't make it
+  uint32_t backup_len = info.image_pages * THUNDERVOLT_BOOT_PAGE_SIZE;
+  uint8_t *backup     = NULL;
+  if (backup_len > 0) {
+    if ((backup = malloc(backup_len)) == NULL)
+      return -THUNDERVOLT_BOOT_ERR_NO_MEMORY;
+
+    for (uint8_t page = 0; page < info.image_pages; page++) {
+      if ((rcode = thundervolt_boot_read_page(page, &backup[page * THUNDERVOLT_BOOT_PAGE_SIZE])) < 0) {
+        free(backup);
+        return rcode;
+      }
+
+      if (progress)
+        progress(THUNDERVOLT_BOOT_STAGE_BACKUP, page + 1, info.image_pages, ctx);
+    }
+
+    // Nothing has been written yet, so a bad backup just aborts the update
+    if (crc16_update_buf(0, backup, backup_len) != info.image_crc) {
+      free(backup);
+      return -THUNDERVOLT_BOOT_ERR_FAILED;
+    }
+  }
+
+  rcode = write_image(image, len, THUNDERVOLT_BOOT_STAGE_WRITE, progress, ctx);
+
+  // Put the previous image back, without it the bootloader stays in recovery mode until the next attempt
+  if (rcode < 0 && backup) {
+    if (write_image(backup, backup_len, THUNDERVOLT_BOOT_STAGE_RESTORE, progress, ctx) == 0)
+      rcode = -THUNDERVOLT_BOOT_ERR_RESTORED;
+  }
+
+  free(backup);
+
+  return rcode;
+}
+
+#endif // HW_RVL
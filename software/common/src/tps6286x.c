@@ -53,8 +53,8 @@ static int tps6286x_set_vout(uint8_t addr, uint8_t reg, uint8_t chip_type, uint1
   if ((rcode = tps6286x_get_scale(chip_type, &scale)) != 0)
     return rcode;
 
-  // Convert mV to hex value
-  uint8_t vout_byte = (voltage / scale - TPS6286X_VOUT_BASE) / TPS6286X_VOUT_STEP;
+  // Convert mV to hex value, rounding to the nearest step
+  uint8_t vout_byte = (voltage / scale - TPS6286X_VOUT_BASE) / TPS6286X_VOUT_STEP + 0.5f;
 
   // Write the value to the register
   return i2c_reg_write_byte(addr, reg, vout_byte);
@@ -76,6 +76,16 @@ int tps6286x_set_slew_rate(uint8_t addr, uint8_t slew_rate)
   return i2c_reg_update_byte(addr, TPS6286X_REG_CONTROL, TPS6286X_SLEW, slew_rate);
 }
 
+int tps6286x_set_forced_pwm(uint8_t addr, bool enabled)
+{
+  return i2c_reg_update_byte(addr, TPS6286X_REG_CONTROL, TPS6286X_FORCE_FPWM, enabled ? TPS6286X_FORCE_FPWM : 0);
+}
+
+int tps6286x_get_status(uint8_t addr, uint8_t *status)
+{
+  return i2c_reg_read_byte(addr, TPS6286X_REG_STATUS, status);
+}
+
 int tps6286x_get_vout1(uint8_t addr, uint8_t device_option, uint16_t *voltage)
 {
   return tps6286x_get_vout(addr, TPS6286X_REG_VOUT1, device_option, voltage);
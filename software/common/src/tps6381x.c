@@ -39,14 +39,14 @@ static int tps6381x_set_vout(uint8_t reg, uint16_t voltage)
   if ((rcode = tps6381x_get_range(&range)) != 0)
     return rcode;
 
-  // Convert mV value to a VOUT hex value
+  // Convert mV value to a VOUT hex value, rounding to the nearest step
   uint8_t vout;
   if (range == TPS6381X_RANGE_LOW) {
     // Low range (1.8V - 4.975V), 25mV steps
-    vout = (voltage - TPS6381X_VOUT_START_LOW) / TPS6381X_VOUT_RESOLUTION;
+    vout = (voltage - TPS6381X_VOUT_START_LOW + TPS6381X_VOUT_RESOLUTION / 2) / TPS6381X_VOUT_RESOLUTION;
   } else {
     // High range (2.025V - 5.2V), 25mV steps
-    vout = (voltage - TPS6381X_VOUT_START_HIGH) / TPS6381X_VOUT_RESOLUTION;
+    vout = (voltage - TPS6381X_VOUT_START_HIGH + TPS6381X_VOUT_RESOLUTION / 2) / TPS6381X_VOUT_RESOLUTION;
   }
 
   // Write the value to the register
@@ -74,12 +74,22 @@ int tps6381x_set_slew_rate(uint8_t slew_rate)
   return i2c_reg_update_byte(TPS6381X_I2C_ADDR, TPS6381X_REG_CONTROL, TPS6381X_SLEW, slew_rate);
 }
 
+int tps6381x_set_forced_pwm(bool enable)
+{
+  return i2c_reg_update_byte(TPS6381X_I2C_ADDR, TPS6381X_REG_CONTROL, TPS6381X_FPWM, enable ? TPS6381X_FPWM : 0);
+}
+
 int tps6381x_enable(bool enable)
 {
   return i2c_reg_update_byte(TPS6381X_I2C_ADDR, TPS6381X_REG_CONTROL, TPS6381X_ENABLE,
                              enable ? TPS6381X_ENABLE : 0);
 }
 
+int tps6381x_get_status(uint8_t *status)
+{
+  return i2c_reg_read_byte(TPS6381X_I2C_ADDR, TPS6381X_REG_STATUS, status);
+}
+
 int tps6381x_get_range(uint8_t *range)
 {
   int rcode;
@@ -0,0 +1,131 @@
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "battery.h"
+
+// Internal reference voltage, in mV
+#define BATTERY_VREF_MV 1100
+
+// Number of samples accumulated in each ADC burst
+#define BATTERY_ADC_SAMPLES 16
+
+// Battery voltage filter strength, each update moves the filtered voltage 1/N of the way to the new value
+#define BATTERY_FILTER 16
+
+// Resting voltage of a 1S Li-ion cell against state of charge
+static const struct {
+  uint16_t voltage;
+  uint8_t soc;
+} OCV_TABLE[] = {
+    {3000, 0},  {3450, 5},  {3600, 10}, {3700, 30}, {3750, 40}, {3800, 50},
+    {3850, 60}, {3950, 75}, {4050, 85}, {4100, 90}, {4200, 100},
+};
+
+#define OCV_TABLE_LEN (sizeof(OCV_TABLE) / sizeof(OCV_TABLE[0]))
+
+// Accumulated ADC result of the last burst, 0 if there hasn't been one yet
+static volatile uint16_t supply_raw = 0;
+
+// Battery state
+static volatile uint16_t battery_voltage = 0;
+static uint16_t filtered_voltage         = 0;
+static uint8_t soc                       = 0xFF;
+static bool low                          = false;
+
+// Estimate the state of charge from the resting voltage, interpolating between table entries
+static uint8_t estimate_soc(uint16_t voltage)
+{
+  if (voltage <= OCV_TABLE[0].voltage)
+    return OCV_TABLE[0].soc;
+
+  for (uint8_t i = 1; i < OCV_TABLE_LEN; i++) {
+    if (voltage < OCV_TABLE[i].voltage) {
+      uint16_t v0 = OCV_TABLE[i - 1].voltage, v1 = OCV_TABLE[i].voltage;
+      uint8_t s0 = OCV_TABLE[i - 1].soc, s1 = OCV_TABLE[i].soc;
+      return s0 + (uint32_t)(voltage - v0) * (s1 - s0) / (v1 - v0);
+    }
+  }
+
+  return OCV_TABLE[OCV_TABLE_LEN - 1].soc;
+}
+
+void battery_init()
+{
+  // Measure the internal 1.1V reference against VDD, so VDD = 1.1V * 1024 / result
+  VREF.CTRLA  = (VREF.CTRLA & ~VREF_ADC0REFSEL_gm) | VREF_ADC0REFSEL_1V1_gc;
+  ADC0.CTRLB  = ADC_SAMPNUM_ACC16_gc;
+  ADC0.CTRLC  = ADC_SAMPCAP_bm | ADC_REFSEL_VDDREF_gc | ADC_PRESC_DIV8_gc;
+  ADC0.CTRLD  = ADC_INITDLY_DLY64_gc;
+  ADC0.MUXPOS = ADC_MUXPOS_INTREF_gc;
+
+  // Keep running in standby, the burst may still be running when the CPU goes back to sleep
+  ADC0.CTRLA   = ADC_RUNSTBY_bm | ADC_RESSEL_10BIT_gc | ADC_ENABLE_bm;
+  ADC0.COMMAND = ADC_STCONV_bm;
+}
+
+void battery_tick(uint32_t now)
+{
+  if (now & (BATTERY_ADC_TICKS - 1))
+    return;
+
+  // Reading the result clears the ready flag
+  if (ADC0.INTFLAGS & ADC_RESRDY_bm)
+    supply_raw = ADC0.RES;
+
+  ADC0.COMMAND = ADC_STCONV_bm;
+}
+
+uint16_t battery_get_supply()
+{
+  uint16_t raw;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { raw = supply_raw; }
+
+  if (raw == 0)
+    return 0;
+
+  return (uint32_t)BATTERY_VREF_MV * 1024 * BATTERY_ADC_SAMPLES / raw;
+}
+
+void battery_set_voltage(uint16_t voltage)
+{
+  battery_voltage = voltage;
+}
+
+bool battery_update(uint16_t low_threshold)
+{
+  uint16_t voltage;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { voltage = battery_voltage; }
+
+  // Forget the battery if the host stops reporting it
+  if (voltage == 0) {
+    filtered_voltage = 0;
+    soc              = 0xFF;
+    low              = false;
+    return false;
+  }
+
+  // Filter out the sag from load transients, the table is for resting voltages
+  if (filtered_voltage == 0) {
+    filtered_voltage = voltage;
+  } else {
+    filtered_voltage += ((int32_t)voltage - filtered_voltage) / BATTERY_FILTER;
+  }
+
+  soc = estimate_soc(filtered_voltage);
+
+  // Apply hysteresis, so a loaded battery doesn't flip between profiles
+  if (low_threshold == 0) {
+    low = false;
+  } else if (filtered_voltage < low_threshold) {
+    low = true;
+  } else if (filtered_voltage >= low_threshold + BATTERY_LOW_HYSTERESIS) {
+    low = false;
+  }
+
+  return low;
+}
+
+uint8_t battery_get_soc()
+{
+  return soc;
+}
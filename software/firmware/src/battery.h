@@ -0,0 +1,65 @@
+/**
+ * Supply and battery monitoring for Thundervolt.
+ *
+ * The ADC measures the ATtiny's own supply (VDD) against the internal 1.1V
+ * reference, a 16-sample burst every BATTERY_ADC_TICKS ms started from the RTC
+ * tick. The tick only reads the previous result and starts the next burst, so
+ * it adds a few cycles to the interrupt.
+ *
+ * VDD is the +1V8_ALW rail from the LP5907 LDO rather than the cell itself, so
+ * it stays at 1.8V across the whole 1S Li-ion range and only shows the health of
+ * the always-on supply. The cell voltage has to be provided by the host (for
+ * example from a portable's fuel gauge) with battery_set_voltage, and is used
+ * for the state of charge estimate and the low battery state.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Interval between ADC bursts, in RTC ticks (must be a power of 2)
+#define BATTERY_ADC_TICKS 32
+
+// Hysteresis on the low battery threshold, in mV
+#define BATTERY_LOW_HYSTERESIS 100
+
+/**
+ * Configure the ADC, and start the first measurement.
+ */
+void battery_init();
+
+/**
+ * Collect the last ADC result and start the next measurement when due.
+ *
+ * Must be called from the 1ms RTC interrupt.
+ *
+ * @param now The current tick, from sched_tick
+ */
+void battery_tick(uint32_t now);
+
+/**
+ * Get the measured supply voltage (VDD), in mV, or 0 if it hasn't been measured yet.
+ */
+uint16_t battery_get_supply();
+
+/**
+ * Set the battery voltage reported by the host.
+ *
+ * @param voltage The battery voltage, in mV, 0 if unknown
+ */
+void battery_set_voltage(uint16_t voltage);
+
+/**
+ * Update the state of charge estimate and the low battery state.
+ *
+ * @param low_threshold The battery voltage below which the battery is low, in mV, 0 to disable
+ *
+ * @return Whether the battery is low
+ */
+bool battery_update(uint16_t low_threshold);
+
+/**
+ * Get the estimated state of charge, in percent, or 0xFF if the battery voltage is unknown.
+ */
+uint8_t battery_get_soc();
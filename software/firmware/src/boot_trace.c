@@ -0,0 +1,29 @@
+#include <avr/io.h>
+
+#include "boot_trace.h"
+#include "i2c/thundervolt.h"
+
+// Recorded events, stored as packed entries so they can be read back byte by byte
+static uint8_t trace[THUNDERVOLT_TRACE_MAX_ENTRIES][THUNDERVOLT_TRACE_ENTRY_SIZE];
+static uint8_t trace_count = 0;
+
+void boot_trace(uint8_t event)
+{
+  if (trace_count >= THUNDERVOLT_TRACE_MAX_ENTRIES)
+    return;
+
+  uint16_t now   = RTC.CNT;
+  uint8_t *entry = trace[trace_count++];
+
+  entry[THUNDERVOLT_TRACE_EVENT]    = event;
+  entry[THUNDERVOLT_TRACE_TIME]     = now & 0xFF;
+  entry[THUNDERVOLT_TRACE_TIME + 1] = now >> 8;
+}
+
+uint8_t boot_trace_read(uint16_t offset)
+{
+  if (offset >= trace_count * THUNDERVOLT_TRACE_ENTRY_SIZE)
+    return 0x00;
+
+  return trace[offset / THUNDERVOLT_TRACE_ENTRY_SIZE][offset % THUNDERVOLT_TRACE_ENTRY_SIZE];
+}
@@ -0,0 +1,31 @@
+/**
+ * Boot trace for Thundervolt.
+ *
+ * Records time-stamped events during the power-on sequence, so the time to
+ * release Hollywood can be measured on real hardware. Timestamps come from the
+ * RTC counter, in 1/32768s units since reset.
+ *
+ * Entries use the THUNDERVOLT_TRACE_xxx layout from i2c/thundervolt.h.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Record a boot event, if there is space left in the trace.
+ *
+ * The RTC counter must be running.
+ *
+ * @param event The THUNDERVOLT_BOOT_xxx event
+ */
+void boot_trace(uint8_t event);
+
+/**
+ * Read a byte from the trace, as if the entries were stored contiguously.
+ *
+ * @param offset The byte offset into the trace
+ *
+ * @return The byte at the offset, or 0x00 if the offset is past the last entry
+ */
+uint8_t boot_trace_read(uint16_t offset);
@@ -0,0 +1,372 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <avr/cpufunc.h>
+#include <avr/io.h>
+#include <util/crc16.h>
+#include <util/delay.h>
+
+#include "bootloader.h"
+#include "i2c/thundervolt_boot.h"
+
+// Bootloader version - increment this for each bootloader release
+#define BOOTLOADER_VERSION 1
+
+// Number of flash pages available for the application
+#define APP_PAGES          ((PROGMEM_SIZE - BOOTLOADER_SIZE) / THUNDERVOLT_BOOT_PAGE_SIZE)
+
+// Image descriptor, stored in the user row so it survives application updates and EEPROM clears
+#define DESC_MAGIC         0 // DESC_MAGIC_xxx
+#define DESC_PAGES         1 // Number of pages in the image
+#define DESC_CRC           2 // CRC of the image (uint16)
+
+// Descriptor states, an erased user row has no descriptor (after uploading the application over UPDI)
+#define DESC_MAGIC_VALUE   0x5A // The image has passed its CRC check
+#define DESC_MAGIC_WRITING 0x00 // An update over I2C has started, the image is incomplete
+#define DESC_MAGIC_NONE    0xFF // No descriptor, the image is checked and recorded on the next boot
+
+// GPIO pins, these must match main.c
+#define EN_PIN             PIN1_bm // PA1, regulator enable
+#define DIRECT_PIN         PIN7_bm // PA7, U10 direct mode pinstrap
+#define U10_PIN            PIN3_bm // PB3, U10 emulation
+#define ALERT_PIN          PIN4_bm // PA4, TMP1075 over-temperature alert, active low
+
+// Time to hold Hollywood in reset after enabling the regulators, in ms
+#define U10_DELAY_MS       200
+
+// Register space, including the page buffer
+static uint8_t registers[THUNDERVOLT_BOOT_NUM_REGISTERS];
+
+// Command waiting for the stop condition, 0 if none
+static uint8_t pending_cmd = 0;
+
+// Get a pointer to an application page in the memory-mapped flash
+static inline const uint8_t *get_page(uint8_t page)
+{
+  return (const uint8_t *)(MAPPED_PROGMEM_START + BOOTLOADER_SIZE + page * THUNDERVOLT_BOOT_PAGE_SIZE);
+}
+
+static uint16_t crc_buf(uint16_t crc, const uint8_t *buf, uint16_t len)
+{
+  while (len--) { crc = _crc_xmodem_update(crc, *buf++); }
+
+  return crc;
+}
+
+// Run an NVM controller command, and wait for it to finish
+static void nvm_command(uint8_t cmd)
+{
+  _PROTECTED_WRITE_SPM(NVMCTRL.CTRLA, cmd);
+  while (NVMCTRL.STATUS & (NVMCTRL_FBUSY_bm | NVMCTRL_EEBUSY_bm));
+}
+
+// Write the image descriptor
+static void write_descriptor(uint8_t magic, uint8_t pages, uint16_t crc)
+{
+  nvm_command(NVMCTRL_CMD_PAGEBUFCLR_gc);
+
+  volatile uint8_t *desc = (volatile uint8_t *)USER_SIGNATURES_START;
+  desc[DESC_MAGIC]       = magic;
+  desc[DESC_PAGES]       = pages;
+  desc[DESC_CRC]         = crc & 0xFF;
+  desc[DESC_CRC + 1]     = crc >> 8;
+
+  nvm_command(NVMCTRL_CMD_PAGEERASEWRITE_gc);
+}
+
+// Check the image descriptor, the image itself was checked when the descriptor was written
+static bool is_image_valid()
+{
+  const volatile uint8_t *desc = (const volatile uint8_t *)USER_SIGNATURES_START;
+  return desc[DESC_MAGIC] == DESC_MAGIC_VALUE && desc[DESC_PAGES] > 0 && desc[DESC_PAGES] <= APP_PAGES;
+}
+
+// Check the flash against the CRC in a valid descriptor
+static bool is_descriptor_current()
+{
+  const volatile uint8_t *desc = (const volatile uint8_t *)USER_SIGNATURES_START;
+  uint16_t crc                 = desc[DESC_CRC] | ((uint16_t)desc[DESC_CRC + 1] << 8);
+  return crc_buf(0, get_page(0), desc[DESC_PAGES] * THUNDERVOLT_BOOT_PAGE_SIZE) == crc;
+}
+
+// Check for an application, its reset vector is a JMP or RJMP rather than erased flash
+static bool has_application()
+{
+  uint16_t reset_vector = get_page(0)[0] | ((uint16_t)get_page(0)[1] << 8);
+  return (reset_vector & 0xFE0E) == 0x940C || (reset_vector & 0xF000) == 0xC000;
+}
+
+// Record an application that was flashed without a descriptor, such as over UPDI
+// The image ends at the last page that isn't erased, and its CRC is taken from the flash as it is
+static void record_image()
+{
+  if (!has_application())
+    return;
+
+  uint8_t pages = APP_PAGES;
+  while (pages > 0) {
+    const uint8_t *page = get_page(pages - 1);
+    uint8_t i           = 0;
+    while (i < THUNDERVOLT_BOOT_PAGE_SIZE && page[i] == 0xFF) i++;
+    if (i < THUNDERVOLT_BOOT_PAGE_SIZE)
+      break;
+    pages--;
+  }
+
+  write_descriptor(DESC_MAGIC_VALUE, pages, crc_buf(0, get_page(0), pages * THUNDERVOLT_BOOT_PAGE_SIZE));
+}
+
+// Publish the installed image in the registers
+static void update_image_registers()
+{
+  const volatile uint8_t *desc = (const volatile uint8_t *)USER_SIGNATURES_START;
+  bool valid                   = is_image_valid();
+
+  registers[THUNDERVOLT_BOOT_REG_IMAGE_PAGES] = valid ? desc[DESC_PAGES] : 0;
+  registers[THUNDERVOLT_BOOT_REG_IMAGE_CRC_L] = valid ? desc[DESC_CRC] : 0;
+  registers[THUNDERVOLT_BOOT_REG_IMAGE_CRC_H] = valid ? desc[DESC_CRC + 1] : 0;
+
+  if (valid) {
+    registers[THUNDERVOLT_BOOT_REG_STATUS] |= THUNDERVOLT_BOOT_IMAGE_VALID;
+  } else {
+    registers[THUNDERVOLT_BOOT_REG_STATUS] &= ~THUNDERVOLT_BOOT_IMAGE_VALID;
+  }
+}
+
+// Program the page buffer to a flash page, and verify it
+static uint8_t write_page(uint8_t page, uint16_t crc)
+{
+  const uint8_t *buf = &registers[THUNDERVOLT_BOOT_REG_BUFFER];
+
+  if (page >= APP_PAGES)
+    return THUNDERVOLT_BOOT_ERROR_PAGE;
+
+  if (crc_buf(0, buf, THUNDERVOLT_BOOT_PAGE_SIZE) != crc)
+    return THUNDERVOLT_BOOT_ERROR_CRC;
+
+  // The image is incomplete from the first write until it is finished, and mustn't be recorded as it is
+  const volatile uint8_t *desc = (const volatile uint8_t *)USER_SIGNATURES_START;
+  if (desc[DESC_MAGIC] != DESC_MAGIC_WRITING) {
+    write_descriptor(DESC_MAGIC_WRITING, 0xFF, 0xFFFF);
+    update_image_registers();
+  }
+
+  // Fill the NVM page buffer through the mapped flash, then erase and write the page in one go
+  nvm_command(NVMCTRL_CMD_PAGEBUFCLR_gc);
+
+  volatile uint8_t *dst = (volatile uint8_t *)get_page(page);
+  for (uint8_t i = 0; i < THUNDERVOLT_BOOT_PAGE_SIZE; i++) dst[i] = buf[i];
+
+  nvm_command(NVMCTRL_CMD_PAGEERASEWRITE_gc);
+
+  if (crc_buf(0, get_page(page), THUNDERVOLT_BOOT_PAGE_SIZE) != crc)
+    return THUNDERVOLT_BOOT_ERROR_VERIFY;
+
+  return THUNDERVOLT_BOOT_ERROR_NONE;
+}
+
+// Read a flash page into the page buffer
+static uint8_t read_page(uint8_t page)
+{
+  if (page >= APP_PAGES)
+    return THUNDERVOLT_BOOT_ERROR_PAGE;
+
+  const uint8_t *src = get_page(page);
+  for (uint8_t i = 0; i < THUNDERVOLT_BOOT_PAGE_SIZE; i++) registers[THUNDERVOLT_BOOT_REG_BUFFER + i] = src[i];
+
+  uint16_t crc                          = crc_buf(0, src, THUNDERVOLT_BOOT_PAGE_SIZE);
+  registers[THUNDERVOLT_BOOT_REG_CRC_L] = crc & 0xFF;
+  registers[THUNDERVOLT_BOOT_REG_CRC_H] = crc >> 8;
+
+  return THUNDERVOLT_BOOT_ERROR_NONE;
+}
+
+// Check the whole image, and mark it valid if it matches
+static uint8_t finish_image(uint8_t pages, uint16_t crc)
+{
+  if (pages == 0 || pages > APP_PAGES)
+    return THUNDERVOLT_BOOT_ERROR_PAGE;
+
+  if (crc_buf(0, get_page(0), pages * THUNDERVOLT_BOOT_PAGE_SIZE) != crc)
+    return THUNDERVOLT_BOOT_ERROR_VERIFY;
+
+  write_descriptor(DESC_MAGIC_VALUE, pages, crc);
+  update_image_registers();
+
+  return THUNDERVOLT_BOOT_ERROR_NONE;
+}
+
+// Run the command written over I2C, once the transaction has finished
+static void run_command(uint8_t cmd)
+{
+  uint8_t page = registers[THUNDERVOLT_BOOT_REG_PAGE];
+  uint16_t crc = registers[THUNDERVOLT_BOOT_REG_CRC_L] | (registers[THUNDERVOLT_BOOT_REG_CRC_H] << 8);
+  uint8_t error;
+
+  switch (cmd) {
+    case THUNDERVOLT_BOOT_CMD_WRITE:
+      error = write_page(page, crc);
+      break;
+    case THUNDERVOLT_BOOT_CMD_READ:
+      error = read_page(page);
+      break;
+    case THUNDERVOLT_BOOT_CMD_FINISH:
+      error = finish_image(page, crc);
+      break;
+    case THUNDERVOLT_BOOT_CMD_START:
+      // A full reset puts the pins back to their defaults, so the application starts from a cold boot
+      _PROTECTED_WRITE(RSTCTRL.SWRR, RSTCTRL_SWRE_bm);
+      return;
+    default:
+      error = THUNDERVOLT_BOOT_ERROR_COMMAND;
+      break;
+  }
+
+  registers[THUNDERVOLT_BOOT_REG_ERROR] = error;
+  registers[THUNDERVOLT_BOOT_REG_STATUS] &= ~THUNDERVOLT_BOOT_BUSY;
+}
+
+// Handle a register write, commands are started at the stop condition
+static void write_register(uint8_t reg_addr, uint8_t value)
+{
+  if (reg_addr == THUNDERVOLT_BOOT_REG_CMD) {
+    pending_cmd = value;
+    registers[THUNDERVOLT_BOOT_REG_STATUS] |= THUNDERVOLT_BOOT_BUSY;
+    return;
+  }
+
+  // Only the page, CRC and buffer registers are writable
+  if (reg_addr == THUNDERVOLT_BOOT_REG_PAGE || reg_addr == THUNDERVOLT_BOOT_REG_CRC_L ||
+      reg_addr == THUNDERVOLT_BOOT_REG_CRC_H ||
+      (reg_addr >= THUNDERVOLT_BOOT_REG_BUFFER && reg_addr < THUNDERVOLT_BOOT_NUM_REGISTERS))
+    registers[reg_addr] = value;
+}
+
+// Serve the I2C target by polling, interrupts stay disabled in the bootloader
+static void poll_target()
+{
+  static uint8_t reg_index = 0;
+  static bool have_index   = false;
+  static bool sent_data    = false;
+
+  uint8_t status = TWI0.SSTATUS;
+
+  if (status & (TWI_COLL_bm | TWI_BUSERR_bm)) {
+    // Drop the transaction on collisions and bus errors, including any command it wrote
+    TWI0.SSTATUS = TWI_COLL_bm | TWI_BUSERR_bm;
+    TWI0.SCTRLB  = TWI_SCMD_COMPTRANS_gc;
+    pending_cmd  = 0;
+    registers[THUNDERVOLT_BOOT_REG_STATUS] &= ~THUNDERVOLT_BOOT_BUSY;
+  } else if (status & TWI_DIF_bm) {
+    if (status & TWI_DIR_bm) {
+      if ((status & TWI_RXACK_bm) && sent_data) {
+        // Controller NACK'd the last byte, so end the transaction
+        TWI0.SCTRLB = TWI_SCMD_COMPTRANS_gc;
+      } else {
+        TWI0.SDATA  = registers[reg_index++ & (THUNDERVOLT_BOOT_NUM_REGISTERS - 1)];
+        TWI0.SCTRLB = TWI_SCMD_RESPONSE_gc;
+        sent_data   = true;
+      }
+    } else {
+      // The first byte is the register address, subsequent bytes are data
+      uint8_t data = TWI0.SDATA;
+      if (!have_index) {
+        reg_index  = data;
+        have_index = true;
+      } else {
+        write_register(reg_index++ & (THUNDERVOLT_BOOT_NUM_REGISTERS - 1), data);
+      }
+      TWI0.SCTRLB = TWI_SCMD_RESPONSE_gc;
+    }
+  } else if (status & TWI_APIF_bm) {
+    if (status & TWI_AP_bm) {
+      // Address match, a repeated start keeps the register address for the read
+      if (!(status & TWI_DIR_bm))
+        have_index = false;
+      sent_data   = false;
+      TWI0.SCTRLB = TWI_SCMD_RESPONSE_gc;
+    } else {
+      // Stop condition, run any command once the bus is released
+      TWI0.SCTRLB = TWI_SCMD_COMPTRANS_gc;
+      if (pending_cmd) {
+        run_command(pending_cmd);
+        pending_cmd = 0;
+      }
+    }
+  }
+}
+
+// Power up the console with the regulators at their default voltages, so it can run the updater
+static void power_up_console()
+{
+  // Check the pinstrapping, and hold Hollywood in reset as in main.c
+  PORTA.PIN7CTRL = PORT_PULLUPEN_bm;
+  _delay_us(10);
+  bool u10_direct_mode = PORTA.IN & DIRECT_PIN;
+
+  PORTB.DIRSET = U10_PIN;
+  if (u10_direct_mode) {
+    PORTB.OUTCLR = U10_PIN;
+  } else {
+    PORTB.OUTSET = U10_PIN;
+  }
+
+  // Enable the regulators, and release Hollywood once they've settled
+  PORTA.DIRSET = EN_PIN;
+  PORTA.OUTSET = EN_PIN;
+  _delay_ms(U10_DELAY_MS);
+
+  if (u10_direct_mode) {
+    PORTB.DIRCLR = U10_PIN;
+  } else {
+    PORTB.OUTCLR = U10_PIN;
+  }
+}
+
+int main(void)
+{
+  bool handover = GPIOR0 == BOOTLOADER_HANDOVER;
+  GPIOR0        = 0;
+
+  const volatile uint8_t *desc = (const volatile uint8_t *)USER_SIGNATURES_START;
+
+  // Before an update, check the descriptor still matches the flash, so the homebrew's backup of the installed
+  // image checks out even if the application was reprogrammed by a programmer that kept the user row
+  if (handover && is_image_valid() && !is_descriptor_current())
+    write_descriptor(DESC_MAGIC_NONE, 0xFF, 0xFFFF);
+
+  // An application uploaded over UPDI has no descriptor, so record it once, this takes up to ~100ms
+  if (desc[DESC_MAGIC] == DESC_MAGIC_NONE)
+    record_image();
+
+  // Start the application straight away if it's valid, nothing has been touched yet
+  if (!handover && is_image_valid())
+    asm volatile("jmp %0" ::"i"(BOOTLOADER_SIZE));
+
+  // Run at 5MHz, the fastest speed supported at 1.8V
+  _PROTECTED_WRITE(CLKCTRL.MCLKCTRLB, CLKCTRL_PDIV_4X_gc | CLKCTRL_PEN_bm);
+
+  // Without an application the console hasn't been powered up yet
+  if (!handover)
+    power_up_console();
+
+  registers[THUNDERVOLT_BOOT_REG_VERSION]   = BOOTLOADER_VERSION;
+  registers[THUNDERVOLT_BOOT_REG_APP_PAGES] = APP_PAGES;
+  update_image_registers();
+
+  // Listen as an I2C target, the flags are polled rather than raising interrupts
+  TWI0.MCTRLA = 0;
+  TWI0.SADDR  = THUNDERVOLT_BOOT_I2C_ADDR << 1;
+  TWI0.SCTRLA = TWI_APIEN_bm | TWI_PIEN_bm | TWI_DIEN_bm | TWI_ENABLE_bm;
+
+  // The TMP1075 keeps the limit the application set, or its power-on default. The OTSD setting isn't available
+  // here, so the regulators are always disabled on an over-temperature alert while the console is updating
+  PORTA.PIN4CTRL = PORT_PULLUPEN_bm;
+
+  while (1) {
+    if (!(PORTA.IN & ALERT_PIN))
+      PORTA.OUTCLR = EN_PIN;
+
+    poll_target();
+  }
+}
@@ -0,0 +1,45 @@
+/**
+ * I2C bootloader for Thundervolt.
+ *
+ * Lives in the boot section at the start of the flash (BOOTEND fuse = 0x08),
+ * with the application linked after it at BOOTLOADER_SIZE. The application
+ * section can't overwrite the bootloader, so a failed update can always be
+ * retried over I2C without a UPDI programmer.
+ *
+ * On reset the bootloader jumps straight to the application if the installed
+ * image is valid. Otherwise it powers the console up with the regulators at
+ * their default voltages, releases U10, and waits for an image over I2C.
+ *
+ * The image is described by a descriptor in the user row, holding its length and
+ * CRC. Images written over I2C get theirs once they pass the FINISH check. The
+ * UPDI upload erases the descriptor instead, and the bootloader records the image
+ * it finds on the next boot, as long as its reset vector is a jump rather than
+ * erased flash. An update that was interrupted part way is never recorded.
+ *
+ * The application can also hand over to the bootloader with bootloader_enter,
+ * without a reset, so the rails and U10 are left as they are and the console
+ * keeps running while it's updated.
+ *
+ * See i2c/thundervolt_boot.h for the register interface.
+ */
+
+#pragma once
+
+#include <avr/io.h>
+
+// Size of the boot section, the application starts here
+#define BOOTLOADER_SIZE     0x800
+
+// Left in GPIOR0 by the application when it hands over to the bootloader
+#define BOOTLOADER_HANDOVER 0xB7
+
+/**
+ * Hand over to the bootloader, leaving the pins as they are.
+ *
+ * Interrupts must be disabled, and the TWI target stopped.
+ */
+static inline void bootloader_enter()
+{
+  GPIOR0 = BOOTLOADER_HANDOVER;
+  asm volatile("jmp 0");
+}
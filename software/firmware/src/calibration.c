@@ -0,0 +1,121 @@
+#include <util/delay.h>
+
+#include "calibration.h"
+
+// Number of points in the sweep
+#define CALIBRATION_POINTS      4
+
+// Number of readings averaged at each point
+#define CALIBRATION_READINGS    4
+
+// Time for the rail to settle at each point, and between readings, covering the INA700 conversion time (in ms)
+#define CALIBRATION_SETTLE_MS   5
+#define CALIBRATION_READING_MS  2
+
+// Round a fitted value to a calibration register
+static int8_t round_trim(float value)
+{
+  return value < 0 ? value - 0.5f : value + 0.5f;
+}
+
+int calibration_fit(const float *x, const float *error, uint8_t points, struct thundervolt_calibration *cal)
+{
+  float x_mean = 0, error_mean = 0;
+  for (uint8_t i = 0; i < points; i++) {
+    x_mean += x[i] / points;
+    error_mean += error[i] / points;
+  }
+
+  // Least-squares fit of error = offset + gain * x
+  float sxy = 0, sxx = 0;
+  for (uint8_t i = 0; i < points; i++) {
+    sxy += (x[i] - x_mean) * (error[i] - error_mean);
+    sxx += (x[i] - x_mean) * (x[i] - x_mean);
+  }
+
+  // The sweep needs at least two distinct setpoints to fit a gain
+  if (sxx <= 0)
+    return -CALIBRATION_ERR_FIT;
+
+  float gain   = sxy / sxx;
+  float offset = error_mean - gain * x_mean;
+
+  // A trim this large means the measurement is wrong (or the regulator is faulty), so don't correct for it
+  if (offset > CALIBRATION_MAX_OFFSET_MV || offset < -CALIBRATION_MAX_OFFSET_MV)
+    return -CALIBRATION_ERR_RANGE;
+  if (gain * 1000 > CALIBRATION_MAX_GAIN || gain * 1000 < -CALIBRATION_MAX_GAIN)
+    return -CALIBRATION_ERR_RANGE;
+
+  // Every point has to sit on the fitted line, a noisy or non-linear sweep can't be corrected with an offset and gain
+  for (uint8_t i = 0; i < points; i++) {
+    float residual = error[i] - (offset + gain * x[i]);
+    if (residual > CALIBRATION_MAX_RESIDUAL_MV || residual < -CALIBRATION_MAX_RESIDUAL_MV)
+      return -CALIBRATION_ERR_FIT;
+  }
+
+  cal->offset = round_trim(offset);
+  cal->gain   = round_trim(gain * 1000);
+
+  return 0;
+}
+
+// Sweep the rail and fit its calibration, leaving the rail wherever the sweep stopped
+static int sweep(uint8_t rail, uint16_t min, uint16_t stock, struct thundervolt_calibration *cal)
+{
+  int rcode;
+
+  // Collect the setpoint error at each point, relative to stock
+  float x[CALIBRATION_POINTS], error[CALIBRATION_POINTS];
+  for (uint8_t i = 0; i < CALIBRATION_POINTS; i++) {
+    uint16_t voltage = stock - (uint32_t)CALIBRATION_SPAN_MV * i / (CALIBRATION_POINTS - 1);
+    if (voltage < min)
+      voltage = min;
+
+    if ((rcode = thundervolt_set_voltage(rail, voltage)) != 0)
+      return rcode;
+
+    // Use the setpoint the regulator actually took, after rounding to its resolution
+    uint16_t setpoint;
+    if ((rcode = thundervolt_get_voltage(rail, &setpoint)) != 0)
+      return rcode;
+
+    _delay_ms(CALIBRATION_SETTLE_MS);
+
+    uint32_t total = 0;
+    for (uint8_t j = 0; j < CALIBRATION_READINGS; j++) {
+      uint16_t measured;
+      if ((rcode = thundervolt_get_measured_voltage(rail, &measured)) != 0)
+        return rcode;
+
+      total += measured;
+      _delay_ms(CALIBRATION_READING_MS);
+    }
+
+    x[i]     = (float)setpoint - stock;
+    error[i] = (float)total / CALIBRATION_READINGS - setpoint;
+  }
+
+  return calibration_fit(x, error, CALIBRATION_POINTS, cal);
+}
+
+int calibration_run(uint8_t rail, struct thundervolt_calibration *cal)
+{
+  int rcode;
+
+  uint16_t min, stock;
+  if ((rcode = thundervolt_get_voltage_range(rail, &min, &stock)) != 0)
+    return rcode;
+
+  // Sweep with the raw setpoints, and keep them if the fit is rejected
+  static const struct thundervolt_calibration uncalibrated = {0, 0};
+  thundervolt_set_calibration(rail, &uncalibrated);
+
+  int result = sweep(rail, min, stock, cal);
+  if (result == 0)
+    thundervolt_set_calibration(rail, cal);
+
+  // Put the rail back to stock, even if the sweep failed part way
+  rcode = thundervolt_set_voltage(rail, stock);
+
+  return result != 0 ? result : rcode;
+}
@@ -0,0 +1,63 @@
+/**
+ * Rail setpoint calibration for Thundervolt 2.
+ *
+ * Sweeps a rail across the top of its range, measures the real output voltage
+ * with the rail's INA700 at each point, and fits the offset and gain error of the
+ * regulator setpoints. The result is applied by thundervolt_set_voltage, so the
+ * same voltage profile gives the same rail voltages on every board.
+ *
+ * The sweep drops the rail up to CALIBRATION_SPAN_MV below stock, so it must only
+ * run while Hollywood is held in reset.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "i2c/thundervolt.h"
+
+// How far below stock the sweep goes, in mV
+#define CALIBRATION_SPAN_MV         150
+
+// Largest fitted offset and gain error that are accepted, in mV and 1/1000
+// A regulator that far out is more likely a bad measurement than something to correct for
+#define CALIBRATION_MAX_OFFSET_MV   20
+#define CALIBRATION_MAX_GAIN        40
+
+// Largest distance of any point of the sweep from the fitted line, in mV (about two INA700 LSBs)
+#define CALIBRATION_MAX_RESIDUAL_MV 6
+
+// Error codes
+enum {
+  CALIBRATION_ERR_RANGE = 30, // The fitted offset or gain is out of range
+  CALIBRATION_ERR_FIT, // The sweep doesn't fit a straight line
+};
+
+/**
+ * Calibrate a rail.
+ *
+ * Uses the I2C bus in controller mode, and takes roughly 50ms. The rail is left at
+ * its stock voltage. The new calibration is only applied if the fit is accepted,
+ * otherwise the rail is left uncalibrated.
+ *
+ * @param rail The rail to calibrate, see THUNDERVOLT_RAIL_xxx
+ * @param cal  The fitted calibration
+ *
+ * @return 0 on success, or a negative error code
+ */
+int calibration_run(uint8_t rail, struct thundervolt_calibration *cal);
+
+/**
+ * Fit the calibration to a sweep.
+ *
+ * The fit is rejected if the offset or gain error is out of range, or if any point is
+ * more than CALIBRATION_MAX_RESIDUAL_MV from the fitted line.
+ *
+ * @param x      The setpoint of each point, relative to stock, in mV
+ * @param error  The measured voltage minus the setpoint at each point, in mV
+ * @param points The number of points
+ * @param cal    The fitted calibration, only written if the fit is accepted
+ *
+ * @return 0 on success, or a negative error code
+ */
+int calibration_fit(const float *x, const float *error, uint8_t points, struct thundervolt_calibration *cal);
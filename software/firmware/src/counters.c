@@ -0,0 +1,120 @@
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "counters.h"
+#include "i2c.h"
+#include "i2c/thundervolt.h"
+#include "i2c_target.h"
+
+// Longest interrupt handler since the last clear, in CPU cycles
+static volatile uint16_t isr_max = 0;
+
+// Interrupt handlers over their budget since the last clear
+static volatile uint16_t isr_overruns = 0;
+
+// EEPROM bytes written since the last clear
+static volatile uint32_t eeprom_writes = 0;
+
+// Counter page latched by the last read of offset 0
+static uint8_t latched[THUNDERVOLT_COUNT_SIZE];
+
+static inline void put_word(uint8_t offset, uint16_t value)
+{
+  latched[offset]     = value & 0xFF;
+  latched[offset + 1] = value >> 8;
+}
+
+static inline void put_long(uint8_t offset, uint32_t value)
+{
+  put_word(offset, value & 0xFFFF);
+  put_word(offset + 2, value >> 16);
+}
+
+void counters_init()
+{
+  // Count main clock cycles, wrapping at 0xFFFF
+  TCB1.CCMP  = 0xFFFF;
+  TCB1.CTRLB = TCB_CNTMODE_INT_gc;
+  TCB1.CTRLA = TCB_CLKSEL_CLKDIV1_gc | TCB_ENABLE_bm;
+}
+
+// Count an overrun, from an interrupt handler
+static inline void count_overrun()
+{
+  if (isr_overruns < UINT16_MAX)
+    isr_overruns++;
+}
+
+uint16_t counters_isr_done(uint16_t start, uint16_t budget)
+{
+  uint16_t duration;
+
+  // The ALERT handler can interrupt the others, and reads TCB1 itself, so everything is done atomically
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    duration = TCB1.CNT - start + COUNTERS_ENTRY_CYCLES;
+    if (duration > isr_max)
+      isr_max = duration;
+    if (duration > budget)
+      count_overrun();
+  }
+
+  return duration;
+}
+
+void counters_isr_deadline(uint16_t start, uint16_t budget)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if ((uint16_t)(TCB1.CNT - start + COUNTERS_ENTRY_CYCLES) > budget)
+      count_overrun();
+  }
+}
+
+void counters_eeprom_written()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (eeprom_writes < UINT32_MAX)
+      eeprom_writes++;
+  }
+}
+
+uint8_t counters_read(uint16_t offset)
+{
+  if (offset >= THUNDERVOLT_COUNT_SIZE)
+    return 0x00;
+
+  // Latch the whole page at the start of a read, the counters keep moving while it is read out
+  if (offset == 0) {
+    struct i2c_target_stats stats;
+    i2c_target_get_stats(&stats);
+
+    put_long(THUNDERVOLT_COUNT_TRANSACTIONS, stats.transactions);
+    put_long(THUNDERVOLT_COUNT_BYTES, stats.bytes);
+    put_word(THUNDERVOLT_COUNT_REJECTED, stats.rejected);
+    put_word(THUNDERVOLT_COUNT_STRETCHES, stats.stretches);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      put_word(THUNDERVOLT_COUNT_ISR_MAX, isr_max);
+      put_word(THUNDERVOLT_COUNT_ISR_OVERRUNS, isr_overruns);
+      put_long(THUNDERVOLT_COUNT_EEPROM_WRITES, eeprom_writes);
+    }
+    put_word(THUNDERVOLT_COUNT_BUS_ERRORS, i2c_get_errors());
+  }
+
+  return latched[offset];
+}
+
+void counters_clear()
+{
+  i2c_target_clear_stats();
+  i2c_clear_errors();
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    isr_max       = 0;
+    isr_overruns  = 0;
+    eeprom_writes = 0;
+  }
+}
@@ -0,0 +1,103 @@
+/**
+ * Performance counters for Thundervolt.
+ *
+ * Counts how busy the firmware is in the field, see THUNDERVOLT_COUNT_xxx for
+ * the layout of the counter page in register window 0x06. The I2C target and
+ * controller keep their own counts, this module adds the interrupt handler
+ * timing and the EEPROM writes, and latches them all into the counter page.
+ *
+ * Interrupt handlers are timed against TCB1, which runs freely from the main
+ * clock, so durations are in CPU cycles whatever the clock speed was, and
+ * checked against their budgets from profile.h. Timed handlers are defined
+ * with COUNTERS_TIMED_ISR, which reads TCB1 before the compiler saves any
+ * registers, so the timing covers the whole handler.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+// Cycles from an interrupt request to TCB1 being read in a COUNTERS_TIMED_ISR vector: the interrupt response (5),
+// the jump from the vector table (3), and the register save, interrupt disable and low byte read (1 + 1 + 3)
+#define COUNTERS_ENTRY_CYCLES 13
+
+/**
+ * Define an interrupt handler timed from its first cycle.
+ *
+ * The vector itself saves one register and records TCB1 in name_start, then jumps to the handler body, a
+ * separate function that saves the registers it needs as usual. A timestamp taken in the body would miss those
+ * register saves, and the time before the vector's first instruction, see COUNTERS_ENTRY_CYCLES. TCB1 is read
+ * with interrupts disabled, so a higher level handler reading it can't corrupt the high byte.
+ *
+ * Use as `COUNTERS_TIMED_ISR(TWI0_TWIS_vect, twi) { ... counters_isr_done(twi_start, budget); }`.
+ *
+ * @param vector The interrupt vector
+ * @param name   The name of the handler body, and the prefix of its start time variable
+ */
+#define COUNTERS_TIMED_ISR(vector, name)                                                                               \
+  static volatile uint16_t name##_start;                                                                               \
+  void __vector_##name(void) __attribute__((signal, used));                                                            \
+  ISR(vector, ISR_NAKED)                                                                                               \
+  {                                                                                                                    \
+    asm volatile("push r24\n\t"                                                                                        \
+                 "cli\n\t"                                                                                             \
+                 "lds r24, %[cnt]\n\t"                                                                                 \
+                 "sts %[start], r24\n\t"                                                                               \
+                 "lds r24, %[cnt]+1\n\t"                                                                               \
+                 "sei\n\t"                                                                                             \
+                 "sts %[start]+1, r24\n\t"                                                                             \
+                 "pop r24\n\t"                                                                                         \
+                 "jmp __vector_" #name                                                                                 \
+                 :                                                                                                     \
+                 : [cnt] "i"(&TCB1.CNT), [start] "i"(&name##_start));                                                  \
+  }                                                                                                                    \
+  void __vector_##name(void)
+
+/**
+ * Start the interrupt handler timer.
+ */
+void counters_init();
+
+/**
+ * Record the duration of an interrupt handler, safe to call from interrupt handlers.
+ *
+ * @param start  The start time of the handler, name_start from COUNTERS_TIMED_ISR
+ * @param budget The handler's budget, in CPU cycles, see PROFILE_BUDGET_xxx
+ *
+ * @return The duration of the handler, in CPU cycles
+ */
+uint16_t counters_isr_done(uint16_t start, uint16_t budget);
+
+/**
+ * Check a deadline inside an interrupt handler, counting an overrun if it was missed.
+ *
+ * Doesn't count towards the longest handler, the handler still finishes with counters_isr_done.
+ *
+ * @param start  The start time of the handler, name_start from COUNTERS_TIMED_ISR
+ * @param budget The deadline, in CPU cycles from the interrupt request, see PROFILE_BUDGET_xxx
+ */
+void counters_isr_deadline(uint16_t start, uint16_t budget);
+
+/**
+ * Count an EEPROM byte write, from the main loop, see storage.h.
+ */
+void counters_eeprom_written();
+
+/**
+ * Read a byte from the counter page.
+ *
+ * Reading offset 0 latches all the counters, so a burst read starting there is consistent.
+ *
+ * @param offset The byte offset into the counter page
+ *
+ * @return The byte at the offset, or 0x00 if the offset is past the end of the page
+ */
+uint8_t counters_read(uint16_t offset);
+
+/**
+ * Reset all the counters to 0, safe to call from interrupt handlers.
+ */
+void counters_clear();
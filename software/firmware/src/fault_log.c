@@ -0,0 +1,123 @@
+#include <stdbool.h>
+
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+
+#include "fault_log.h"
+#include "i2c/thundervolt.h"
+#include "sched.h"
+#include "storage.h"
+
+// Saved records, stored below the voltage profile slots, THUNDERVOLT_FAULT_RECORD_SIZE bytes per record
+#define EEPROM_FAULTS_ADDR 0x80
+
+// Slot the next saved record is written to, stored above the voltage profile slots
+#define EEPROM_FAULTS_HEAD_ADDR ((uint8_t *)0xE8)
+
+// Records since reset, in a ring overwriting the oldest, stored packed so they can be read back byte by byte
+static uint8_t records[THUNDERVOLT_FAULT_MAX_RECORDS][THUNDERVOLT_FAULT_RECORD_SIZE];
+static uint8_t records_head  = 0;
+static uint8_t records_count = 0;
+
+// Last measured board temperature
+static volatile int8_t last_temp = THUNDERVOLT_FAULT_TEMP_UNKNOWN;
+
+static inline uint8_t *get_saved_addr(uint8_t slot)
+{
+  return (uint8_t *)(EEPROM_FAULTS_ADDR + slot * THUNDERVOLT_FAULT_RECORD_SIZE);
+}
+
+// Get the slot the next record is saved to, an erased EEPROM reads as 0xFF
+static uint8_t get_saved_head()
+{
+  uint8_t head = eeprom_read_byte(EEPROM_FAULTS_HEAD_ADDR);
+  return head < THUNDERVOLT_FAULT_MAX_SAVED ? head : 0;
+}
+
+void fault_log(uint8_t event, uint8_t addr, uint8_t data)
+{
+  uint32_t now = sched_millis();
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    uint8_t *record = records[records_head];
+    records_head    = (records_head + 1) & (THUNDERVOLT_FAULT_MAX_RECORDS - 1);
+    if (records_count < THUNDERVOLT_FAULT_MAX_RECORDS)
+      records_count++;
+
+    record[THUNDERVOLT_FAULT_EVENT] = event;
+    for (uint8_t i = 0; i < 4; i++) record[THUNDERVOLT_FAULT_TIME + i] = now >> (i * 8);
+    record[THUNDERVOLT_FAULT_ADDR] = addr;
+    record[THUNDERVOLT_FAULT_DATA] = data;
+    record[THUNDERVOLT_FAULT_TEMP] = last_temp;
+  }
+}
+
+void fault_log_set_temp(int8_t temp)
+{
+  last_temp = temp;
+}
+
+void fault_log_save(uint8_t event)
+{
+  // Find the newest record of the event
+  uint8_t record[THUNDERVOLT_FAULT_RECORD_SIZE];
+  bool found = false;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (uint8_t i = 1; i <= records_count && !found; i++) {
+      const uint8_t *r = records[(records_head - i) & (THUNDERVOLT_FAULT_MAX_RECORDS - 1)];
+      if (r[THUNDERVOLT_FAULT_EVENT] == event) {
+        for (uint8_t j = 0; j < THUNDERVOLT_FAULT_RECORD_SIZE; j++) record[j] = r[j];
+        found = true;
+      }
+    }
+  }
+
+  if (!found)
+    return;
+
+  uint8_t head  = get_saved_head();
+  uint8_t *addr = get_saved_addr(head);
+
+  // Invalidate the slot first and write the event last, so an interrupted save leaves it empty rather than half written
+  storage_update_byte(addr + THUNDERVOLT_FAULT_EVENT, 0xFF);
+  for (uint8_t i = THUNDERVOLT_FAULT_EVENT + 1; i < THUNDERVOLT_FAULT_RECORD_SIZE; i++)
+    storage_update_byte(addr + i, record[i]);
+  storage_update_byte(addr + THUNDERVOLT_FAULT_EVENT, record[THUNDERVOLT_FAULT_EVENT]);
+
+  storage_update_byte(EEPROM_FAULTS_HEAD_ADDR, (head + 1) & (THUNDERVOLT_FAULT_MAX_SAVED - 1));
+}
+
+uint8_t fault_log_read(uint16_t offset)
+{
+  uint8_t index = offset / THUNDERVOLT_FAULT_RECORD_SIZE;
+  if (index >= records_count)
+    return 0x00;
+
+  uint8_t slot = (records_head - records_count + index) & (THUNDERVOLT_FAULT_MAX_RECORDS - 1);
+  return records[slot][offset % THUNDERVOLT_FAULT_RECORD_SIZE];
+}
+
+uint8_t fault_log_read_saved(uint16_t offset)
+{
+  // The slots fill up from 0, so until the ring wraps the slot at the head is still empty
+  // The EEPROM is memory-mapped, so reading it is quick enough for the interrupt handler
+  uint8_t head  = get_saved_head();
+  bool wrapped  = eeprom_read_byte(get_saved_addr(head) + THUNDERVOLT_FAULT_EVENT) != 0xFF;
+  uint8_t first = wrapped ? head : 0;
+  uint8_t count = wrapped ? THUNDERVOLT_FAULT_MAX_SAVED : head;
+
+  uint8_t index = offset / THUNDERVOLT_FAULT_RECORD_SIZE;
+  if (index >= count)
+    return 0x00;
+
+  uint8_t *addr = get_saved_addr((first + index) & (THUNDERVOLT_FAULT_MAX_SAVED - 1));
+  uint8_t value = eeprom_read_byte(addr + offset % THUNDERVOLT_FAULT_RECORD_SIZE);
+
+  // A save was interrupted, the slot reads as unused
+  if (offset % THUNDERVOLT_FAULT_RECORD_SIZE == THUNDERVOLT_FAULT_EVENT && value == 0xFF)
+    return 0x00;
+
+  return value;
+}
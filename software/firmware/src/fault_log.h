@@ -0,0 +1,62 @@
+/**
+ * Fault log for Thundervolt.
+ *
+ * A black-box recorder for the events that lead up to a shutdown. Records are
+ * kept in an SRAM ring since reset, overwriting the oldest, and serious events
+ * (a failed boot scan, an over-temperature shutdown or a regulator fault) are
+ * also saved to a small EEPROM ring, so they can be read back after the board
+ * has been power cycled.
+ *
+ * Logging only stores a record in SRAM, so it's cheap enough for the interrupt
+ * handlers. The temperature in each record is the last one the main loop
+ * measured, the interrupt handlers never touch the I2C bus.
+ *
+ * Records use the THUNDERVOLT_FAULT_xxx layout from i2c/thundervolt.h.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Record an event, safe to call from interrupt handlers.
+ *
+ * @param event The THUNDERVOLT_FAULT_xxx event
+ * @param addr  The I2C address of the device involved, 0 if none
+ * @param data  The register snapshot for the event
+ */
+void fault_log(uint8_t event, uint8_t addr, uint8_t data);
+
+/**
+ * Update the temperature recorded with each event.
+ *
+ * @param temp The board temperature, in degrees C
+ */
+void fault_log_set_temp(int8_t temp);
+
+/**
+ * Save the newest record of an event to the EEPROM ring.
+ *
+ * Writes the EEPROM, so must only be called from the main loop.
+ *
+ * @param event The THUNDERVOLT_FAULT_xxx event
+ */
+void fault_log_save(uint8_t event);
+
+/**
+ * Read a byte from the log since reset, as if the records were stored contiguously, oldest first.
+ *
+ * @param offset The byte offset into the log
+ *
+ * @return The byte at the offset, or 0x00 if the offset is past the newest record
+ */
+uint8_t fault_log_read(uint16_t offset);
+
+/**
+ * Read a byte from the records saved to the EEPROM, as if they were stored contiguously, oldest first.
+ *
+ * @param offset The byte offset into the saved records
+ *
+ * @return The byte at the offset, or 0x00 if the offset is past the newest record
+ */
+uint8_t fault_log_read_saved(uint16_t offset);
@@ -0,0 +1,70 @@
+#include <stdbool.h>
+
+#include "governor.h"
+#include "i2c/thundervolt.h"
+
+// How far below the soft limit the board must cool before throttling is released, in degrees C
+#define GOVERNOR_HYSTERESIS     5
+
+// How far ahead the temperature is predicted from the slope, in seconds
+#define GOVERNOR_LOOKAHEAD_S    10
+
+// Slope filter strength, each reading moves the filtered slope 1/N of the way to the new value
+#define GOVERNOR_SLOPE_FILTER   8
+
+// Updates to wait after a change before throttling further (1s) or releasing a step (5s),
+// giving the board time to respond to the new voltages
+#define GOVERNOR_STEP_UP_HOLD   4
+#define GOVERNOR_RELEASE_HOLD   20
+
+// Governor state
+static uint8_t throttle = 0;
+static uint8_t hold     = 0;
+
+// Temperature history
+static bool have_reading = false;
+static float last_temp;
+static float slope; // degrees C per second
+
+uint8_t governor_update(int8_t soft_limit)
+{
+  // Keep the current throttle step if the sensors didn't respond
+  float temp;
+  if (thundervolt_get_max_temp(&temp) != 0)
+    return throttle;
+
+  // Track the temperature slope, filtered since the TMP1075 only resolves 1/16 degree steps
+  if (have_reading)
+    slope += ((temp - last_temp) * (1000.0f / GOVERNOR_PERIOD_MS) - slope) / GOVERNOR_SLOPE_FILTER;
+
+  last_temp    = temp;
+  have_reading = true;
+
+  if (hold > 0)
+    hold--;
+
+  // Only use the slope to throttle earlier, never to release earlier
+  float predicted = slope > 0 ? temp + slope * GOVERNOR_LOOKAHEAD_S : temp;
+
+  if (predicted >= soft_limit) {
+    // Throttle another step, straight away if the board is already past the soft limit
+    if (throttle < THUNDERVOLT_THROTTLE_MAX && (hold == 0 || temp >= soft_limit)) {
+      throttle++;
+      hold = GOVERNOR_STEP_UP_HOLD;
+    }
+  } else if (throttle > 0 && hold == 0 && slope <= 0 && temp < soft_limit - GOVERNOR_HYSTERESIS) {
+    // Release a step once the board has cooled down and stopped heating up
+    throttle--;
+    hold = GOVERNOR_RELEASE_HOLD;
+  }
+
+  return throttle;
+}
+
+void governor_reset()
+{
+  throttle     = 0;
+  hold         = 0;
+  have_reading = false;
+  slope        = 0;
+}
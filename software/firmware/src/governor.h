@@ -0,0 +1,35 @@
+/**
+ * Thermal governor for Thundervolt.
+ *
+ * Throttles the rails towards stock voltages in steps as the board approaches
+ * the over-temperature limit, so an undervolted console slows its heating down
+ * instead of hitting the hard shutdown. Throttling is released one step at a
+ * time once the board has cooled below the soft limit and stopped heating up.
+ *
+ * The temperature slope is tracked so throttling can start before the soft
+ * limit is reached when the board is heating up quickly.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Governor update period, in milliseconds
+#define GOVERNOR_PERIOD_MS 250
+
+/**
+ * Take a temperature reading and update the throttle step.
+ *
+ * Uses the I2C bus in controller mode, so must only be called from the main loop,
+ * every GOVERNOR_PERIOD_MS.
+ *
+ * @param soft_limit The temperature to keep the board below, in degrees C
+ *
+ * @return The throttle step, from 0 (not throttling) to THUNDERVOLT_THROTTLE_MAX (stock voltages)
+ */
+uint8_t governor_update(int8_t soft_limit);
+
+/**
+ * Stop throttling, and forget the temperature history.
+ */
+void governor_reset();
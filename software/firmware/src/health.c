@@ -0,0 +1,14 @@
+#include "health.h"
+#include "i2c/thundervolt.h"
+
+uint8_t health_poll(uint8_t *health, uint8_t *addrs, uint8_t *status)
+{
+  // Read all the regulators back to back, so the bus is only held up once per poll
+  uint8_t read = 0;
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    if (thundervolt_get_regulator_health(i, &health[i], &addrs[i], &status[i]) == 0)
+      read |= 1 << i;
+  }
+
+  return read;
+}
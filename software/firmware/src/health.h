@@ -0,0 +1,27 @@
+/**
+ * Regulator health polling for Thundervolt.
+ *
+ * Reading a regulator's STATUS register clears the faults it reports, so a
+ * poll returns every rail that was read back, even when a later rail's read
+ * fails, and the caller must latch all of them.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Read the health of every regulator.
+ *
+ * A regulator that doesn't respond reads as THUNDERVOLT_HEALTH_NO_RESPONSE. Any other failure, such as a lost
+ * arbitration or a busy bus, says nothing about the regulator, so only that rail is skipped.
+ *
+ * Uses the I2C bus in controller mode, so must only be called from the main loop.
+ *
+ * @param health The health of each rail, see THUNDERVOLT_HEALTH_xxx
+ * @param addrs  The I2C address of each rail's regulator
+ * @param status The raw STATUS register of each rail's regulator
+ *
+ * @return The rails that were read, 1 bit per rail
+ */
+uint8_t health_poll(uint8_t *health, uint8_t *addrs, uint8_t *status);
@@ -4,8 +4,16 @@
 
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <util/atomic.h>
+#include <util/delay.h>
 
+#include "counters.h"
+#include "crc8.h"
+#include "fault_log.h"
+#include "i2c/thundervolt.h"
 #include "i2c_target.h"
+#include "power.h"
+#include "profile.h"
 
 // State machine for I2C target mode
 static enum i2c_state { IDLE, NEW_TRANSACTION, RECEIVED_ADDRESS, RECEIVED_DATA, SENT_DATA };
@@ -14,10 +22,51 @@ static enum i2c_state { IDLE, NEW_TRANSACTION, RECEIVED_ADDRESS, RECEIVED_DATA,
 static volatile enum i2c_state i2c_state = IDLE;
 static volatile uint8_t reg_index        = 0;
 
+// The next byte to send, fetched ahead of time so reads can be answered immediately
+static volatile uint8_t prefetch = 0;
+
+// Set if the read callback rejected the prefetched byte, only counted once the byte is actually sent
+static bool prefetch_rejected = false;
+
+// Register image, served directly without going through the read callback
+static const volatile uint8_t *reg_image = NULL;
+static uint8_t reg_image_len             = 0;
+
 // Register access functions
 static read_register_fn reg_read_fn   = NULL;
 static write_register_fn reg_write_fn = NULL;
 
+// Our own address, needed to calculate the PEC
+static uint8_t target_addr = 0;
+
+// Packet Error Checking state. PEC is enabled or disabled at the start of a transaction.
+static volatile bool pec_requested = false;
+static bool pec_active             = false;
+static uint8_t pec_crc;
+static uint8_t pec_errors = 0;
+
+// Bytes written in a PEC transaction, applied at the stop condition once the PEC has been checked
+static uint8_t pec_buf[I2C_TARGET_PEC_BUF_LEN];
+static uint8_t pec_buf_len;
+
+// Bytes left in a PEC block read, the PEC byte is sent when this reaches zero
+static uint8_t block_remaining;
+
+// Transaction statistics, only updated from the interrupt handler
+static struct i2c_target_stats stats;
+
+static inline void count16(uint16_t *counter)
+{
+  if (*counter != UINT16_MAX)
+    (*counter)++;
+}
+
+static inline void count32(uint32_t *counter)
+{
+  if (*counter != UINT32_MAX)
+    (*counter)++;
+}
+
 static inline void i2c_ack()
 {
   TWI0.SCTRLB = TWI_SCMD_RESPONSE_gc;
@@ -26,6 +75,7 @@ static inline void i2c_ack()
 static inline void i2c_nack()
 {
   TWI0.SCTRLB = TWI_SCMD_RESPONSE_gc | TWI_ACKACT_NACK_gc;
+  count16(&stats.rejected);
 }
 
 static inline void i2c_complete()
@@ -33,41 +83,139 @@ static inline void i2c_complete()
   TWI0.SCTRLB = TWI_SCMD_COMPTRANS_gc;
 }
 
-static void i2c_target_end_transaction()
+// Fetch the value of a register, from the image if possible
+static inline uint8_t i2c_target_fetch(uint8_t reg_addr)
+{
+  prefetch_rejected = false;
+  if (reg_addr < reg_image_len)
+    return reg_image[reg_addr];
+
+  uint8_t value;
+  prefetch_rejected = reg_read_fn(reg_addr, &value) < 0;
+  return value;
+}
+
+// Write a register through the write callback, counting rejected writes
+static inline void i2c_target_store(uint8_t reg_addr, uint8_t value)
+{
+  if (reg_write_fn(reg_addr, value) < 0)
+    count16(&stats.rejected);
+}
+
+// Apply the data written in a PEC transaction, if the PEC matches
+static void i2c_target_commit_pec_write()
+{
+  // The last byte is the PEC, so the CRC over all bytes is zero if the data arrived intact
+  if (pec_crc != 0) {
+    pec_errors++;
+    fault_log(THUNDERVOLT_FAULT_PEC, target_addr, reg_index);
+    return;
+  }
+
+  for (uint8_t i = 0; i + 1 < pec_buf_len; i++)
+    i2c_target_store(reg_index++, pec_buf[i]);
+}
+
+static void i2c_target_end_transaction(bool stop)
 {
+  // Let the CPU slow down and sleep again
+  if (i2c_state != IDLE)
+    power_set_busy(POWER_BUSY_I2C, false);
+
+  if (stop && pec_active && i2c_state == RECEIVED_DATA)
+    i2c_target_commit_pec_write();
+
   i2c_state = IDLE;
   i2c_complete();
 }
 
-static void i2c_target_handle_address_match()
+static void i2c_target_handle_address_match(uint8_t status)
 {
+  bool read = status & TWI_DIR_bm;
+
+  if (i2c_state == IDLE) {
+    // Keep the CPU at full speed until the transaction is done
+    power_set_busy(POWER_BUSY_I2C, true);
+    count32(&stats.transactions);
+
+    // Latch the PEC mode for the whole transaction
+    pec_active      = pec_requested;
+    pec_crc         = 0;
+    pec_buf_len     = 0;
+    block_remaining = 0;
+  } else if (pec_active && read) {
+    // A repeated start after [reg][len] is a PEC block read, anything else is a plain read
+    block_remaining = pec_buf_len == 1 ? pec_buf[0] : 0;
+    pec_buf_len     = 0;
+  }
+
+  if (pec_active)
+    pec_crc = crc8_update(pec_crc, (target_addr << 1) | read);
+
   i2c_state = NEW_TRANSACTION;
   i2c_ack();
+
+  // Refresh the prefetched byte for a read, a register may have changed since it was fetched. Writes don't
+  // prefetch, the window read callback has side effects such as latching the counter page.
+  if (read)
+    prefetch = i2c_target_fetch(reg_index);
 }
 
-static void i2c_target_handle_data()
+static void i2c_target_handle_data(uint8_t status)
 {
-  if (TWI0.SSTATUS & TWI_DIR_bm) {
+  if (status & TWI_DIR_bm) {
     // Handle reads from a master
-    if ((TWI0.SSTATUS & TWI_RXACK_bm) && i2c_state == SENT_DATA) {
+    if ((status & TWI_RXACK_bm) && i2c_state == SENT_DATA) {
       // Client NACK'd the last byte, so end the transaction
       i2c_complete();
     } else {
-      // Send the contents of the current register
-      reg_read_fn(reg_index++, &TWI0.SDATA);
-      i2c_state = SENT_DATA;
+      // Send the prefetched byte, releasing the clock as soon as possible
+      TWI0.SDATA = prefetch;
+      i2c_state  = SENT_DATA;
       i2c_ack();
+
+      count32(&stats.bytes);
+      if (prefetch_rejected)
+        count16(&stats.rejected);
+
+      // In a PEC block read, send the PEC after the last byte of the block
+      if (block_remaining) {
+        pec_crc = crc8_update(pec_crc, prefetch);
+        if (--block_remaining == 0) {
+          prefetch          = pec_crc;
+          prefetch_rejected = false;
+          return;
+        }
+      }
+
+      // Fetch the next byte while this one is being clocked out
+      prefetch = i2c_target_fetch(++reg_index);
     }
   } else {
     // Handle writes from a master
+    uint8_t data = TWI0.SDATA;
+    if (pec_active)
+      pec_crc = crc8_update(pec_crc, data);
+
+    count32(&stats.bytes);
+
     if (i2c_state == NEW_TRANSACTION) {
       // The first byte is the register address
-      reg_index = TWI0.SDATA;
+      reg_index = data;
       i2c_state = RECEIVED_ADDRESS;
       i2c_ack();
+    } else if (pec_active) {
+      // Buffer the data until the PEC has been checked, refusing anything that doesn't fit
+      if (pec_buf_len < I2C_TARGET_PEC_BUF_LEN) {
+        pec_buf[pec_buf_len++] = data;
+        i2c_state              = RECEIVED_DATA;
+        i2c_ack();
+      } else {
+        i2c_nack();
+      }
     } else {
       // Subsequent bytes are data, write them to the current register
-      reg_write_fn(reg_index++, TWI0.SDATA);
+      i2c_target_store(reg_index++, data);
       i2c_state = RECEIVED_DATA;
       i2c_ack();
     }
@@ -75,22 +223,34 @@ static void i2c_target_handle_data()
 }
 
 // I2C target mode interrupt handler
-ISR(TWI0_TWIS_vect)
+COUNTERS_TIMED_ISR(TWI0_TWIS_vect, twi)
 {
-  if (TWI0.SSTATUS & (TWI_COLL_bm | TWI_BUSERR_bm)) {
-    // Handle collisions and bus errors
-    i2c_target_end_transaction();
-  } else if (TWI0.SSTATUS & TWI_APIF_bm) {
+  PROFILE_ENTER(PROFILE_PIN_TWI);
+
+  uint8_t status = TWI0.SSTATUS;
+
+  if (status & (TWI_COLL_bm | TWI_BUSERR_bm)) {
+    // Handle collisions and bus errors, which can happen when multiple controllers share the bus.
+    // Clear the flags so they don't mask the next address match.
+    TWI0.SSTATUS = TWI_COLL_bm | TWI_BUSERR_bm;
+    i2c_target_end_transaction(false);
+  } else if (status & TWI_DIF_bm) {
+    // Handle data interrupts first, they are the most frequent
+    i2c_target_handle_data(status);
+  } else if (status & TWI_APIF_bm) {
     // Handle address match and stop condition interrupts
-    if (TWI0.SSTATUS & TWI_AP_bm) {
-      i2c_target_handle_address_match();
+    if (status & TWI_AP_bm) {
+      i2c_target_handle_address_match(status);
     } else {
-      i2c_target_end_transaction();
+      i2c_target_end_transaction(true);
     }
-  } else if (TWI0.SSTATUS & TWI_DIF_bm) {
-    // Handle data interrupts
-    i2c_target_handle_data();
   }
+
+  // The clock is held from the interrupt until the response, so a long handler stretches it
+  if (counters_isr_done(twi_start, PROFILE_BUDGET_TWI_CYCLES) > I2C_TARGET_STRETCH_CYCLES)
+    count16(&stats.stretches);
+
+  PROFILE_EXIT(PROFILE_PIN_TWI);
 }
 
 void i2c_target_init(uint8_t addr, read_register_fn read_fn, write_register_fn write_fn)
@@ -100,8 +260,49 @@ void i2c_target_init(uint8_t addr, read_register_fn read_fn, write_register_fn w
   reg_write_fn = write_fn;
 
   // Set the I2C target address
-  TWI0.SADDR = (addr << 1);
+  target_addr = addr;
+  TWI0.SADDR  = (addr << 1);
 
   // Enable I2C target mode, smart mode, and stop/address match/data interrupts
   TWI0.SCTRLA = TWI_DIEN_bm | TWI_APIEN_bm | TWI_PIEN_bm | TWI_SMEN_bm | TWI_ENABLE_bm;
-}
\ No newline at end of file
+}
+
+void i2c_target_stop()
+{
+  for (uint16_t us = 0; i2c_state != IDLE && us < I2C_TARGET_STOP_TIMEOUT_US; us += 10)
+    _delay_us(10);
+
+  TWI0.SCTRLA = 0;
+}
+
+void i2c_target_set_image(const volatile uint8_t *image, uint8_t len)
+{
+  reg_image     = image;
+  reg_image_len = len;
+}
+
+void i2c_target_set_pec(bool enable)
+{
+  pec_requested = enable;
+}
+
+uint8_t i2c_target_get_pec_errors()
+{
+  return pec_errors;
+}
+
+void i2c_target_get_stats(struct i2c_target_stats *out)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { *out = stats; }
+}
+
+void i2c_target_clear_stats()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    stats.transactions = 0;
+    stats.bytes        = 0;
+    stats.rejected     = 0;
+    stats.stretches    = 0;
+  }
+}
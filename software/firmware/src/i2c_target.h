@@ -6,12 +6,62 @@
  * - Supports auto-incrementing register reads and writes
  * - No support for I2C general call addresses
  * - No support for matching on multiple addresses
+ * - Can be used alongside controller mode on the same TWI peripheral. The controller tracks
+ *   the bus state, so it waits for our own target transactions to finish before starting.
+ *
+ * Reads are served from a prefetched byte, so the clock is released as soon as possible.
+ * Registers in the optional register image (see i2c_target_set_image) are read directly,
+ * other registers go through the read callback.
+ *
+ * Optional SMBus Packet Error Checking (see i2c_target_set_pec):
+ * - Writes are [reg][data...][PEC], and are only applied at the stop condition if the PEC matches
+ * - Block reads are [reg][len], repeated start, then len bytes of data followed by the PEC
+ * - Reads without a length are served as usual, without a PEC
+ *
+ * The target marks itself busy with the power manager (see power.h) for the duration of
+ * each transaction, so the CPU runs at full speed and doesn't enter standby mid-transaction.
+ * Define POWER_BOOST_I2C_CLOCK to run at 10MHz instead while addressed.
+ *
+ * Transactions, bytes, rejected accesses and long clock stretches are counted with
+ * saturating counters (see i2c_target_get_stats), for the firmware's performance counters.
  */
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "i2c/thundervolt.h"
+
+// Maximum number of bytes in a PEC write, including the PEC byte. The largest write the host library makes is
+// the 4 regulator health registers, so this leaves room for growth without tying up SRAM for longer writes.
+// The host library refuses longer PEC writes itself, see THUNDERVOLT_PEC_WRITE_MAX.
+#define I2C_TARGET_PEC_BUF_LEN (THUNDERVOLT_PEC_WRITE_MAX + 1)
+
+// Interrupts longer than a byte time at 400kHz (22.5us) are counted as clock stretches, in CPU cycles
+#define I2C_TARGET_STRETCH_CYCLES (F_CPU / 1000000UL * 45 / 2)
+
+// Longest wait for a transaction to finish in i2c_target_stop, in us. Long enough for a 200 byte burst at 100kHz,
+// a controller that never sends the stop condition doesn't hold it up for longer
+#define I2C_TARGET_STOP_TIMEOUT_US 20000
+
+/**
+ * I2C target statistics, each saturating at its maximum
+ */
+struct i2c_target_stats {
+  /** Transactions addressed to us, not counting repeated starts */
+  uint32_t transactions;
+
+  /** Data bytes received and sent */
+  uint32_t bytes;
+
+  /** Bytes NACKed, and register accesses rejected by the read or write callback */
+  uint16_t rejected;
+
+  /** Interrupts which held the clock for longer than I2C_TARGET_STRETCH_CYCLES */
+  uint16_t stretches;
+};
+
 /**
  * Callback for reading a value from a single byte register at the specified address
  *
@@ -35,4 +85,47 @@ typedef int (*write_register_fn)(uint8_t reg_addr, uint8_t value);
  * @param read_fn The callback function for reading a register
  * @param write_fn The callback function for writing a register
  */
-void i2c_target_init(uint8_t dev_addr, read_register_fn read_fn, write_register_fn write_fn);
\ No newline at end of file
+void i2c_target_init(uint8_t dev_addr, read_register_fn read_fn, write_register_fn write_fn);
+
+/**
+ * Serve reads of the first len registers directly from memory, bypassing the read callback.
+ *
+ * Writes still go through the write callback, which is responsible for updating the image.
+ *
+ * @param image Pointer to the register image
+ * @param len   The number of registers in the image
+ */
+void i2c_target_set_image(const volatile uint8_t *image, uint8_t len);
+
+/**
+ * Wait for the current transaction to finish, then stop responding as an I2C target.
+ *
+ * Interrupts must be enabled, the transaction is finished by the interrupt handler. If it hasn't finished within
+ * I2C_TARGET_STOP_TIMEOUT_US, the target is stopped anyway, and the controller sees the rest of it NACKed.
+ */
+void i2c_target_stop();
+
+/**
+ * Enable or disable Packet Error Checking, taking effect at the start of the next transaction.
+ *
+ * @param enable True to require a PEC on writes, and append one to block reads
+ */
+void i2c_target_set_pec(bool enable);
+
+/**
+ * Get the number of PEC writes discarded because the PEC didn't match, wrapping at 255.
+ * Hosts compare successive readings for equality to detect a discarded write, so it mustn't stick at a limit.
+ */
+uint8_t i2c_target_get_pec_errors();
+
+/**
+ * Get the transaction statistics.
+ *
+ * @param stats Where to store the statistics
+ */
+void i2c_target_get_stats(struct i2c_target_stats *stats);
+
+/**
+ * Reset the transaction statistics to 0.
+ */
+void i2c_target_clear_stats();
@@ -1,6 +1,7 @@
 #include <stddef.h>
 
 #include <avr/io.h>
+#include <util/atomic.h>
 
 #include "led.h"
 
@@ -15,10 +16,18 @@ enum effect_type {
   EFFECT_CUSTOM,
 };
 
+// Brightness level at full brightness, in 8.8 fixed point
+#define LEVEL_MAX 0xFF00
+
 // Data/settings storage for effects
 union effect_data {
   // Data for fade, blink, and breathe effects
-  uint16_t period;
+  struct {
+    uint16_t period;
+    uint16_t step;  // Brightness change per millisecond, in 8.8 fixed point
+    uint16_t level; // Current brightness, in 8.8 fixed point
+    bool rising;
+  };
 
   // Data for custom effects
   struct {
@@ -31,42 +40,48 @@ union effect_data {
     uint16_t *pattern;
     uint8_t length;
     uint8_t index;
-    uint32_t last_change;
   };
 };
 
-// Time since the active effect started
+// Time since the active effect started, for custom effects
 static uint32_t start_time;
 
+// Milliseconds into the current phase of the effect (e.g. the current blink, or fade)
+static uint16_t phase_time;
+
 // Active effect type and data
-static enum effect_type effect_type;
+static volatile enum effect_type effect_type;
 static union effect_data effect_data;
 
-// Get the brightness for a fade-on effect
-static inline uint8_t fade_on_brightness(uint32_t elapsed)
-{
-  return elapsed * 255 / effect_data.period;
-}
-
-// Get the brightness for a fade-off effect
-static inline uint8_t fade_off_brightness(uint32_t elapsed)
-{
-  return 255 - fade_on_brightness(elapsed);
-}
-
 // Set the LED brightness directly
 static inline void led_set_raw(uint8_t brightness)
 {
   TCB0.CCMPH = brightness;
 }
 
+// Start a new effect, the per-tick update only has to add and compare from here on
+static void led_effect_start(enum effect_type type, uint16_t period, uint16_t ramp_time, bool rising)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    effect_type = type;
+    start_time  = 0;
+    phase_time  = 0;
+
+    effect_data.period = period ? period : 1;
+    effect_data.step   = ramp_time ? LEVEL_MAX / ramp_time : LEVEL_MAX;
+    effect_data.level  = rising ? 0 : LEVEL_MAX;
+    effect_data.rising = rising;
+  }
+}
+
 void led_init()
 {
   // Select the alternative output pin for TCB0 (PC0)
   PORTMUX.CTRLD = PORTMUX_TCB0_bm;
 
-  // Configure TCB0 for 8-bit PWM output
-  TCB0.CTRLA = TCB_ENABLE_bm;
+  // Configure TCB0 for 8-bit PWM output, from the stable clock so the idle clock changes don't alter the PWM frequency
+  TCB0.CTRLA = TCB_CLKSEL_CLKTCA_gc | TCB_ENABLE_bm;
   TCB0.CTRLB = TCB_CCMPEN_bm | TCB_CNTMODE_PWM8_gc;
 
   // Set the PWM period
@@ -79,6 +94,11 @@ void led_set(uint8_t brightness)
   led_set_raw(brightness);
 }
 
+bool led_is_active()
+{
+  return effect_type != EFFECT_NONE || TCB0.CCMPH != 0;
+}
+
 void led_effect_none()
 {
   effect_type = EFFECT_NONE;
@@ -86,105 +106,120 @@ void led_effect_none()
 
 void led_effect_blink(uint16_t period)
 {
-  effect_type = EFFECT_BLINK;
-  start_time  = 0;
-
-  effect_data.period = period;
+  led_effect_start(EFFECT_BLINK, period, 0, false);
 }
 
 void led_effect_blink_pattern(uint16_t *pattern, uint8_t length)
 {
-  effect_type = EFFECT_BLINK_PATTERN;
-  start_time  = 0;
-
-  effect_data.pattern     = pattern;
-  effect_data.length      = length;
-  effect_data.index       = 0;
-  effect_data.last_change = 0;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    effect_type = EFFECT_BLINK_PATTERN;
+    start_time  = 0;
+    phase_time  = 0;
+
+    effect_data.pattern = pattern;
+    effect_data.length  = length;
+    effect_data.index   = 0;
+  }
 }
 
 void led_effect_fade_on(uint16_t period)
 {
-  effect_type = EFFECT_FADE_ON;
-  start_time  = 0;
-
-  effect_data.period = period;
+  led_effect_start(EFFECT_FADE_ON, period, period, true);
 }
 
 void led_effect_fade_off(uint16_t period)
 {
-  effect_type = EFFECT_FADE_OFF;
-  start_time  = 0;
-
-  effect_data.period = period;
+  led_effect_start(EFFECT_FADE_OFF, period, period, false);
 }
 
 void led_effect_breathe(uint16_t period)
 {
-  effect_type = EFFECT_BREATHE;
-  start_time  = 0;
-
-  effect_data.period = period;
+  // Fade on for the first half of the period, and off for the second half
+  led_effect_start(EFFECT_BREATHE, period / 2, period / 2, true);
 }
 
 void led_effect_custom(led_effect_fn user_fn, void *user_data)
 {
-  effect_type = EFFECT_CUSTOM;
-  start_time  = 0;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    effect_type = EFFECT_CUSTOM;
+    start_time  = 0;
 
-  effect_data.user_fn   = user_fn;
-  effect_data.user_data = user_data;
+    effect_data.user_fn   = user_fn;
+    effect_data.user_data = user_data;
+  }
 }
 
-void led_effect_update(uint32_t millis)
+// Step a fade by one millisecond, returning true at the end of the fade
+static inline bool fade_step()
 {
-  if (effect_type == EFFECT_NONE)
-    return;
+  if (++phase_time >= effect_data.period) {
+    // Snap to the end of the fade, so rounding errors in the step don't build up
+    effect_data.level = effect_data.rising ? LEVEL_MAX : 0;
+    phase_time        = 0;
+    return true;
+  }
 
-  // Initialize the start time
-  if (start_time == 0)
-    start_time = millis;
+  if (effect_data.rising) {
+    effect_data.level += effect_data.step;
+  } else {
+    effect_data.level -= effect_data.step;
+  }
 
-  // Calculate the elapsed time since the effect started
-  uint32_t elapsed = millis - start_time;
+  return false;
+}
 
-  // Set the LED brightness based on the effect type
+void led_effect_update(uint32_t millis)
+{
   switch (effect_type) {
-    case EFFECT_BLINK: {
-      uint32_t pos = elapsed % (effect_data.period * 2);
-      led_set_raw(pos < effect_data.period ? 255 : 0);
-      break;
-    }
-
-    case EFFECT_BLINK_PATTERN: {
-      uint16_t period = effect_data.pattern[effect_data.index];
-      if (effect_data.last_change == 0) {
-        effect_data.last_change = elapsed;
-      } else if (elapsed - effect_data.last_change >= period) {
-        effect_data.last_change = elapsed;
-        effect_data.index       = (effect_data.index + 1) % effect_data.length;
+    case EFFECT_NONE:
+      return;
+
+    case EFFECT_BLINK:
+      // Toggle between on and off every period (rising doubles as the "off" state)
+      if (++phase_time > effect_data.period) {
+        effect_data.rising = !effect_data.rising;
+        phase_time         = 1;
       }
 
-      led_set_raw((effect_data.index % 2 == 0) ? 255 : 0);
+      led_set_raw(effect_data.rising ? 0 : 255);
       break;
-    }
 
-    case EFFECT_FADE_ON:
-      led_set_raw(fade_on_brightness(elapsed));
+    case EFFECT_BLINK_PATTERN:
+      // Move to the next step of the pattern when the current one is done
+      if (++phase_time > effect_data.pattern[effect_data.index]) {
+        if (++effect_data.index >= effect_data.length)
+          effect_data.index = 0;
+        phase_time = 1;
+      }
+
+      led_set_raw((effect_data.index & 1) ? 0 : 255);
       break;
 
+    case EFFECT_FADE_ON:
     case EFFECT_FADE_OFF:
-      led_set_raw(fade_off_brightness(elapsed));
+      // Stop at the end of the fade, holding the final brightness
+      if (fade_step())
+        effect_type = EFFECT_NONE;
+
+      led_set_raw(effect_data.level >> 8);
       break;
 
-    case EFFECT_BREATHE: {
-      uint32_t pos = (elapsed % effect_data.period) * 2;
-      led_set_raw(pos < effect_data.period ? fade_on_brightness(pos) : fade_off_brightness(pos - effect_data.period));
+    case EFFECT_BREATHE:
+      // Reverse direction at the end of each fade
+      if (fade_step())
+        effect_data.rising = !effect_data.rising;
+
+      led_set_raw(effect_data.level >> 8);
       break;
-    }
 
     case EFFECT_CUSTOM:
-      led_set_raw(effect_data.user_fn(elapsed, effect_data.user_data));
+      // Initialize the start time
+      if (start_time == 0)
+        start_time = millis;
+
+      led_set_raw(effect_data.user_fn(millis - start_time, effect_data.user_data));
       break;
   }
 }
@@ -10,6 +10,7 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 /**
@@ -50,6 +51,13 @@ static inline void led_off()
   led_set(0);
 }
 
+/**
+ * Check if the LED is lit, or has an effect running.
+ *
+ * The PWM timer needs the peripheral clock while this is true.
+ */
+bool led_is_active();
+
 /**
  * Disable any active LED effect.
  */
@@ -103,7 +111,11 @@ void led_effect_custom(led_effect_fn user_fn, void *user_data);
 /**
  * Update the LED effect.
  *
- * This function should be called periodically to update the LED effect,
- * typically from an periodic interrupt, or from the main loop.
+ * This function must be called every millisecond to update the LED effect,
+ * typically from a periodic interrupt. Effects advance by one step per call,
+ * with the step sizes worked out when the effect is started, so no divisions
+ * are needed here.
+ *
+ * @param millis The current time in milliseconds, passed to custom effects
  */
 void led_effect_update(uint32_t millis);
\ No newline at end of file
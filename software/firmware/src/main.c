@@ -4,13 +4,31 @@
 #include <avr/eeprom.h>
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <util/atomic.h>
 #include <util/delay.h>
 
+#include "battery.h"
+#include "boot_trace.h"
+#include "bootloader/bootloader.h"
+#include "calibration.h"
+#include "counters.h"
+#include "fault_log.h"
 #include "gpio.h"
+#include "governor.h"
+#include "health.h"
 #include "i2c.h"
 #include "i2c/thundervolt.h"
+#include "i2c/thundervolt_boot.h"
 #include "i2c_target.h"
 #include "led.h"
+#include "power.h"
+#include "profile.h"
+#include "rail_mode.h"
+#include "rails.h"
+#include "sched.h"
+#include "storage.h"
+#include "stream.h"
+#include "telemetry.h"
 
 // Device power states
 enum device_state { STATE_STANDBY, STATE_POWERED };
@@ -30,6 +48,15 @@ static const gpio_t LED      = {&PORTC, 0};
 static const uint16_t *EEPROM_SIGNATURE_ADDR = 0x00FE;
 static const uint16_t EEPROM_SIGNATURE       = 0xCAFE;
 
+// EEPROM layout version, stored below the signature and bumped whenever persisted registers are added
+// EEPROMs initialized before the layout was versioned read back as 0xFF
+static uint8_t *const EEPROM_LAYOUT_ADDR   = (uint8_t *)0x00FD;
+static const uint8_t EEPROM_LAYOUT_VERSION = 1;
+static const uint8_t EEPROM_LAYOUT_NONE    = 0xFF;
+
+// Voltage profile slots, stored above the persisted registers, THUNDERVOLT_PROFILE_SIZE bytes per slot
+static const uint8_t EEPROM_PROFILES_ADDR = 0xC0;
+
 // LED effect timings (in milliseconds)
 static const uint16_t LED_BREATHE_PERIOD = 2000;
 static const uint16_t LED_SOS_PATTERN[]  = {
@@ -38,12 +65,56 @@ static const uint16_t LED_SOS_PATTERN[]  = {
     200, 200, 200, 200, 200, 1400 // S
 };
 
-// RTC millisecond counter
-static volatile uint32_t millis = 0;
+// Regulator startup timings
+static const uint16_t REGULATOR_STARTUP_US  = 1100; // TPS6286x don't respond on I2C until startup is finished
+static const uint16_t POWER_GOOD_TIMEOUT_MS = 20;   // Give up if the devices still aren't responding
 
 // Device state
 static volatile enum device_state device_state = STATE_STANDBY;
 
+// Task handles
+static int8_t telemetry_task = -1;
+static int8_t settings_task  = -1;
+static int8_t commit_task    = -1;
+static int8_t clear_task     = -1;
+static int8_t alert_task     = -1;
+static int8_t otsd_task      = -1;
+static int8_t profile_task   = -1;
+static int8_t boot_task      = -1;
+
+// Voltage profile requests waiting for the main loop, 0xFF if none
+static volatile uint8_t pending_profile_select = THUNDERVOLT_PROFILE_NONE;
+static volatile uint8_t pending_profile_save   = THUNDERVOLT_PROFILE_NONE;
+
+// Registers waiting to be committed to the EEPROM, one bit per register
+static volatile uint8_t dirty_registers[(THUNDERVOLT_NUM_REGISTERS + 7) / 8];
+
+// Persisted registers added after the first firmware release, with their default values
+// They're written once when an EEPROM from older firmware is upgraded to the current layout, see initialize_eeprom
+static const struct {
+  uint8_t reg;
+  uint8_t value;
+} EXTENDED_DEFAULTS[] = {
+    {THUNDERVOLT_REG_U10_DELAY, THUNDERVOLT_DEFAULT_U10_DELAY},
+    {THUNDERVOLT_REG_OTSD_CTRL, THUNDERVOLT_DEFAULT_OTSD_CTRL},
+    {THUNDERVOLT_REG_GOV_MARGIN, THUNDERVOLT_DEFAULT_GOV_MARGIN},
+    {THUNDERVOLT_REG_AVP_GAIN_1V0, 0},
+    {THUNDERVOLT_REG_AVP_GAIN_1V15, 0},
+    {THUNDERVOLT_REG_AVP_GAIN_1V8, 0},
+    {THUNDERVOLT_REG_AVP_GAIN_3V3, 0},
+    {THUNDERVOLT_REG_MODE_CTRL, 0},
+    {THUNDERVOLT_REG_FPWM_TH_1V0, THUNDERVOLT_DEFAULT_FPWM_TH},
+    {THUNDERVOLT_REG_FPWM_TH_1V15, THUNDERVOLT_DEFAULT_FPWM_TH},
+    {THUNDERVOLT_REG_FPWM_TH_1V8, THUNDERVOLT_DEFAULT_FPWM_TH},
+    {THUNDERVOLT_REG_FPWM_TH_3V3, THUNDERVOLT_DEFAULT_FPWM_TH},
+    {THUNDERVOLT_REG_BATT_LOW_TH, THUNDERVOLT_DEFAULT_BATT_LOW_TH},
+    {THUNDERVOLT_REG_BATT_OFS_1V0, 0},
+    {THUNDERVOLT_REG_BATT_OFS_1V15, 0},
+    {THUNDERVOLT_REG_BATT_OFS_1V8, 0},
+    {THUNDERVOLT_REG_BATT_OFS_3V3, 0},
+    {THUNDERVOLT_REG_PROFILE_SELECT, THUNDERVOLT_PROFILE_NONE},
+};
+
 // Register memory space
 // For convenience we're also using the same addresses for values persisted in EEPROM
 static volatile uint8_t registers[THUNDERVOLT_NUM_REGISTERS];
@@ -52,36 +123,91 @@ static volatile uint8_t registers[THUNDERVOLT_NUM_REGISTERS];
 static void reset_eeprom()
 {
   // Write the default CONFIG register value
-  eeprom_update_byte(THUNDERVOLT_REG_CONFIG, THUNDERVOLT_LED);
+  storage_update_byte(THUNDERVOLT_REG_CONFIG, THUNDERVOLT_LED);
 
   // Write the default "stock" voltage values
-  eeprom_write_word(THUNDERVOLT_REG_VPERS_1V0_L, THUNDERVOLT_STOCK_VOLTAGE_1V0);
-  eeprom_write_word(THUNDERVOLT_REG_VPERS_1V15_L, THUNDERVOLT_STOCK_VOLTAGE_1V15);
-  eeprom_write_word(THUNDERVOLT_REG_VPERS_1V8_L, THUNDERVOLT_STOCK_VOLTAGE_1V8);
-  eeprom_write_word(THUNDERVOLT_REG_VPERS_3V3_L, THUNDERVOLT_STOCK_VOLTAGE_3V3);
+  storage_update_word(THUNDERVOLT_REG_VPERS_1V0_L, THUNDERVOLT_STOCK_VOLTAGE_1V0);
+  storage_update_word(THUNDERVOLT_REG_VPERS_1V15_L, THUNDERVOLT_STOCK_VOLTAGE_1V15);
+  storage_update_word(THUNDERVOLT_REG_VPERS_1V8_L, THUNDERVOLT_STOCK_VOLTAGE_1V8);
+  storage_update_word(THUNDERVOLT_REG_VPERS_3V3_L, THUNDERVOLT_STOCK_VOLTAGE_3V3);
 
   // Write the default over-temperature shutdown temperature
-  eeprom_update_byte(THUNDERVOLT_REG_OTSD_TEMP, THUNDERVOLT_DEFAULT_OTSD_LIMIT);
+  storage_update_byte(THUNDERVOLT_REG_OTSD_TEMP, THUNDERVOLT_DEFAULT_OTSD_LIMIT);
+
+  // Write the defaults for the newer registers
+  for (uint8_t i = 0; i < sizeof(EXTENDED_DEFAULTS) / sizeof(EXTENDED_DEFAULTS[0]); i++)
+    storage_update_byte((uint8_t *)EXTENDED_DEFAULTS[i].reg, EXTENDED_DEFAULTS[i].value);
+
+  // Empty the voltage profile slots
+  for (uint8_t i = 0; i < THUNDERVOLT_NUM_PROFILES * THUNDERVOLT_PROFILE_SIZE; i++)
+    storage_update_byte((uint8_t *)(EEPROM_PROFILES_ADDR + i), 0xFF);
 }
 
-// Initialize the EEPROM if it has never been initialized
+// Initialize the EEPROM if it has never been initialized, or upgrade it from an older layout
 static void initialize_eeprom()
 {
-  // Return early if the EEPROM has already been initialized
-  if (eeprom_read_word(EEPROM_SIGNATURE_ADDR) == EEPROM_SIGNATURE)
-    return;
-
-  // Write the default "stock" voltage values
-  reset_eeprom();
+  if (eeprom_read_word(EEPROM_SIGNATURE_ADDR) != EEPROM_SIGNATURE) {
+    // Write the default "stock" voltage values
+    reset_eeprom();
+
+    // Write the signature
+    storage_update_word(EEPROM_SIGNATURE_ADDR, EEPROM_SIGNATURE);
+  } else if (eeprom_read_byte(EEPROM_LAYOUT_ADDR) == EEPROM_LAYOUT_NONE) {
+    // Older firmware loaded the default for any of the newer registers that read back as 0xFF, which includes
+    // the ones it didn't have yet, so writing the defaults over those keeps the settings the user last saw
+    for (uint8_t i = 0; i < sizeof(EXTENDED_DEFAULTS) / sizeof(EXTENDED_DEFAULTS[0]); i++) {
+      if (eeprom_read_byte((uint8_t *)EXTENDED_DEFAULTS[i].reg) == 0xFF)
+        storage_update_byte((uint8_t *)EXTENDED_DEFAULTS[i].reg, EXTENDED_DEFAULTS[i].value);
+    }
+  }
 
-  // Write the signature
-  eeprom_write_word(EEPROM_SIGNATURE_ADDR, EEPROM_SIGNATURE);
+  // From here on every persisted byte is a setting, including 0xFF
+  storage_update_byte(EEPROM_LAYOUT_ADDR, EEPROM_LAYOUT_VERSION);
 }
 
 // Check if the specified register is read-only
 static inline bool is_read_only_register(uint8_t reg_addr)
 {
-  return reg_addr == THUNDERVOLT_REG_STATUS || reg_addr == THUNDERVOLT_REG_HWREV || reg_addr == THUNDERVOLT_REG_SWREV;
+  return reg_addr == THUNDERVOLT_REG_STATUS || reg_addr == THUNDERVOLT_REG_HWREV ||
+         reg_addr == THUNDERVOLT_REG_SWREV || reg_addr == THUNDERVOLT_REG_HIST_COUNT ||
+         reg_addr == THUNDERVOLT_REG_OTSD_LATENCY_L || reg_addr == THUNDERVOLT_REG_OTSD_LATENCY_H ||
+         reg_addr == THUNDERVOLT_REG_THROTTLE || reg_addr == THUNDERVOLT_REG_MODE_STATUS ||
+         (reg_addr >= THUNDERVOLT_REG_CAL_OFFSET_1V0 && reg_addr <= THUNDERVOLT_REG_CAL_GAIN_3V3) ||
+         reg_addr == THUNDERVOLT_REG_SUPPLY_L || reg_addr == THUNDERVOLT_REG_SUPPLY_H ||
+         reg_addr == THUNDERVOLT_REG_BATT_SOC;
+}
+
+// Check if the specified register is persisted to the EEPROM
+static inline bool is_persisted_register(uint8_t reg_addr)
+{
+  return (reg_addr <= THUNDERVOLT_REG_OTSD_TEMP && !is_read_only_register(reg_addr)) ||
+         reg_addr == THUNDERVOLT_REG_U10_DELAY || reg_addr == THUNDERVOLT_REG_OTSD_CTRL ||
+         reg_addr == THUNDERVOLT_REG_GOV_MARGIN ||
+         (reg_addr >= THUNDERVOLT_REG_AVP_GAIN_1V0 && reg_addr <= THUNDERVOLT_REG_FPWM_TH_3V3) ||
+         (reg_addr >= THUNDERVOLT_REG_BATT_LOW_TH && reg_addr <= THUNDERVOLT_REG_BATT_OFS_3V3) ||
+         reg_addr == THUNDERVOLT_REG_PROFILE_SELECT;
+}
+
+// Check if the specified register is part of a voltage profile
+static inline bool is_profile_register(uint8_t reg_addr)
+{
+  return reg_addr == THUNDERVOLT_REG_CONFIG ||
+         (reg_addr >= THUNDERVOLT_REG_VPERS_1V0_L && reg_addr <= THUNDERVOLT_REG_OTSD_TEMP);
+}
+
+// Get the EEPROM address of a voltage profile slot
+static inline uint8_t *get_profile_addr(uint8_t slot)
+{
+  return (uint8_t *)(EEPROM_PROFILES_ADDR + slot * THUNDERVOLT_PROFILE_SIZE);
+}
+
+// Check if a voltage profile slot holds a profile
+static bool is_valid_profile(uint8_t slot)
+{
+  if (slot >= THUNDERVOLT_NUM_PROFILES)
+    return false;
+
+  return !(eeprom_read_byte(get_profile_addr(slot) + THUNDERVOLT_PROFILE_FLAGS) & ~THUNDERVOLT_PROFILE_CONFIG);
 }
 
 // Get the value of a 16-bit register
@@ -90,15 +216,25 @@ static inline uint16_t get_word_register(uint8_t addr)
   return registers[addr] | (registers[addr + 1] << 8);
 }
 
+// Mark a register as waiting to be committed to the EEPROM
+static inline void mark_dirty(uint8_t reg_addr)
+{
+  dirty_registers[reg_addr / 8] |= 1 << (reg_addr % 8);
+}
+
 // Populate the registers with persistent values from the EEPROM
 static void load_persisted_registers()
 {
   for (uint8_t i = 0; i < THUNDERVOLT_NUM_REGISTERS; i++) {
-    if (is_read_only_register(i))
+    if (!is_persisted_register(i))
       continue;
 
     registers[i] = eeprom_read_byte((uint8_t *)i);
   }
+
+  // The calibration belongs to the board rather than the user's settings, so it isn't reset by CLEAR
+  if (registers[THUNDERVOLT_REG_CAL_CTRL] == 0xFF)
+    registers[THUNDERVOLT_REG_CAL_CTRL] = 0;
 }
 
 // Initialize the registers to their "reset" state
@@ -111,6 +247,10 @@ static void reset_registers()
   registers[THUNDERVOLT_REG_HWREV] = THUNDERVOLT_HWREV;
   registers[THUNDERVOLT_REG_SWREV] = SOFTWARE_REV;
 
+  // Initialize the telemetry settings
+  registers[THUNDERVOLT_REG_TELEM_PERIOD]  = THUNDERVOLT_DEFAULT_TELEM_PERIOD;
+  registers[THUNDERVOLT_REG_TELEM_SAMPLES] = THUNDERVOLT_DEFAULT_TELEM_SAMPLES;
+
   // Populate the registers with persistent values from EEPROM
   load_persisted_registers();
 }
@@ -118,6 +258,47 @@ static void reset_registers()
 // Handle register reads from an I2C controller when in I2C target mode
 static int handle_register_read(uint8_t reg_addr, uint8_t *value)
 {
+  // Handle reads from the register window
+  if (reg_addr >= THUNDERVOLT_REG_WINDOW_BASE) {
+    switch (registers[THUNDERVOLT_REG_WINDOW]) {
+      case THUNDERVOLT_WINDOW_HISTORY:
+        *value = telemetry_read(reg_addr - THUNDERVOLT_REG_WINDOW_BASE);
+        return 0;
+      case THUNDERVOLT_WINDOW_BOOT_TRACE:
+        *value = boot_trace_read(reg_addr - THUNDERVOLT_REG_WINDOW_BASE);
+        return 0;
+      case THUNDERVOLT_WINDOW_MODE_STATS:
+        *value = rail_mode_read_stats(reg_addr - THUNDERVOLT_REG_WINDOW_BASE);
+        return 0;
+      case THUNDERVOLT_WINDOW_FAULTS:
+        *value = fault_log_read(reg_addr - THUNDERVOLT_REG_WINDOW_BASE);
+        return 0;
+      case THUNDERVOLT_WINDOW_FAULTS_SAVED:
+        *value = fault_log_read_saved(reg_addr - THUNDERVOLT_REG_WINDOW_BASE);
+        return 0;
+      case THUNDERVOLT_WINDOW_COUNTERS:
+        *value = counters_read(reg_addr - THUNDERVOLT_REG_WINDOW_BASE);
+        return 0;
+      case THUNDERVOLT_WINDOW_PROFILES:
+        // The EEPROM is memory-mapped, so reading it is quick enough for the interrupt handler
+        if (reg_addr - THUNDERVOLT_REG_WINDOW_BASE >= THUNDERVOLT_NUM_PROFILES * THUNDERVOLT_PROFILE_SIZE) {
+          *value = 0x00;
+          return -1;
+        }
+        *value = eeprom_read_byte((uint8_t *)(EEPROM_PROFILES_ADDR + reg_addr - THUNDERVOLT_REG_WINDOW_BASE));
+        return 0;
+      default:
+        *value = 0x00;
+        return -1;
+    }
+  }
+
+  // Handle reads from the live registers
+  if (reg_addr == THUNDERVOLT_REG_PEC_ERRORS) {
+    *value = i2c_target_get_pec_errors();
+    return 0;
+  }
+
   // Return 0x00 for out-of-bounds register reads
   if (reg_addr >= THUNDERVOLT_NUM_REGISTERS) {
     *value = 0x00;
@@ -130,43 +311,497 @@ static int handle_register_read(uint8_t reg_addr, uint8_t *value)
   return 0;
 }
 
+// Apply the LED bit of the CONFIG register
+static void apply_led_config(uint8_t config)
+{
+  if (config & THUNDERVOLT_LED) {
+    led_effect_breathe(LED_BREATHE_PERIOD);
+  } else {
+    led_off();
+  }
+}
+
+// Apply the regulator mode policy from the MODE_CTRL register
+static void apply_mode_ctrl(uint8_t ctrl)
+{
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++)
+    rail_mode_set_policy(i, (ctrl >> THUNDERVOLT_MODE_SHIFT(i)) & THUNDERVOLT_MODE_MASK);
+}
+
+// Recompute the STATUS fault bit from the HEALTH registers
+static void update_fault_status()
+{
+  uint8_t faults = 0;
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++)
+    faults |= registers[THUNDERVOLT_REG_HEALTH_1V0 + i];
+
+  if (faults) {
+    registers[THUNDERVOLT_REG_STATUS] |= THUNDERVOLT_REGULATOR_FAULT;
+  } else {
+    registers[THUNDERVOLT_REG_STATUS] &= ~THUNDERVOLT_REGULATOR_FAULT;
+  }
+}
+
 // Handle register writes from an I2C controller when in I2C target mode
 static int handle_register_write(uint8_t reg_addr, uint8_t value)
 {
+  // Log the write to the UART stream as received, including any that are rejected
+  stream_log_write(reg_addr, value);
+
   // Ignore writes to read-only registers and out-of-bounds registers
   if (is_read_only_register(reg_addr) || reg_addr >= THUNDERVOLT_NUM_REGISTERS)
     return -1;
 
   // Handle CONFIG register writes
   if (reg_addr == THUNDERVOLT_REG_CONFIG) {
-    // Handle the CLEAR bit
+    // Handle the CLEAR bit, rewriting the EEPROM takes a while so it is done from the main loop
     if (value & THUNDERVOLT_CLEAR) {
-      // Clear persisted registers
-      reset_eeprom();
-      load_persisted_registers();
-
-      // We just cleared CONFIG, so load the updated value
-      value = registers[THUNDERVOLT_REG_CONFIG];
+      sched_post(clear_task);
+      return 0;
     }
 
-    // Handle the LED bit
-    if (value & THUNDERVOLT_LED) {
-      led_effect_breathe(LED_BREATHE_PERIOD);
-    } else {
-      led_off();
-    }
+    apply_led_config(value);
+  }
+
+  // Handle telemetry and bus register writes
+  switch (reg_addr) {
+    case THUNDERVOLT_REG_BUS_CTRL:
+      i2c_target_set_pec(value & THUNDERVOLT_BUS_PEC);
+      break;
+    case THUNDERVOLT_REG_TELEM_PERIOD:
+      sched_post(settings_task);
+      break;
+    case THUNDERVOLT_REG_OTSD_CTRL:
+      sched_post(otsd_task);
+      break;
+    case THUNDERVOLT_REG_TELEM_SAMPLES:
+      telemetry_set_samples_per_record(value);
+      break;
+    case THUNDERVOLT_REG_AVP_GAIN_1V0:
+    case THUNDERVOLT_REG_AVP_GAIN_1V15:
+    case THUNDERVOLT_REG_AVP_GAIN_1V8:
+    case THUNDERVOLT_REG_AVP_GAIN_3V3:
+      rails_set_avp_gain(reg_addr - THUNDERVOLT_REG_AVP_GAIN_1V0, value);
+      break;
+    case THUNDERVOLT_REG_MODE_CTRL:
+      apply_mode_ctrl(value);
+      break;
+    case THUNDERVOLT_REG_FPWM_TH_1V0:
+    case THUNDERVOLT_REG_FPWM_TH_1V15:
+    case THUNDERVOLT_REG_FPWM_TH_1V8:
+    case THUNDERVOLT_REG_FPWM_TH_3V3:
+      rail_mode_set_threshold(reg_addr - THUNDERVOLT_REG_FPWM_TH_1V0, value * 20);
+      break;
+    case THUNDERVOLT_REG_BATT_H:
+      battery_set_voltage(registers[THUNDERVOLT_REG_BATT_L] | (value << 8));
+      break;
+    case THUNDERVOLT_REG_CAL_CTRL:
+      // Only the firmware can mark the calibration as valid
+      value = (value & THUNDERVOLT_CAL_REQUEST) | (registers[THUNDERVOLT_REG_CAL_CTRL] & THUNDERVOLT_CAL_VALID);
+      break;
+    case THUNDERVOLT_REG_PROFILE_SELECT:
+      // Switching ramps the rails over I2C, so it is done from the main loop
+      // Safe mode has to stay at stock, so profiles can't be selected
+      if ((value & ~(THUNDERVOLT_PROFILE_SLOT | THUNDERVOLT_PROFILE_BOOT)) ||
+          !is_valid_profile(value & THUNDERVOLT_PROFILE_SLOT) ||
+          (registers[THUNDERVOLT_REG_STATUS] & THUNDERVOLT_SAFEMODE))
+        return -1;
+      pending_profile_select = value;
+      sched_post(profile_task);
+      return 0;
+    case THUNDERVOLT_REG_PROFILE_SAVE:
+      // Saving rewrites the slot in the EEPROM, so it is done from the main loop, the register always reads as 0
+      if (value >= THUNDERVOLT_NUM_PROFILES)
+        return -1;
+      pending_profile_save = value;
+      sched_post(profile_task);
+      return 0;
+    case THUNDERVOLT_REG_BOOTLOADER:
+      // Handing over stops the I2C target, so it is done from the main loop once this write has finished
+      if (value != THUNDERVOLT_BOOT_ENTER)
+        return -1;
+      sched_post(boot_task);
+      return 0;
+    case THUNDERVOLT_REG_HIST_POP:
+      // Consume the records, the register itself always reads as 0
+      telemetry_pop(value);
+      registers[THUNDERVOLT_REG_HIST_COUNT] = telemetry_count();
+      return 0;
+    case THUNDERVOLT_REG_COUNTERS_CLEAR:
+      // Any value clears the counters, the register itself always reads as 0
+      counters_clear();
+      return 0;
+    case THUNDERVOLT_REG_HEALTH_1V0:
+    case THUNDERVOLT_REG_HEALTH_1V15:
+    case THUNDERVOLT_REG_HEALTH_1V8:
+    case THUNDERVOLT_REG_HEALTH_3V3:
+      // Writing 1s clears the latched faults
+      registers[reg_addr] &= ~value;
+      update_fault_status();
+      return 0;
+  }
+
+  // Settings changed by hand no longer match the active profile
+  if (is_profile_register(reg_addr) && registers[THUNDERVOLT_REG_PROFILE_SELECT] != THUNDERVOLT_PROFILE_NONE &&
+      (reg_addr != THUNDERVOLT_REG_CONFIG || ((registers[reg_addr] ^ value) & THUNDERVOLT_PROFILE_CONFIG))) {
+    registers[THUNDERVOLT_REG_PROFILE_SELECT] = THUNDERVOLT_PROFILE_NONE;
+    mark_dirty(THUNDERVOLT_REG_PROFILE_SELECT);
   }
 
   // Update the register
   registers[reg_addr] = value;
 
-  // Persist the value to the EEPROM
-  // for some reason eeprom_update_byte is buggy, so use eeprom_update_byte instead
-  eeprom_update_byte((uint8_t *)reg_addr, value);
+  // Persist the value to the EEPROM from the main loop, EEPROM writes take ~3.3ms per byte
+  if (is_persisted_register(reg_addr)) {
+    mark_dirty(reg_addr);
+    sched_post(commit_task);
+  }
 
   return 0;
 }
 
+// Commit dirty registers to the EEPROM
+static void commit_registers()
+{
+  for (uint8_t i = 0; i < THUNDERVOLT_NUM_REGISTERS; i++) {
+    bool dirty;
+    uint8_t value;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      dirty = dirty_registers[i / 8] & (1 << (i % 8));
+      dirty_registers[i / 8] &= ~(1 << (i % 8));
+      value = registers[i];
+    }
+
+    // for some reason eeprom_update_byte is buggy, so use eeprom_update_byte instead
+    if (dirty)
+      storage_update_byte((uint8_t *)i, value);
+  }
+}
+
+// Reset the persisted registers to their defaults
+static void clear_persisted_registers()
+{
+  // Drop any pending commits, the EEPROM is about to be overwritten
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { memset((uint8_t *)dirty_registers, 0, sizeof(dirty_registers)); }
+
+  reset_eeprom();
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { load_persisted_registers(); }
+
+  apply_led_config(registers[THUNDERVOLT_REG_CONFIG]);
+}
+
+// Apply register settings which can't be changed from an interrupt handler
+static void apply_settings()
+{
+  sched_set_period(telemetry_task, registers[THUNDERVOLT_REG_TELEM_PERIOD] * 10);
+}
+
+// Configure the temperature sensor from the OTSD_CTRL register, and publish the resulting worst-case latency
+static void apply_otsd_config()
+{
+  uint8_t ctrl     = registers[THUNDERVOLT_REG_OTSD_CTRL];
+  uint16_t latency = thundervolt_get_otsd_worst_case_latency(ctrl);
+
+  thundervolt_configure_otsd(ctrl);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    registers[THUNDERVOLT_REG_OTSD_LATENCY_L] = latency & 0xFF;
+    registers[THUNDERVOLT_REG_OTSD_LATENCY_H] = latency >> 8;
+  }
+}
+
+// Save the active voltages, OTSD limit and profile CONFIG bits to a voltage profile slot
+static void save_profile(uint8_t slot)
+{
+  uint8_t *addr = get_profile_addr(slot);
+
+  // Invalidate the slot first, so an interrupted save leaves it empty rather than half written
+  storage_update_byte(addr + THUNDERVOLT_PROFILE_FLAGS, 0xFF);
+
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    uint16_t voltage;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { voltage = get_word_register(THUNDERVOLT_REG_VPERS_1V0_L + i * 2); }
+    storage_update_word((uint16_t *)(addr + THUNDERVOLT_PROFILE_VOLTAGE + i * 2), voltage);
+  }
+
+  storage_update_byte(addr + THUNDERVOLT_PROFILE_OTSD_TEMP, registers[THUNDERVOLT_REG_OTSD_TEMP]);
+  storage_update_byte(addr + THUNDERVOLT_PROFILE_FLAGS, registers[THUNDERVOLT_REG_CONFIG] & THUNDERVOLT_PROFILE_CONFIG);
+}
+
+// Switch to a voltage profile, ramping the rails to its voltages, and optionally persist it as the boot default
+static void select_profile(uint8_t slot, bool boot_default)
+{
+  uint8_t *addr = get_profile_addr(slot);
+
+  // Check the slot again, it may have been cleared since the request
+  if (!is_valid_profile(slot))
+    return;
+
+  uint16_t voltages[4];
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    uint16_t min, max;
+    voltages[i] = eeprom_read_word((uint16_t *)(addr + THUNDERVOLT_PROFILE_VOLTAGE + i * 2));
+    if (thundervolt_get_voltage_range(i, &min, &max) != 0 || voltages[i] < min || voltages[i] > max)
+      return;
+  }
+
+  int8_t otsd_temp = eeprom_read_byte(addr + THUNDERVOLT_PROFILE_OTSD_TEMP);
+  uint8_t flags    = eeprom_read_byte(addr + THUNDERVOLT_PROFILE_FLAGS);
+
+  // Update the registers to the profile, OTSD_TEMP and CONFIG always show the settings in effect
+  // VPERS only holds the boot voltages, so it is left alone unless the profile becomes the boot default, otherwise
+  // persisting a single rail's VPERS later would leave the other rails' VPERS reading back values never persisted
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (boot_default) {
+      for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+        registers[THUNDERVOLT_REG_VPERS_1V0_L + i * 2] = voltages[i] & 0xFF;
+        registers[THUNDERVOLT_REG_VPERS_1V0_H + i * 2] = voltages[i] >> 8;
+      }
+    }
+
+    registers[THUNDERVOLT_REG_OTSD_TEMP]      = otsd_temp;
+    registers[THUNDERVOLT_REG_CONFIG]         = (registers[THUNDERVOLT_REG_CONFIG] & ~THUNDERVOLT_PROFILE_CONFIG) | flags;
+    registers[THUNDERVOLT_REG_PROFILE_SELECT] = slot;
+  }
+
+  // Ramp the rails through the rail control loop, rather than jumping straight to the new voltages
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++)
+    rails_set_voltage(i, voltages[i]);
+
+  thundervolt_set_otsd_limit(otsd_temp);
+
+  // Persist the profile's settings, so the board boots into it
+  if (boot_default) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      for (uint8_t i = THUNDERVOLT_REG_VPERS_1V0_L; i <= THUNDERVOLT_REG_OTSD_TEMP; i++)
+        mark_dirty(i);
+
+      mark_dirty(THUNDERVOLT_REG_CONFIG);
+      mark_dirty(THUNDERVOLT_REG_PROFILE_SELECT);
+    }
+
+    commit_registers();
+  }
+}
+
+// Handle the voltage profile requests from the I2C target
+static void handle_profile_requests()
+{
+  uint8_t select, save;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    select                 = pending_profile_select;
+    save                   = pending_profile_save;
+    pending_profile_select = THUNDERVOLT_PROFILE_NONE;
+    pending_profile_save   = THUNDERVOLT_PROFILE_NONE;
+  }
+
+  if (save != THUNDERVOLT_PROFILE_NONE)
+    save_profile(save);
+
+  if (select != THUNDERVOLT_PROFILE_NONE)
+    select_profile(select & THUNDERVOLT_PROFILE_SLOT, select & THUNDERVOLT_PROFILE_BOOT);
+}
+
+// Calibrate the rails against the power monitors, and persist the result
+// Must only be called while Hollywood is held in reset, the sweep takes the rails below their persisted voltages
+static void calibrate_rails()
+{
+  uint8_t ctrl = registers[THUNDERVOLT_REG_CAL_CTRL] & ~THUNDERVOLT_CAL_REQUEST;
+
+  if (thundervolt_has_power_monitoring()) {
+    ctrl |= THUNDERVOLT_CAL_VALID;
+    for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+      struct thundervolt_calibration cal;
+      if (calibration_run(i, &cal) != 0) {
+        ctrl &= ~THUNDERVOLT_CAL_VALID;
+        break;
+      }
+
+      registers[THUNDERVOLT_REG_CAL_OFFSET_1V0 + i] = cal.offset;
+      registers[THUNDERVOLT_REG_CAL_GAIN_1V0 + i]   = cal.gain;
+      mark_dirty(THUNDERVOLT_REG_CAL_OFFSET_1V0 + i);
+      mark_dirty(THUNDERVOLT_REG_CAL_GAIN_1V0 + i);
+    }
+  }
+
+  // A calibration is only valid for all the rails together, so drop the ones that did pass
+  if (!(ctrl & THUNDERVOLT_CAL_VALID)) {
+    static const struct thundervolt_calibration uncalibrated = {0, 0};
+    for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++)
+      thundervolt_set_calibration(i, &uncalibrated);
+  }
+
+  // Clear the request even if calibration failed, so a bad board doesn't calibrate on every boot
+  registers[THUNDERVOLT_REG_CAL_CTRL] = ctrl;
+  mark_dirty(THUNDERVOLT_REG_CAL_CTRL);
+  commit_registers();
+}
+
+// Apply the persisted calibration to the rails
+static void apply_calibration()
+{
+  if (!(registers[THUNDERVOLT_REG_CAL_CTRL] & THUNDERVOLT_CAL_VALID))
+    return;
+
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    struct thundervolt_calibration cal = {
+        .offset = registers[THUNDERVOLT_REG_CAL_OFFSET_1V0 + i],
+        .gain   = registers[THUNDERVOLT_REG_CAL_GAIN_1V0 + i],
+    };
+    thundervolt_set_calibration(i, &cal);
+  }
+}
+
+// Run the thermal governor, throttling the rails towards stock as the board approaches the OTSD temperature
+static void run_governor()
+{
+  uint8_t throttle = 0;
+  if (registers[THUNDERVOLT_REG_CONFIG] & THUNDERVOLT_GOVERNOR) {
+    int16_t soft_limit = (int8_t)registers[THUNDERVOLT_REG_OTSD_TEMP] - registers[THUNDERVOLT_REG_GOV_MARGIN];
+    throttle           = governor_update(soft_limit < INT8_MIN ? INT8_MIN : soft_limit);
+  } else {
+    governor_reset();
+  }
+
+  rails_set_throttle(throttle);
+  registers[THUNDERVOLT_REG_THROTTLE] = throttle;
+}
+
+// Switch the regulator modes for the current load
+static void update_rail_modes()
+{
+  registers[THUNDERVOLT_REG_MODE_STATUS] = rail_mode_update();
+}
+
+// Update the battery state, and apply the low battery offsets to the rails
+// The offsets are never applied in safe mode, which has to stay at stock
+static void update_battery()
+{
+  bool low       = battery_update(registers[THUNDERVOLT_REG_BATT_LOW_TH] * 20);
+  bool safe_mode = registers[THUNDERVOLT_REG_STATUS] & THUNDERVOLT_SAFEMODE;
+
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++)
+    rails_set_offset(i, low && !safe_mode ? (int8_t)registers[THUNDERVOLT_REG_BATT_OFS_1V0 + i] : 0);
+
+  uint16_t supply = battery_get_supply();
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    registers[THUNDERVOLT_REG_SUPPLY_L] = supply & 0xFF;
+    registers[THUNDERVOLT_REG_SUPPLY_H] = supply >> 8;
+    registers[THUNDERVOLT_REG_BATT_SOC] = battery_get_soc();
+    if (low) {
+      registers[THUNDERVOLT_REG_STATUS] |= THUNDERVOLT_BATT_LOW;
+    } else {
+      registers[THUNDERVOLT_REG_STATUS] &= ~THUNDERVOLT_BATT_LOW;
+    }
+  }
+}
+
+// Poll the regulators' STATUS registers, latching any faults into the HEALTH registers
+// A rail's first fault since it was last cleared is logged, and saved to the EEPROM
+static void check_regulators()
+{
+  // The regulators don't respond while EN is low, that isn't a fault
+  if (!gpio_read(EN))
+    return;
+
+  // Every rail that was read has had its STATUS cleared, so its result must be latched even if another rail failed
+  uint8_t health[THUNDERVOLT_RAIL_3V3 + 1], addrs[THUNDERVOLT_RAIL_3V3 + 1], status[THUNDERVOLT_RAIL_3V3 + 1];
+  uint8_t read = health_poll(health, addrs, status);
+
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    if (!(read & (1 << i)) || !health[i])
+      continue;
+
+    bool first;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      first = !registers[THUNDERVOLT_REG_HEALTH_1V0 + i];
+      registers[THUNDERVOLT_REG_HEALTH_1V0 + i] |= health[i];
+      update_fault_status();
+    }
+
+    if (first) {
+      fault_log(THUNDERVOLT_FAULT_REGULATOR, addrs[i], status[i]);
+      fault_log_save(THUNDERVOLT_FAULT_REGULATOR);
+    }
+  }
+}
+
+// Adjust the rails for throttling, low battery and load-line compensation
+// The governor, the battery, the regulator modes and health are updated at the governor's slower rate
+static void regulate_rails()
+{
+  static uint8_t governor_countdown = 0;
+  if (governor_countdown-- == 0) {
+    governor_countdown = GOVERNOR_PERIOD_MS / RAILS_PERIOD_MS - 1;
+    run_governor();
+    update_battery();
+    update_rail_modes();
+    check_regulators();
+  }
+
+  rails_update();
+}
+
+// Hand over to the bootloader for a firmware update, the rails and U10 are left as they are so the console keeps running
+static void enter_bootloader()
+{
+  // Don't lose any settings still waiting to be persisted
+  commit_registers();
+
+  led_off();
+  i2c_target_stop();
+
+  cli();
+  bootloader_enter();
+}
+
+// Log the over-temperature shutdown and show it on the LED, the regulators are already off
+static void handle_alert()
+{
+  fault_log(THUNDERVOLT_FAULT_OTSD, THUNDERVOLT_ADDR_TMP, registers[THUNDERVOLT_REG_OTSD_TEMP]);
+  fault_log_save(THUNDERVOLT_FAULT_OTSD);
+  stream_otsd(registers[THUNDERVOLT_REG_OTSD_TEMP]);
+  led_effect_blink_pattern(LED_SOS_PATTERN, sizeof(LED_SOS_PATTERN) / sizeof(LED_SOS_PATTERN[0]));
+}
+
+// Sample telemetry, and publish the updated history count
+static void sample_telemetry()
+{
+  telemetry_sample();
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { registers[THUNDERVOLT_REG_HIST_COUNT] = telemetry_count(); }
+}
+
+// Release Hollywood from reset, once the U10 delay has elapsed
+static void release_u10()
+{
+  // Check pinstrapping to see if board has U10 FET
+  bool u10_direct_mode = gpio_read(DIRECT);
+
+  // Deassert U10 (make it high-impedance) so Hollywood can boot
+  if (u10_direct_mode) {
+    gpio_input(U10); // faux open-drain (direct mode)
+  } else {
+    gpio_set_low(U10); // Turn off U10 NFET
+  }
+
+  boot_trace(THUNDERVOLT_BOOT_U10_RELEASED);
+
+  // Update the device state
+  device_state = STATE_POWERED;
+
+  // Enable the breathing LED effect if the LED is enabled
+  if (registers[THUNDERVOLT_REG_CONFIG] & THUNDERVOLT_LED) {
+    led_effect_breathe(LED_BREATHE_PERIOD);
+  }
+}
+
 // Initialize the GPIO pins
 static void gpio_init()
 {
@@ -175,8 +810,9 @@ static void gpio_init()
   gpio_config(SAFEMODE, PORT_PULLUPEN_bm);
 
   // Temperature sensor alert pin, active low
+  // Falling edges can't wake the CPU from standby on this pin, so sense both edges and check the level
   gpio_input(ALERT);
-  gpio_config(ALERT, PORT_PULLUPEN_bm | PORT_ISC_FALLING_gc);
+  gpio_config(ALERT, PORT_PULLUPEN_bm | PORT_ISC_BOTHEDGES_gc);
 
   // Regulator enable pin, active high
   gpio_output(EN);
@@ -204,69 +840,113 @@ static void gpio_init()
   gpio_set_low(LED);
 }
 
-// Initialize the RTC for periodic interrupts
+// Initialize the RTC for periodic interrupts, and start the counter for boot tracing
 void rtc_init()
 {
   RTC.CLKSEL     = RTC_CLKSEL_INT32K_gc;
   RTC.PITINTCTRL = RTC_PI_bm;
   RTC.PITCTRLA   = RTC_PERIOD_CYC32_gc | RTC_PITEN_bm;
+
+  while (RTC.STATUS & RTC_CTRLBUSY_bm);
+  RTC.CTRLA = RTC_PRESCALER_DIV1_gc | RTC_RTCEN_bm;
+}
+
+// Wait for the regulators to finish starting up after EN goes high
+// Rather than waiting a fixed worst-case time, poll until every device responds on I2C
+static bool wait_for_power_good()
+{
+  _delay_us(REGULATOR_STARTUP_US);
+
+  uint32_t start = sched_millis();
+  while (!thundervolt_i2c_scan()) {
+    if (sched_millis() - start >= POWER_GOOD_TIMEOUT_MS)
+      return false;
+  }
+
+  return true;
 }
 
 // Handle periodic RTC interrupts (every ~1ms)
-ISR(RTC_PIT_vect)
+COUNTERS_TIMED_ISR(RTC_PIT_vect, rtc)
 {
+  PROFILE_ENTER(PROFILE_PIN_RTC);
+
   // Clear the interrupt flag
   RTC.PITINTFLAGS = RTC_PI_bm;
 
-  // Update the "milliseconds since boot" counter
-  millis++;
+  // Update the "milliseconds since boot" counter, the LED effect and the supply measurement
+  power_wake();
+  uint32_t now = sched_tick();
+  led_effect_update(now);
+  battery_tick(now);
 
-  // Update the LED effect
-  led_effect_update(millis);
+  counters_isr_done(rtc_start, PROFILE_BUDGET_RTC_CYCLES);
+  PROFILE_EXIT(PROFILE_PIN_RTC);
 }
 
 // Handle gpio interrupts on PORTA
-ISR(PORTA_PORT_vect)
+COUNTERS_TIMED_ISR(PORTA_PORT_vect, porta)
 {
+  PROFILE_ENTER(PROFILE_PIN_ALERT);
+
   // Handle the temperature sensor alert
-  if (gpio_read_intflag(ALERT)) {
+  if (gpio_read_intflag(ALERT) && !gpio_read(ALERT)) {
     // Shutdown the regulators if over-temp shutdown is enabled
     if (device_state == STATE_POWERED && registers[THUNDERVOLT_REG_CONFIG] & THUNDERVOLT_OTSD) {
-      // Disable the regulators
+      // Disable the regulators straight away, before even restoring the clock, and leave the rest to the main loop
+      // Nothing else is done here, this handler delays any TWI interrupt it preempts, see main
       gpio_set_low(EN);
-
-      // Enable the SOS LED effect
-      led_effect_blink_pattern(LED_SOS_PATTERN, sizeof(LED_SOS_PATTERN) / sizeof(LED_SOS_PATTERN[0]));
+      counters_isr_deadline(porta_start, PROFILE_BUDGET_ALERT_EN_CYCLES);
+      power_wake();
+      sched_post(alert_task);
     }
   }
 
   // Clear the interrupt flags
   PORTA.INTFLAGS = 0xFF;
+
+  counters_isr_done(porta_start, PROFILE_BUDGET_ALERT_CYCLES);
+  PROFILE_EXIT(PROFILE_PIN_ALERT);
 }
 
 int main(void)
 {
-  // Enable prescaler, and set prescaler division to 4 to run at 5MHz
-  CPU_CCP           = CCP_IOREG_gc;
-  CLKCTRL.MCLKCTRLB = CLKCTRL_PDIV_4X_gc | CLKCTRL_PEN_bm;
+  // Set the main clock to run at 5MHz
+  power_init();
 
-  // Set I2C target interrupts as the highest priority
-  CPUINT.LVL1VEC = TWI0_TWIS_vect_num;
+  // Set the ALERT interrupt as the highest priority, so over-temperature shutdown is never held up by
+  // I2C traffic. A TWI interrupt it preempts answers late by the length of the ALERT handler. Controllers
+  // that honour clock stretching just see a longer stretch, but the Wii drives SCL push-pull, so a byte in
+  // flight can be lost and the transfer fails (PEC or a retry catches it). The ALERT handler is kept to
+  // dropping EN and posting the rest to the main loop, and it only fires once per shutdown.
+  CPUINT.LVL1VEC = PORTA_PORT_vect_num;
 
   // Enable interrupts (for I2C target comms and overtemp alerting)
   sei();
 
   // Initalize the GPIOs
   gpio_init();
+  profile_init();
+
+  // Start timing the interrupt handlers
+  counters_init();
 
-  // Initialize the RTC
+  // Initialize the RTC, and start tracing the boot sequence
   rtc_init();
+  boot_trace(THUNDERVOLT_BOOT_RESET);
+
+  // Record the cause of the reset, and clear the flags so the next reset is reported on its own
+  fault_log(THUNDERVOLT_FAULT_RESET, 0, RSTCTRL.RSTFR);
+  RSTCTRL.RSTFR = RSTCTRL.RSTFR;
 
   // Initialize the LED
   led_init();
 
-  // Initialize as an I2C controller
-  i2c_configure(I2C_MODE_STANDARD);
+  // Start measuring the supply voltage
+  battery_init();
+
+  // Initialize as an I2C controller, in fast mode to keep the boot sequence short
+  i2c_configure(I2C_MODE_FAST);
 
   // uncomment for forced EEPROM reset (debug)
   // reset_eeprom();
@@ -283,23 +963,47 @@ int main(void)
     registers[THUNDERVOLT_REG_STATUS] |= THUNDERVOLT_SAFEMODE;
   }
 
-  // Registers cannot be read/written via I2C on the TPS62868x until startup is finished,
-  // so we must enable the regulators and wait a short time (at least ~1100us) first
+  boot_trace(THUNDERVOLT_BOOT_REGS_LOADED);
+
+  // Enable the regulators
   gpio_set_high(EN);
-  _delay_ms(3);
+  boot_trace(THUNDERVOLT_BOOT_EN_HIGH);
 
   // Make sure we can talk to all four regulators and the TMP. If not, shut down + enable SOS until power is cycled
-  if (!thundervolt_i2c_scan()) {
+  if (!wait_for_power_good()) {
 
     gpio_set_low(EN);
+    boot_trace(THUNDERVOLT_BOOT_SCAN_FAILED);
+
+    // Save which device didn't respond, so it can still be read back after the power is cycled
+    fault_log(THUNDERVOLT_FAULT_SCAN_FAILED, thundervolt_i2c_find_missing(), registers[THUNDERVOLT_REG_STATUS]);
+    fault_log_save(THUNDERVOLT_FAULT_SCAN_FAILED);
 
     // Enable the SOS LED effect
     led_effect_blink_pattern(LED_SOS_PATTERN, sizeof(LED_SOS_PATTERN) / sizeof(LED_SOS_PATTERN[0]));
 
     asm volatile("nop"); // required due to some sinister bug somewhere...
-    while (1);
+    while (1) { power_sleep(false); }
+  }
+
+  // The U10 delay counts from power-good, so the rails are programmed while U10 is held
+  uint32_t power_good_time = sched_millis();
+  boot_trace(THUNDERVOLT_BOOT_POWER_GOOD);
+
+  // Reading the regulators' STATUS registers clears them, drop anything flagged while they were starting up
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    uint8_t health, addr, status;
+    thundervolt_get_regulator_health(i, &health, &addr, &status);
   }
 
+  // Calibrate the rails if requested, while U10 still holds Hollywood in reset
+  if (registers[THUNDERVOLT_REG_CAL_CTRL] & THUNDERVOLT_CAL_REQUEST) {
+    calibrate_rails();
+    boot_trace(THUNDERVOLT_BOOT_CALIBRATED);
+  }
+
+  apply_calibration();
+
   // Determine the startup voltages
   uint16_t voltages[4];
   if (in_safe_mode) {
@@ -319,34 +1023,58 @@ int main(void)
   // Set the voltage on each regulator
   for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) { thundervolt_set_voltage(i, voltages[i]); }
 
-  // Set the over-temperature limit based on the persisted value
-  thundervolt_set_otsd_limit(registers[THUNDERVOLT_REG_OTSD_TEMP]);
-
-  // Wait 200ms to emulate the U10 delay
-  _delay_ms(200);
+  // Set up load-line compensation, it takes over from the voltages set above once the rails are regulated
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++)
+    rails_set_avp_gain(i, registers[THUNDERVOLT_REG_AVP_GAIN_1V0 + i]);
 
-  // Check pinstrapping to see if board has U10 FET
-  bool u10_direct_mode = gpio_read(DIRECT);
+  // Set up the regulator mode policies, they are applied on the first rail update
+  apply_mode_ctrl(registers[THUNDERVOLT_REG_MODE_CTRL]);
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++)
+    rail_mode_set_threshold(i, registers[THUNDERVOLT_REG_FPWM_TH_1V0 + i] * 20);
 
-  // Deassert U10 (make it high-impedance) so Hollywood can boot
-  if (u10_direct_mode) {
-    gpio_input(U10); // faux open-drain (direct mode)
-  } else {
-    gpio_set_low(U10); // Turn off U10 NFET
-  }
-
-  // Update the device state
-  device_state = STATE_POWERED;
-
-  // Enable the breathing LED effect if the LED is enabled
-  if (registers[THUNDERVOLT_REG_CONFIG] & THUNDERVOLT_LED) {
-    led_effect_breathe(LED_BREATHE_PERIOD);
-  }
+  // Set the over-temperature limit based on the persisted value
+  thundervolt_set_otsd_limit(registers[THUNDERVOLT_REG_OTSD_TEMP]);
+  apply_otsd_config();
+  boot_trace(THUNDERVOLT_BOOT_RAILS_SET);
+
+  // Release U10 once the rest of the U10 delay has elapsed, Hollywood is never released before the rails are programmed
+  uint32_t elapsed  = sched_millis() - power_good_time;
+  uint8_t u10_delay = registers[THUNDERVOLT_REG_U10_DELAY];
+  sched_after(elapsed < u10_delay ? u10_delay - elapsed : 0, release_u10);
+
+  // Register the background tasks, before the I2C target can post them
+  telemetry_task = sched_every(registers[THUNDERVOLT_REG_TELEM_PERIOD] * 10, sample_telemetry);
+  settings_task  = sched_register(apply_settings);
+  commit_task    = sched_register(commit_registers);
+  clear_task     = sched_register(clear_persisted_registers);
+  alert_task     = sched_register(handle_alert);
+  otsd_task      = sched_register(apply_otsd_config);
+  profile_task   = sched_register(handle_profile_requests);
+  boot_task      = sched_register(enter_bootloader);
+  sched_every(RAILS_PERIOD_MS, regulate_rails);
+
+#if defined(STREAM_UART)
+  // Start the UART telemetry stream on bench builds
+  uint8_t hw_rev;
+  thundervolt_get_hardware_revision(&hw_rev);
+  stream_init(hw_rev, SOFTWARE_REV);
+  sched_every(STREAM_PERIOD_MS, stream_sample);
+#endif
+
+  // Start the counters from here, the boot scan's polling would otherwise show up as controller errors
+  counters_clear();
 
   // Initialize as an I2C target device, and listen for commands
+  // Plain registers are read straight from the register space, only the window needs the read handler
+  i2c_target_set_image(registers, THUNDERVOLT_NUM_REGISTERS);
   i2c_target_init(THUNDERVOLT_I2C_ADDR, handle_register_read, handle_register_write);
+  boot_trace(THUNDERVOLT_BOOT_TARGET_READY);
 
-  // Main loop
+  // Main loop, run background tasks and sleep until the next interrupt
+  // Standby stops the LED PWM, so only use it while the LED is off
   asm volatile("nop"); // required due to some sinister bug somewhere...
-  while (1);
+  while (1) {
+    sched_run();
+    power_sleep(!led_is_active());
+  }
 }
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include <stdbool.h>
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+
+#include "power.h"
+
+// Main clock prescaler settings, from the 20MHz oscillator
+#define CLOCK_RUN   (CLKCTRL_PDIV_4X_gc | CLKCTRL_PEN_bm)  // 5MHz, used for all normal work
+#define CLOCK_SLEEP (CLKCTRL_PDIV_16X_gc | CLKCTRL_PEN_bm) // 1.25MHz, used while sleeping in idle mode
+#define CLOCK_BOOST (CLKCTRL_PDIV_2X_gc | CLKCTRL_PEN_bm)  // 10MHz, used during I2C transactions if enabled
+
+// TCA0 prescaler settings for each main clock setting, holding TCA0 at 1.25MHz
+#define TIMER_RUN   (TCA_SINGLE_CLKSEL_DIV4_gc | TCA_SINGLE_ENABLE_bm)
+#define TIMER_SLEEP (TCA_SINGLE_CLKSEL_DIV1_gc | TCA_SINGLE_ENABLE_bm)
+#define TIMER_BOOST (TCA_SINGLE_CLKSEL_DIV8_gc | TCA_SINGLE_ENABLE_bm)
+
+// Current main clock prescaler setting
+static volatile uint8_t clock_setting = CLOCK_RUN;
+
+// Busy sources, see POWER_BUSY_xxx
+static volatile uint8_t busy = 0;
+
+static inline void set_clock(uint8_t setting)
+{
+  if (clock_setting == setting)
+    return;
+
+  CPU_CCP           = CCP_IOREG_gc;
+  CLKCTRL.MCLKCTRLB = setting;
+  clock_setting     = setting;
+
+  // Rescale TCA0 straight after, so the stable clock only glitches for a few cycles
+  TCA0.SINGLE.CTRLA = setting == CLOCK_SLEEP ? TIMER_SLEEP : setting == CLOCK_BOOST ? TIMER_BOOST : TIMER_RUN;
+}
+
+void power_init()
+{
+  CPU_CCP           = CCP_IOREG_gc;
+  CLKCTRL.MCLKCTRLB = CLOCK_RUN;
+  clock_setting     = CLOCK_RUN;
+
+  // Run TCA0 as the stable clock, it is only used as a prescaler so it just counts freely
+  TCA0.SINGLE.CTRLA = TIMER_RUN;
+}
+
+void power_wake()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (clock_setting == CLOCK_SLEEP)
+      set_clock(CLOCK_RUN);
+  }
+}
+
+void power_set_busy(uint8_t source, bool is_busy)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (is_busy) {
+      busy |= source;
+    } else {
+      busy &= ~source;
+    }
+
+#if defined(POWER_BOOST_I2C_CLOCK)
+    // Run the CPU at 10MHz while we are addressed, to avoid stretching the clock.
+    // Only do this if the supply voltage supports 10MHz operation.
+    set_clock((busy & POWER_BUSY_I2C) ? CLOCK_BOOST : CLOCK_RUN);
+#else
+    set_clock(CLOCK_RUN);
+#endif
+  }
+}
+
+void power_sleep(bool standby)
+{
+  cli();
+
+  if (busy) {
+    // Keep the clock running at full speed until the work is done
+    set_sleep_mode(SLEEP_MODE_IDLE);
+  } else if (standby) {
+    set_sleep_mode(SLEEP_MODE_STANDBY);
+  } else {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    set_clock(CLOCK_SLEEP);
+  }
+
+  // The instruction after sei() always runs before any pending interrupt,
+  // so an interrupt can't slip in between here and going to sleep
+  sleep_enable();
+  sei();
+  sleep_cpu();
+  sleep_disable();
+
+  power_wake();
+}
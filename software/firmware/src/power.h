@@ -0,0 +1,64 @@
+/**
+ * Power management for AVR 0/1-series MCUs.
+ *
+ * Owns the main clock prescaler, and puts the CPU to sleep from the main loop
+ * whenever there is nothing to do. The main clock is lowered while sleeping in
+ * idle mode, so peripherals which keep running (TCB0 PWM, TWI) draw less
+ * current, and is restored by power_wake() before any real work is done.
+ *
+ * Peripherals whose timing has to hold through the clock changes, such as the
+ * TCB0 LED PWM, run from TCA0 (TCB_CLKSEL_CLKTCA_gc), which is rescaled along
+ * with the main clock to stay at POWER_STABLE_CLOCK.
+ *
+ * Work sources (such as an I2C transaction in progress) can mark themselves as
+ * busy with power_set_busy(), which keeps the clock at full speed and prevents
+ * the deeper sleep modes until they are done.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Busy sources
+#define POWER_BUSY_I2C  (1 << 0) // An I2C target transaction is in progress
+#define POWER_BUSY_UART (1 << 1) // The UART telemetry stream is transmitting
+
+// TCA0 clock, whatever the main clock, in Hz
+#define POWER_STABLE_CLOCK 1250000UL
+
+/**
+ * Set the main clock to the run speed (5MHz), and start TCA0 as the stable clock.
+ *
+ * Must be called at boot, before any code that depends on F_CPU.
+ */
+void power_init();
+
+/**
+ * Restore the main clock to the run speed, if it was lowered for sleep.
+ *
+ * Safe to call from both interrupt handlers and the main loop. Interrupt handlers
+ * which do more than a few instructions of work should call this first.
+ */
+void power_wake();
+
+/**
+ * Mark a work source as busy or idle.
+ *
+ * Safe to call from both interrupt handlers and the main loop.
+ *
+ * @param source The POWER_BUSY_xxx source
+ * @param busy   True if the source is busy
+ */
+void power_set_busy(uint8_t source, bool busy);
+
+/**
+ * Sleep until the next interrupt, then restore the run clock.
+ *
+ * Standby stops the peripheral clock, so it may only be used when no peripheral
+ * needs it (e.g. the LED PWM is off). Falls back to idle sleep at full speed if
+ * any source is busy.
+ *
+ * @param standby True to use standby sleep, false to use idle sleep
+ */
+void power_sleep(bool standby);
@@ -0,0 +1,76 @@
+/**
+ * ISR profiling markers for Thundervolt.
+ *
+ * When built with PROFILE_ISR defined (see env:thundervolt-hw1-profile), each
+ * interrupt handler drives a spare pin high for as long as it runs, so ISR
+ * duration, interrupt latency and ALERT to EN response can be measured with a
+ * logic analyzer on real hardware:
+ *
+ * - PC1: TWI target interrupt
+ * - PC2: RTC tick interrupt (scheduler tick and LED effects)
+ * - PC3: PORTA interrupt (ALERT handling), compare against the ALERT and EN nets
+ *
+ * The pins are unconnected on all board variants. Markers are single SBI/CBI
+ * instructions through the virtual port, so they add only a few cycles.
+ *
+ * Every build also checks each handler against its cycle budget below, timed
+ * with TCB1 from the interrupt request (see COUNTERS_TIMED_ISR), and counts the
+ * handlers that ran over in the ISR_OVERRUNS performance counter. A run on real
+ * hardware passes if the counter is still 0 afterwards, without a logic
+ * analyzer. tools/isr_cycles.c checks the same budgets against the worst case
+ * path through each handler in a built firmware.elf, without hardware.
+ *
+ * The budgets come from the bus: the Wii drives SCL push-pull and can't be
+ * clock stretched, so an address match has to be answered within the byte
+ * that follows it. The homebrew runs the bus at 100kHz, one byte is 90us. The
+ * worst case for the TWI ISR is waiting for an RTC tick that has just started,
+ * which is itself interrupted by ALERT, so the three budgets add up to 90us:
+ * - TWI target ISR: 22.5us, one byte at 400kHz, which is also the point where
+ *   a clock stretch is counted as long for other controllers
+ * - RTC tick ISR: 45us, it runs the scheduler tick, the LED effect and the
+ *   battery sample every millisecond
+ * - ALERT ISR: 22.5us, it only drops EN and posts a task
+ * - ALERT to EN low: 10us from the interrupt request, the "few microseconds"
+ *   the OTSD response promises. Checked separately by counters_isr_deadline,
+ *   straight after EN is driven low
+ *
+ * Without PROFILE_ISR all markers compile to nothing.
+ */
+
+#pragma once
+
+#include <avr/io.h>
+
+// Convert a time in nanoseconds to CPU cycles
+#define PROFILE_NS_TO_CYCLES(ns) (F_CPU / 1000000UL * (ns) / 1000)
+
+// Interrupt handler budgets, in CPU cycles
+#define PROFILE_BUDGET_TWI_CYCLES      PROFILE_NS_TO_CYCLES(22500)
+#define PROFILE_BUDGET_RTC_CYCLES      PROFILE_NS_TO_CYCLES(45000)
+#define PROFILE_BUDGET_ALERT_CYCLES    PROFILE_NS_TO_CYCLES(22500)
+#define PROFILE_BUDGET_ALERT_EN_CYCLES PROFILE_NS_TO_CYCLES(10000)
+
+#if defined(PROFILE_ISR)
+
+#define PROFILE_PIN_TWI   PIN1_bm
+#define PROFILE_PIN_RTC   PIN2_bm
+#define PROFILE_PIN_ALERT PIN3_bm
+
+// Set the marker pins as outputs, driven low
+static inline void profile_init()
+{
+  VPORTC.OUT &= ~(PROFILE_PIN_TWI | PROFILE_PIN_RTC | PROFILE_PIN_ALERT);
+  VPORTC.DIR |= PROFILE_PIN_TWI | PROFILE_PIN_RTC | PROFILE_PIN_ALERT;
+}
+
+#define PROFILE_ENTER(pin) (VPORTC.OUT |= (pin))
+#define PROFILE_EXIT(pin)  (VPORTC.OUT &= ~(pin))
+
+#else
+
+static inline void profile_init() {}
+
+#define PROFILE_ENTER(pin)
+#define PROFILE_EXIT(pin)
+
+#endif
@@ -0,0 +1,132 @@
+#include <stdbool.h>
+
+#include <util/atomic.h>
+
+#include "i2c/thundervolt.h"
+#include "rail_mode.h"
+
+#define NUM_RAILS (THUNDERVOLT_RAIL_3V3 + 1)
+
+// Averaging strength for the statistics, each sample moves the average 1/N of the way to the new value
+#define RAIL_MODE_STATS_FILTER 16
+
+// Mode settings
+static uint8_t policy[NUM_RAILS];
+static uint16_t threshold[NUM_RAILS];
+
+// Modes currently applied to the regulators, 1 bit per rail
+static uint8_t forced  = 0;
+static uint8_t applied = 0;
+
+// Statistics, by rail then mode, stored packed so they can be read back byte by byte
+static uint8_t stats[NUM_RAILS][2][THUNDERVOLT_MODE_STATS_SIZE];
+
+// Fetch and store little-endian words in a statistics entry
+static inline uint16_t get_word(const uint8_t *entry, uint8_t offset)
+{
+  return entry[offset] | (entry[offset + 1] << 8);
+}
+
+static inline void put_word(uint8_t *entry, uint8_t offset, uint16_t value)
+{
+  entry[offset]     = value & 0xFF;
+  entry[offset + 1] = value >> 8;
+}
+
+// Fold a sample into a running average
+static uint16_t average(uint16_t avg, uint16_t sample, uint16_t samples)
+{
+  if (samples == 0)
+    return sample;
+
+  return avg + ((int32_t)sample - avg) / RAIL_MODE_STATS_FILTER;
+}
+
+// Record a sample for a rail in its current mode
+static void record_sample(uint8_t rail, bool fpwm, uint16_t current)
+{
+  uint32_t power;
+  if (thundervolt_get_power(rail, &power) != 0)
+    return;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    uint8_t *entry   = stats[rail][fpwm];
+    uint16_t samples = get_word(entry, THUNDERVOLT_MODE_STATS_SAMPLES);
+
+    put_word(entry, THUNDERVOLT_MODE_STATS_CURRENT,
+             average(get_word(entry, THUNDERVOLT_MODE_STATS_CURRENT), current, samples));
+    put_word(entry, THUNDERVOLT_MODE_STATS_POWER,
+             average(get_word(entry, THUNDERVOLT_MODE_STATS_POWER), power / 1000, samples));
+
+    if (samples < UINT16_MAX)
+      put_word(entry, THUNDERVOLT_MODE_STATS_SAMPLES, samples + 1);
+  }
+}
+
+void rail_mode_set_policy(uint8_t rail, uint8_t mode)
+{
+  if (rail < NUM_RAILS)
+    policy[rail] = mode;
+}
+
+void rail_mode_set_threshold(uint8_t rail, uint16_t current)
+{
+  if (rail < NUM_RAILS)
+    threshold[rail] = current;
+}
+
+uint8_t rail_mode_update()
+{
+  bool monitoring = thundervolt_has_power_monitoring();
+
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    uint8_t bit = 1 << i;
+    bool fpwm   = forced & bit;
+
+    uint16_t current;
+    bool have_current = monitoring && thundervolt_get_current(i, &current) == 0;
+
+    // Pick the mode for the rail's policy
+    bool want_fpwm;
+    switch (policy[i]) {
+      case THUNDERVOLT_MODE_FPWM:
+        want_fpwm = true;
+        break;
+      case THUNDERVOLT_MODE_ADAPTIVE:
+        // Without power monitoring this is power save, and a failed reading keeps the current mode
+        want_fpwm = monitoring && fpwm;
+        if (have_current && current >= threshold[i]) {
+          want_fpwm = true;
+        } else if (have_current && current < threshold[i] - threshold[i] / 4) {
+          want_fpwm = false;
+        }
+        break;
+      default:
+        want_fpwm = false;
+        break;
+    }
+
+    // Switch the regulator mode, failed writes are retried on the next update
+    if (want_fpwm != fpwm || !(applied & bit)) {
+      if (thundervolt_set_forced_pwm(i, want_fpwm) == 0) {
+        forced = want_fpwm ? forced | bit : forced & ~bit;
+        fpwm   = want_fpwm;
+        applied |= bit;
+      }
+    }
+
+    if (have_current)
+      record_sample(i, fpwm, current);
+  }
+
+  return forced;
+}
+
+uint8_t rail_mode_read_stats(uint16_t offset)
+{
+  if (offset >= sizeof(stats))
+    return 0x00;
+
+  return ((const uint8_t *)stats)[offset];
+}
@@ -0,0 +1,53 @@
+/**
+ * Regulator mode policy for Thundervolt.
+ *
+ * The regulators can either run in forced PWM, which gives the best transient
+ * response, or drop into power save mode (PFM) at light load, which is more
+ * efficient. Each rail follows a THUNDERVOLT_MODE_xxx policy:
+ * - Power save and forced PWM are applied as they are, on all hardware
+ * - Adaptive switches on the rail's INA700 current, forcing PWM above the
+ *   threshold and returning to power save once the current drops to 3/4 of it.
+ *   Without power monitoring it behaves like power save.
+ *
+ * On HW2 the average current and power of each rail are also recorded for each
+ * mode, so the policies can be compared. Records use the THUNDERVOLT_MODE_STATS_xxx
+ * layout from i2c/thundervolt.h.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Set the mode policy for a rail.
+ *
+ * @param rail The rail, see THUNDERVOLT_RAIL_xxx
+ * @param mode The policy, see THUNDERVOLT_MODE_xxx
+ */
+void rail_mode_set_policy(uint8_t rail, uint8_t mode);
+
+/**
+ * Set the forced PWM threshold for the adaptive policy.
+ *
+ * @param rail    The rail, see THUNDERVOLT_RAIL_xxx
+ * @param current The threshold current, in mA
+ */
+void rail_mode_set_threshold(uint8_t rail, uint16_t current);
+
+/**
+ * Measure the rails, and switch their modes according to their policies.
+ *
+ * Uses the I2C bus in controller mode, so must only be called from the main loop.
+ *
+ * @return The rails running in forced PWM, 1 bit per rail
+ */
+uint8_t rail_mode_update();
+
+/**
+ * Read a byte from the mode statistics, as if the entries were stored contiguously by rail then mode.
+ *
+ * @param offset The byte offset into the statistics
+ *
+ * @return The byte at the offset, or 0x00 if the offset is past the last entry
+ */
+uint8_t rail_mode_read_stats(uint16_t offset);
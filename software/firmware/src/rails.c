@@ -0,0 +1,218 @@
+#include <stdbool.h>
+
+#include "i2c/thundervolt.h"
+#include "rails.h"
+
+#define NUM_RAILS (THUNDERVOLT_RAIL_3V3 + 1)
+
+// Load-line corrections smaller than this are ignored, so the rails don't chase noise, in mV
+#define RAILS_AVP_DEADBAND  5
+
+// Stock voltage for each rail, in mV
+static const uint16_t STOCK_VOLTAGE[NUM_RAILS] = {
+    THUNDERVOLT_STOCK_VOLTAGE_1V0,
+    THUNDERVOLT_STOCK_VOLTAGE_1V15,
+    THUNDERVOLT_STOCK_VOLTAGE_1V8,
+    THUNDERVOLT_STOCK_VOLTAGE_3V3,
+};
+
+// Regulator resolution for each rail, in mV
+static const uint8_t RESOLUTION[NUM_RAILS] = {5, 5, 10, 25};
+
+// Largest change made to a rail in one update, in regulator steps
+#define RAILS_MAX_STEPS     2
+
+// The user's voltages, captured when adjusting started and restored once it ends
+static uint16_t base_voltage[NUM_RAILS];
+
+// Rail currents when the user's voltages were set, the load line passes through the user's voltage at this load, in mA
+static uint16_t base_current[NUM_RAILS];
+
+// Voltages the regulators were last seen running at, as read back after each write
+static uint16_t applied_voltage[NUM_RAILS];
+
+// Voltages requested with rails_set_voltage, 0 if there is no request for the rail
+static uint16_t requested_voltage[NUM_RAILS];
+
+// Adjustment settings
+static uint8_t throttle = 0;
+static int8_t offset[NUM_RAILS];
+static uint8_t avp_gain[NUM_RAILS];
+
+// Whether the rails are currently under our control
+static bool active = false;
+
+// Check if any adjustments are requested
+static bool is_adjusting()
+{
+  if (throttle > 0)
+    return true;
+
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    if (offset[i])
+      return true;
+  }
+
+  // Load-line compensation needs the power monitors
+  if (!thundervolt_has_power_monitoring())
+    return false;
+
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    if (avp_gain[i])
+      return true;
+  }
+
+  return false;
+}
+
+// Check if any new voltages are waiting to be ramped to
+static bool has_requests()
+{
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    if (requested_voltage[i])
+      return true;
+  }
+
+  return false;
+}
+
+// Set the user's voltage for a rail, along with the load it was set at
+// Without a current reading, the load line starts from no load, and can only raise the rail
+static void set_base_voltage(uint8_t rail, uint16_t voltage)
+{
+  base_voltage[rail] = voltage;
+  if (!thundervolt_has_power_monitoring() || thundervolt_get_current(rail, &base_current[rail]) != 0)
+    base_current[rail] = 0;
+}
+
+// Capture the voltages the rails are running at
+static bool capture_base_voltages()
+{
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    uint16_t voltage;
+    if (thundervolt_get_voltage(i, &voltage) != 0)
+      return false;
+
+    set_base_voltage(i, voltage);
+    applied_voltage[i] = voltage;
+  }
+
+  return true;
+}
+
+// Get the voltage a rail should run at for the current settings, within the rail's allowed range
+static uint16_t get_target_voltage(uint8_t rail)
+{
+  uint16_t min, max;
+  if (thundervolt_get_voltage_range(rail, &min, &max) != 0)
+    return base_voltage[rail];
+
+  // Apply the offset, then move part of the way towards stock for the throttle step
+  int32_t target = base_voltage[rail] + offset[rail];
+  if (target < min)
+    target = min;
+  if (target < STOCK_VOLTAGE[rail])
+    target += (int32_t)(STOCK_VOLTAGE[rail] - target) * throttle / THUNDERVOLT_THROTTLE_MAX;
+
+  // Add the load-line correction for the measured current, raising the rail above the load the user's voltage was
+  // set at and lowering it below, the clamp below keeps it within the rail's range either way
+  uint16_t current;
+  if (avp_gain[rail] && thundervolt_get_current(rail, &current) == 0) {
+    int32_t correction = ((int32_t)current - base_current[rail]) * avp_gain[rail] / 1000;
+    if (correction >= RAILS_AVP_DEADBAND || correction <= -RAILS_AVP_DEADBAND)
+      target += correction;
+  }
+
+  if (target < min)
+    return min;
+  if (target > max)
+    return max;
+
+  return target;
+}
+
+void rails_set_voltage(uint8_t rail, uint16_t voltage)
+{
+  if (rail < NUM_RAILS)
+    requested_voltage[rail] = voltage;
+}
+
+void rails_set_throttle(uint8_t step)
+{
+  throttle = step > THUNDERVOLT_THROTTLE_MAX ? THUNDERVOLT_THROTTLE_MAX : step;
+}
+
+void rails_set_offset(uint8_t rail, int8_t mv)
+{
+  if (rail < NUM_RAILS)
+    offset[rail] = mv;
+}
+
+void rails_set_avp_gain(uint8_t rail, uint8_t gain)
+{
+  if (rail < NUM_RAILS)
+    avp_gain[rail] = gain;
+}
+
+void rails_update()
+{
+  bool adjusting = is_adjusting();
+
+  // Nothing to do until adjusting starts, or a new voltage is requested
+  if (!active) {
+    if ((!adjusting && !has_requests()) || !capture_base_voltages())
+      return;
+
+    active = true;
+  }
+
+  bool settled = true;
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    // If the voltage was changed from elsewhere, that is the user's new voltage
+    uint16_t voltage;
+    if (thundervolt_get_voltage(i, &voltage) != 0) {
+      settled = false;
+      continue;
+    }
+
+    if (voltage != applied_voltage[i]) {
+      set_base_voltage(i, voltage);
+      applied_voltage[i] = voltage;
+    }
+
+    // Requested voltages replace the user's voltage, and are ramped to like any other change
+    if (requested_voltage[i]) {
+      set_base_voltage(i, requested_voltage[i]);
+      requested_voltage[i] = 0;
+    }
+
+    // Step towards the target, failed writes are retried on the next update
+    // Skip rails within one regulator step of their target, the write wouldn't change anything
+    uint16_t target   = adjusting ? get_target_voltage(i) : base_voltage[i];
+    uint16_t max_step = RESOLUTION[i] * RAILS_MAX_STEPS;
+    if (target < voltage + RESOLUTION[i] && target + RESOLUTION[i] > voltage)
+      continue;
+
+    if (target > voltage + max_step) {
+      target = voltage + max_step;
+    } else if (target + max_step < voltage) {
+      target = voltage - max_step;
+    }
+
+    if (thundervolt_set_voltage(i, target) != 0) {
+      settled = false;
+      continue;
+    }
+
+    // The regulators round to their own resolution, so remember what they actually took
+    if (thundervolt_get_voltage(i, &applied_voltage[i]) != 0)
+      applied_voltage[i] = target;
+
+    if (applied_voltage[i] != base_voltage[i])
+      settled = false;
+  }
+
+  // Hand the rails back once they are at the user's voltages again
+  if (!adjusting && settled)
+    active = false;
+}
@@ -0,0 +1,68 @@
+/**
+ * Rail voltage control for Thundervolt.
+ *
+ * Adjusts the rails on top of the voltages the user set, for:
+ * - Offsets, such as the more aggressive undervolt used on low battery
+ * - Throttling, moving each rail part of the way towards stock as the board heats up
+ * - Load-line compensation (HW2 only), moving each rail with its measured current,
+ *   up for loads above the one the user's voltage was set at and down below it,
+ *   so it can idle lower while still holding up under load
+ *
+ * Changes are made in small steps, so the regulators ramp at their configured
+ * slew rate rather than jumping straight to the new voltage.
+ *
+ * New voltages can also be requested with rails_set_voltage, which ramps the
+ * rails the same way instead of switching them in one write.
+ *
+ * The rails are left alone while there is nothing to adjust. When adjusting
+ * starts the current voltages are captured as the user's voltages, and any
+ * voltage written over I2C by the homebrew while adjusting replaces the captured
+ * value, so the user's settings are never lost.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Rail update period, in milliseconds
+#define RAILS_PERIOD_MS 50
+
+/**
+ * Ramp a rail to a new voltage, which becomes the user's voltage for the rail.
+ *
+ * @param rail    The rail, see THUNDERVOLT_RAIL_xxx
+ * @param voltage The voltage, in mV, must be within the rail's allowed range
+ */
+void rails_set_voltage(uint8_t rail, uint16_t voltage);
+
+/**
+ * Set the throttle step.
+ *
+ * @param step The throttle step, from 0 (not throttling) to THUNDERVOLT_THROTTLE_MAX (stock voltages)
+ */
+void rails_set_throttle(uint8_t step);
+
+/**
+ * Set the voltage offset for a rail, applied to the user's voltage before throttling.
+ *
+ * @param rail The rail, see THUNDERVOLT_RAIL_xxx
+ * @param mv   The offset, in mV
+ */
+void rails_set_offset(uint8_t rail, int8_t mv);
+
+/**
+ * Set the load-line gain for a rail.
+ *
+ * @param rail The rail, see THUNDERVOLT_RAIL_xxx
+ * @param gain The voltage added per amp of load current above the load the user's voltage was set at, and taken
+ *             away per amp below it, in mV/A, 0 to disable
+ */
+void rails_set_avp_gain(uint8_t rail, uint8_t gain);
+
+/**
+ * Measure the rails and program them for the current settings.
+ *
+ * Uses the I2C bus in controller mode, so must only be called from the main loop,
+ * every RAILS_PERIOD_MS.
+ */
+void rails_update();
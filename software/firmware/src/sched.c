@@ -0,0 +1,136 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <util/atomic.h>
+
+#include "sched.h"
+
+// Task flags
+#define TASK_TIMED   (1 << 0) // The task runs when next_run is reached
+#define TASK_ONESHOT (1 << 1) // The task is freed after it runs
+
+// Task storage, a slot is free if fn is NULL
+struct task {
+  sched_fn fn;
+  uint8_t flags;
+  uint16_t period;
+  uint32_t next_run;
+};
+
+// Milliseconds since boot
+static volatile uint32_t millis = 0;
+
+// Registered tasks
+static struct task tasks[SCHED_MAX_TASKS];
+
+// Posted tasks, one bit per task slot
+static volatile uint16_t posted = 0;
+
+// Find a free task slot, and fill it in
+static int8_t add_task(sched_fn fn, uint8_t flags, uint16_t period, uint16_t delay)
+{
+  for (uint8_t i = 0; i < SCHED_MAX_TASKS; i++) {
+    struct task *task = &tasks[i];
+    if (task->fn)
+      continue;
+
+    task->flags    = flags;
+    task->period   = period;
+    task->next_run = sched_millis() + delay;
+    task->fn       = fn;
+
+    return i;
+  }
+
+  return -1;
+}
+
+uint32_t sched_tick()
+{
+  return ++millis;
+}
+
+uint32_t sched_millis()
+{
+  uint32_t now;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { now = millis; }
+
+  return now;
+}
+
+int8_t sched_every(uint16_t period, sched_fn fn)
+{
+  return add_task(fn, period ? TASK_TIMED : 0, period, period);
+}
+
+int8_t sched_after(uint16_t delay, sched_fn fn)
+{
+  return add_task(fn, TASK_TIMED | TASK_ONESHOT, 0, delay);
+}
+
+int8_t sched_register(sched_fn fn)
+{
+  return add_task(fn, 0, 0, 0);
+}
+
+void sched_post(int8_t task)
+{
+  if (task < 0 || task >= SCHED_MAX_TASKS)
+    return;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { posted |= (1U << task); }
+}
+
+void sched_set_period(int8_t task, uint16_t period)
+{
+  if (task < 0 || task >= SCHED_MAX_TASKS)
+    return;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    tasks[task].period   = period;
+    tasks[task].flags    = period ? TASK_TIMED : 0;
+    tasks[task].next_run = millis + period;
+  }
+}
+
+void sched_run()
+{
+  uint32_t now = sched_millis();
+
+  // Take the posted tasks, anything posted from now on runs on the next pass
+  uint16_t run_posted;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    run_posted = posted;
+    posted     = 0;
+  }
+
+  for (uint8_t i = 0; i < SCHED_MAX_TASKS; i++) {
+    struct task *task = &tasks[i];
+    if (!task->fn)
+      continue;
+
+    bool due = run_posted & (1U << i);
+
+    // Check timed tasks against their deadline
+    if ((task->flags & TASK_TIMED) && (int32_t)(now - task->next_run) >= 0) {
+      due = true;
+
+      // Schedule the next run relative to the deadline, so the period doesn't drift
+      task->next_run += task->period;
+      if ((int32_t)(now - task->next_run) >= 0)
+        task->next_run = now + task->period;
+    }
+
+    if (!due)
+      continue;
+
+    // Free one-shot tasks before running them, so they can reschedule themselves
+    sched_fn fn = task->fn;
+    if (task->flags & TASK_ONESHOT)
+      task->fn = NULL;
+
+    fn();
+  }
+}
@@ -0,0 +1,98 @@
+/**
+ * Cooperative task scheduler for AVR 0/1-series MCUs.
+ *
+ * Keeps a millisecond tick (advanced from a periodic interrupt) and runs
+ * tasks from the main loop, so slow work such as I2C polling or EEPROM
+ * writes never runs inside an interrupt handler.
+ *
+ * Three kinds of task are supported:
+ * - Periodic tasks, run every N milliseconds (sched_every)
+ * - One-shot tasks, run once after a delay and then freed (sched_after)
+ * - Deferred tasks, run when posted, typically from an interrupt handler (sched_register/sched_post)
+ *
+ * Tasks are statically allocated, up to SCHED_MAX_TASKS. The tick interrupt only
+ * increments a counter, and posting a task only sets a bit, so the cost inside
+ * interrupt handlers is small and constant.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Maximum number of tasks that can be registered, at most 16 (posted tasks are tracked in a word)
+#define SCHED_MAX_TASKS 12
+
+/**
+ * Task function, called from the main loop when the task is due.
+ */
+typedef void (*sched_fn)(void);
+
+/**
+ * Advance the millisecond tick.
+ *
+ * Must be called from a 1ms periodic interrupt.
+ *
+ * @return The updated tick
+ */
+uint32_t sched_tick();
+
+/**
+ * Get the number of milliseconds since boot.
+ *
+ * Safe to call from both interrupt handlers and the main loop.
+ */
+uint32_t sched_millis();
+
+/**
+ * Register a periodic task.
+ *
+ * @param period The period of the task, in milliseconds, 0 to pause the task
+ * @param fn     The task function
+ *
+ * @return A task handle, or -1 if there are no free task slots
+ */
+int8_t sched_every(uint16_t period, sched_fn fn);
+
+/**
+ * Register a one-shot task, which is freed after it runs.
+ *
+ * @param delay The delay before the task runs, in milliseconds
+ * @param fn    The task function
+ *
+ * @return A task handle, or -1 if there are no free task slots
+ */
+int8_t sched_after(uint16_t delay, sched_fn fn);
+
+/**
+ * Register a deferred task, which only runs when posted with sched_post.
+ *
+ * @param fn The task function
+ *
+ * @return A task handle, or -1 if there are no free task slots
+ */
+int8_t sched_register(sched_fn fn);
+
+/**
+ * Run a task from the main loop as soon as possible.
+ *
+ * Safe to call from interrupt handlers. Posting a task several times before it
+ * runs only runs it once.
+ *
+ * @param task The task handle
+ */
+void sched_post(int8_t task);
+
+/**
+ * Change the period of a periodic task.
+ *
+ * @param task   The task handle returned by sched_every
+ * @param period The new period, in milliseconds, 0 to pause the task
+ */
+void sched_set_period(int8_t task, uint16_t period);
+
+/**
+ * Run any tasks that are due or posted.
+ *
+ * This function should be called repeatedly from the main loop.
+ */
+void sched_run();
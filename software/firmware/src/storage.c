@@ -0,0 +1,19 @@
+#include <avr/eeprom.h>
+
+#include "counters.h"
+#include "storage.h"
+
+void storage_update_byte(uint8_t *addr, uint8_t value)
+{
+  if (eeprom_read_byte(addr) == value)
+    return;
+
+  eeprom_write_byte(addr, value);
+  counters_eeprom_written();
+}
+
+void storage_update_word(uint16_t *addr, uint16_t value)
+{
+  storage_update_byte((uint8_t *)addr, value & 0xFF);
+  storage_update_byte((uint8_t *)addr + 1, value >> 8);
+}
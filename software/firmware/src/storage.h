@@ -0,0 +1,27 @@
+/**
+ * EEPROM writes for Thundervolt.
+ *
+ * Every EEPROM write goes through here, so only the bytes that change are
+ * written, saving the EEPROM's endurance, and each one is counted in the
+ * THUNDERVOLT_COUNT_EEPROM_WRITES counter.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Update a byte in the EEPROM, if the value changed.
+ *
+ * @param addr  The EEPROM address
+ * @param value The value to write
+ */
+void storage_update_byte(uint8_t *addr, uint8_t value);
+
+/**
+ * Update a little-endian word in the EEPROM, one byte at a time.
+ *
+ * @param addr  The EEPROM address
+ * @param value The value to write
+ */
+void storage_update_word(uint16_t *addr, uint16_t value);
@@ -0,0 +1,220 @@
+#if defined(STREAM_UART)
+
+#include <stdbool.h>
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "crc8.h"
+#include "i2c/thundervolt.h"
+#include "power.h"
+#include "sched.h"
+#include "stream.h"
+#include "thundervolt_stream.h"
+
+// The baud rate is derived from the peripheral clock, which must not change while a frame is sent
+#if defined(POWER_BOOST_I2C_CLOCK)
+#error "STREAM_UART can't be used with POWER_BOOST_I2C_CLOCK"
+#endif
+
+// USART0 TX, on its default pin
+#define TX_PIN PIN2_bm
+
+// Baud rate register value, rounded to the nearest
+#define BAUD_REG ((64UL * F_CPU + 8UL * THUNDERVOLT_STREAM_BAUD) / (16UL * THUNDERVOLT_STREAM_BAUD))
+
+// TX ring buffer, filled from the main loop and drained by the DRE interrupt
+static uint8_t tx_buf[STREAM_TX_LEN];
+static volatile uint8_t tx_head = 0;
+static volatile uint8_t tx_tail = 0;
+
+// Register writes waiting for the next sample, logged from the TWI interrupt
+static volatile uint8_t writes[STREAM_WRITES][2];
+static volatile uint8_t num_writes = 0;
+
+// Frames and writes dropped since the last sample
+static volatile uint8_t dropped = 0;
+
+static uint8_t seq = 0;
+
+static inline void count_dropped()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (dropped < UINT8_MAX)
+      dropped++;
+  }
+}
+
+static inline void put_word(uint8_t *payload, uint8_t offset, uint16_t value)
+{
+  payload[offset]     = value & 0xFF;
+  payload[offset + 1] = value >> 8;
+}
+
+static inline void put_time(uint8_t *payload)
+{
+  uint32_t now = sched_millis();
+  put_word(payload, THUNDERVOLT_STREAM_TIME, now & 0xFFFF);
+  put_word(payload, THUNDERVOLT_STREAM_TIME + 2, now >> 16);
+}
+
+static inline void tx_push(uint8_t data)
+{
+  tx_buf[tx_head] = data;
+  tx_head         = (tx_head + 1) & (STREAM_TX_LEN - 1);
+}
+
+// Queue a frame, or drop it if the ring buffer doesn't have room for all of it
+static bool send_frame(uint8_t type, const uint8_t *payload, uint8_t len)
+{
+  uint8_t used = (tx_head - tx_tail) & (STREAM_TX_LEN - 1);
+  if (STREAM_TX_LEN - 1 - used < len + THUNDERVOLT_STREAM_OVERHEAD) {
+    count_dropped();
+    return false;
+  }
+
+  uint8_t crc = crc8_update(crc8_update(crc8_update(0, type), seq), len);
+  crc         = crc8_update_buf(crc, payload, len);
+
+  tx_push(THUNDERVOLT_STREAM_SYNC);
+  tx_push(type);
+  tx_push(seq++);
+  tx_push(len);
+  for (uint8_t i = 0; i < len; i++) tx_push(payload[i]);
+  tx_push(crc);
+
+  // Start draining, and keep the peripheral clock running until the last byte is out
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    power_set_busy(POWER_BUSY_UART, true);
+    USART0.CTRLA = USART_DREIE_bm;
+  }
+
+  return true;
+}
+
+void stream_init(uint8_t hw_rev, uint8_t sw_rev)
+{
+  // TX only, so the RX pin (PB3, U10) is left alone
+  PORTB.OUTSET = TX_PIN;
+  PORTB.DIRSET = TX_PIN;
+
+  USART0.BAUD  = BAUD_REG;
+  USART0.CTRLC = USART_CMODE_ASYNCHRONOUS_gc | USART_PMODE_DISABLED_gc | USART_SBMODE_1BIT_gc | USART_CHSIZE_8BIT_gc;
+  USART0.CTRLB = USART_TXEN_bm;
+
+  uint8_t payload[THUNDERVOLT_STREAM_BOOT_SIZE];
+  put_time(payload);
+  payload[THUNDERVOLT_STREAM_BOOT_HW_REV] = hw_rev;
+  payload[THUNDERVOLT_STREAM_BOOT_SW_REV] = sw_rev;
+  send_frame(THUNDERVOLT_STREAM_BOOT, payload, sizeof(payload));
+}
+
+// Send the register writes logged since the last sample
+static void send_writes()
+{
+  uint8_t payload[THUNDERVOLT_STREAM_WRITES_DATA + STREAM_WRITES * 2];
+  uint8_t len = THUNDERVOLT_STREAM_WRITES_DATA;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (uint8_t i = 0; i < num_writes; i++) {
+      payload[len++] = writes[i][0];
+      payload[len++] = writes[i][1];
+    }
+    num_writes = 0;
+  }
+
+  if (len == THUNDERVOLT_STREAM_WRITES_DATA)
+    return;
+
+  put_time(payload);
+  send_frame(THUNDERVOLT_STREAM_WRITES, payload, len);
+}
+
+void stream_sample()
+{
+  uint8_t payload[THUNDERVOLT_STREAM_SAMPLE_SIZE_PM];
+  uint8_t len = THUNDERVOLT_STREAM_SAMPLE_SIZE;
+
+  put_time(payload);
+
+  float temp;
+  int16_t centi = thundervolt_get_temp(&temp) == 0 ? temp * 100 : INT16_MIN;
+  put_word(payload, THUNDERVOLT_STREAM_SAMPLE_TEMP, centi);
+
+  // Readings that fail are sent as THUNDERVOLT_STREAM_NO_READING, so they can't be mistaken for 0
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    uint16_t voltage;
+    if (thundervolt_get_voltage(i, &voltage) != 0)
+      voltage = THUNDERVOLT_STREAM_NO_READING;
+    put_word(payload, THUNDERVOLT_STREAM_SAMPLE_VOUT + i * 2, voltage);
+  }
+
+  if (thundervolt_has_power_monitoring()) {
+    for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+      uint16_t voltage, current;
+      if (thundervolt_get_measured_voltage(i, &voltage) != 0)
+        voltage = THUNDERVOLT_STREAM_NO_READING;
+      if (thundervolt_get_current(i, &current) != 0)
+        current = THUNDERVOLT_STREAM_NO_READING;
+      put_word(payload, THUNDERVOLT_STREAM_SAMPLE_VBUS + i * 2, voltage);
+      put_word(payload, THUNDERVOLT_STREAM_SAMPLE_CURRENT + i * 2, current);
+    }
+    len = THUNDERVOLT_STREAM_SAMPLE_SIZE_PM;
+  }
+
+  // The drop count is only cleared once it has been reported
+  uint8_t reported                           = dropped;
+  payload[THUNDERVOLT_STREAM_SAMPLE_DROPPED] = reported;
+  if (send_frame(THUNDERVOLT_STREAM_SAMPLE, payload, len)) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { dropped -= reported; }
+  }
+
+  send_writes();
+}
+
+void stream_otsd(int8_t limit)
+{
+  uint8_t payload[THUNDERVOLT_STREAM_OTSD_SIZE];
+  put_time(payload);
+  payload[THUNDERVOLT_STREAM_OTSD_LIMIT] = limit;
+  send_frame(THUNDERVOLT_STREAM_OTSD, payload, sizeof(payload));
+}
+
+void stream_log_write(uint8_t reg_addr, uint8_t value)
+{
+  if (num_writes < STREAM_WRITES) {
+    writes[num_writes][0] = reg_addr;
+    writes[num_writes][1] = value;
+    num_writes++;
+  } else {
+    count_dropped();
+  }
+}
+
+// Send the next byte, or wait for the last one to finish once the ring buffer is empty
+ISR(USART0_DRE_vect)
+{
+  power_wake();
+  if (tx_tail != tx_head) {
+    USART0.STATUS  = USART_TXCIF_bm;
+    USART0.TXDATAL = tx_buf[tx_tail];
+    tx_tail        = (tx_tail + 1) & (STREAM_TX_LEN - 1);
+  } else {
+    USART0.CTRLA = USART_TXCIE_bm;
+  }
+}
+
+// The last byte has been sent, let the CPU slow down and sleep again
+ISR(USART0_TXC_vect)
+{
+  power_wake();
+  USART0.STATUS = USART_TXCIF_bm;
+  USART0.CTRLA  = 0;
+  power_set_busy(POWER_BUSY_UART, false);
+}
+
+#endif // STREAM_UART
@@ -0,0 +1,89 @@
+/**
+ * UART telemetry stream for bench rigs.
+ *
+ * When built with STREAM_UART defined (see env:thundervolt-hw2-stream), the
+ * firmware sends binary frames on the USART0 TX pin (PB2, unconnected on all
+ * board variants), in the format described in thundervolt_stream.h.
+ *
+ * Frames are queued in a TX ring buffer, and drained by the USART's data
+ * register empty interrupt, so queueing never waits for the UART. A frame that
+ * doesn't fit is dropped and counted instead. The drain interrupt only moves a
+ * byte per character time, so it never holds up the RTC or TWI interrupts for
+ * more than a few cycles.
+ *
+ * Register writes are logged from the TWI interrupt into a small buffer, and
+ * framed by stream_sample from the main loop.
+ *
+ * Without STREAM_UART all functions compile to nothing.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Interval between samples, in ms
+#define STREAM_PERIOD_MS 100
+
+// Size of the TX ring buffer, in bytes (must be a power of 2)
+#define STREAM_TX_LEN 128
+
+// Number of register writes buffered between samples
+#define STREAM_WRITES 16
+
+#if defined(STREAM_UART)
+
+/**
+ * Set up the UART, and send the BOOT frame.
+ *
+ * @param hw_rev The hardware revision
+ * @param sw_rev The software revision
+ */
+void stream_init(uint8_t hw_rev, uint8_t sw_rev);
+
+/**
+ * Sample the rails and send a SAMPLE frame, followed by any register writes since the last sample.
+ *
+ * Uses the I2C bus in controller mode, so must only be called from the main loop.
+ */
+void stream_sample();
+
+/**
+ * Send an OTSD frame.
+ *
+ * @param limit The over-temperature limit that was exceeded, in °C
+ */
+void stream_otsd(int8_t limit);
+
+/**
+ * Log a register write, to be sent with the next sample.
+ *
+ * Called from the TWI interrupt.
+ *
+ * @param reg_addr The register address
+ * @param value    The value written
+ */
+void stream_log_write(uint8_t reg_addr, uint8_t value);
+
+#else
+
+// Functions rather than empty macros, stream_sample is also passed to the scheduler
+static inline void stream_init(uint8_t hw_rev, uint8_t sw_rev)
+{
+  (void)hw_rev;
+  (void)sw_rev;
+}
+
+static inline void stream_sample() {}
+
+static inline void stream_otsd(int8_t limit)
+{
+  (void)limit;
+}
+
+static inline void stream_log_write(uint8_t reg_addr, uint8_t value)
+{
+  (void)reg_addr;
+  (void)value;
+}
+
+#endif
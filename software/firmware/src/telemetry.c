@@ -0,0 +1,156 @@
+#include <stdbool.h>
+
+#include <util/atomic.h>
+
+#include "fault_log.h"
+#include "i2c/thundervolt.h"
+#include "telemetry.h"
+
+// History FIFO, stored as packed records so it can be read back byte by byte
+static uint8_t history[TELEMETRY_HISTORY_LEN][THUNDERVOLT_HIST_RECORD_SIZE];
+static volatile uint8_t history_head  = 0;
+static volatile uint8_t history_count = 0;
+
+// Samples per record
+static uint8_t samples_per_record = THUNDERVOLT_DEFAULT_TELEM_SAMPLES;
+
+// Accumulated values for the record being built
+static uint8_t num_samples;
+static int8_t temp_min, temp_max;
+static int16_t temp_sum;
+static uint16_t power_min, power_max;
+static uint32_t power_sum;
+
+// Store a little-endian word in a record
+static inline void put_word(uint8_t *record, uint8_t offset, uint16_t value)
+{
+  record[offset]     = value & 0xFF;
+  record[offset + 1] = value >> 8;
+}
+
+// Push the accumulated values into the history FIFO, dropping the oldest record if full
+static void push_record()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    uint8_t *record;
+    if (history_count < TELEMETRY_HISTORY_LEN) {
+      record = history[(history_head + history_count++) % TELEMETRY_HISTORY_LEN];
+    } else {
+      record       = history[history_head];
+      history_head = (history_head + 1) % TELEMETRY_HISTORY_LEN;
+    }
+
+    record[THUNDERVOLT_HIST_TEMP_MIN] = temp_min;
+    record[THUNDERVOLT_HIST_TEMP_MAX] = temp_max;
+    record[THUNDERVOLT_HIST_TEMP_AVG] = temp_sum / num_samples;
+    record[THUNDERVOLT_HIST_SAMPLES]  = num_samples;
+    put_word(record, THUNDERVOLT_HIST_POWER_MIN, power_min);
+    put_word(record, THUNDERVOLT_HIST_POWER_AVG, power_sum / num_samples);
+    put_word(record, THUNDERVOLT_HIST_POWER_MAX, power_max);
+  }
+
+  num_samples = 0;
+}
+
+// Read the total board power, in mW, saturating at 65535
+// Fails if any of the rails couldn't be read, rather than returning a partial total
+static int read_board_power(uint16_t *power)
+{
+  *power = 0;
+  if (!thundervolt_has_power_monitoring())
+    return 0;
+
+  uint32_t total = 0;
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+    int rcode;
+    uint32_t rail_power;
+    if ((rcode = thundervolt_get_power(i, &rail_power)) != 0)
+      return rcode;
+
+    total += rail_power;
+  }
+
+  total /= 1000;
+  *power = total > UINT16_MAX ? UINT16_MAX : total;
+
+  return 0;
+}
+
+void telemetry_sample()
+{
+  // Read the board temperature, skip this sample if the sensor didn't respond
+  float temp_c;
+  if (thundervolt_get_temp(&temp_c) != 0)
+    return;
+
+  // Round to the nearest degree, clamped to the record's int8
+  if (temp_c > INT8_MAX)
+    temp_c = INT8_MAX;
+  if (temp_c < INT8_MIN)
+    temp_c = INT8_MIN;
+  int8_t temp = temp_c < 0 ? temp_c - 0.5f : temp_c + 0.5f;
+
+  // Keep the temperature for the fault log, its records are made in interrupt handlers which can't read the sensor
+  fault_log_set_temp(temp);
+
+  // Skip this sample if any rail's power couldn't be read, a partial total would drag the record's minimum down
+  uint16_t power;
+  if (read_board_power(&power) != 0)
+    return;
+
+  // Accumulate the sample
+  if (num_samples == 0) {
+    temp_min = temp_max = temp;
+    power_min = power_max = power;
+    temp_sum              = 0;
+    power_sum             = 0;
+  }
+
+  if (temp < temp_min)
+    temp_min = temp;
+  if (temp > temp_max)
+    temp_max = temp;
+  if (power < power_min)
+    power_min = power;
+  if (power > power_max)
+    power_max = power;
+
+  temp_sum += temp;
+  power_sum += power;
+
+  // Push a record once we have enough samples
+  if (++num_samples >= samples_per_record)
+    push_record();
+}
+
+void telemetry_set_samples_per_record(uint8_t samples)
+{
+  samples_per_record = samples ? samples : 1;
+}
+
+uint8_t telemetry_count()
+{
+  return history_count;
+}
+
+void telemetry_pop(uint8_t count)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (count > history_count)
+      count = history_count;
+
+    history_head = (history_head + count) % TELEMETRY_HISTORY_LEN;
+    history_count -= count;
+  }
+}
+
+uint8_t telemetry_read(uint16_t offset)
+{
+  uint8_t index = offset / THUNDERVOLT_HIST_RECORD_SIZE;
+  if (index >= history_count)
+    return 0x00;
+
+  return history[(history_head + index) % TELEMETRY_HISTORY_LEN][offset % THUNDERVOLT_HIST_RECORD_SIZE];
+}
@@ -0,0 +1,51 @@
+/**
+ * Background telemetry for Thundervolt.
+ *
+ * Periodically samples the board temperature (and board power on hardware with
+ * power monitoring), and condenses the samples into a history FIFO of
+ * min/max/average records which can be read back over I2C.
+ *
+ * Records use the THUNDERVOLT_HIST_xxx layout from i2c/thundervolt.h.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Number of history records kept in SRAM
+#define TELEMETRY_HISTORY_LEN 48
+
+/**
+ * Take a telemetry sample, pushing a history record once enough samples have been taken.
+ *
+ * Uses the I2C bus in controller mode, so must only be called from the main loop.
+ */
+void telemetry_sample();
+
+/**
+ * Set the number of samples condensed into each history record.
+ *
+ * @param samples The number of samples per record, from 1 to 255
+ */
+void telemetry_set_samples_per_record(uint8_t samples);
+
+/**
+ * Get the number of history records available.
+ */
+uint8_t telemetry_count();
+
+/**
+ * Discard the oldest history records.
+ *
+ * @param count The number of records to discard
+ */
+void telemetry_pop(uint8_t count);
+
+/**
+ * Read a byte from the history, as if the records were stored contiguously, oldest first.
+ *
+ * @param offset The byte offset into the history
+ *
+ * @return The byte at the offset, or 0x00 if the offset is past the newest record
+ */
+uint8_t telemetry_read(uint16_t offset);
@@ -1,17 +1,17 @@
 #pragma once
 
-// Font
-#include "Glass_TTY_VT220_ttf.h"
+// Font, baked from Glass_TTY_VT220.ttf at build time
+#include "font_atlas_bin.h"
 
-// Image
-#include "arrow_png.h"
-#include "bullet_png.h"
-#include "cursor_png.h"
-#include "dolphin_png.h"
-#include "note_png.h"
-#include "toggle_off_png.h"
-#include "toggle_on_png.h"
-#include "tv_png.h"
+// Image, converted to GX textures at build time
+#include "arrow_tex.h"
+#include "bullet_tex.h"
+#include "cursor_tex.h"
+#include "dolphin_tex.h"
+#include "note_tex.h"
+#include "toggle_off_tex.h"
+#include "toggle_on_tex.h"
+#include "tv_tex.h"
 
 // SFX
 #include "back_raw.h"
@@ -0,0 +1,150 @@
+/*
+ * Font
+ *
+ * Draws text as textured quads from the font atlas baked at build time by tools/font_bake,
+ * so no glyphs are rasterized at runtime
+ *
+ */
+
+#include <grrlib.h>
+#include <ogc/cache.h>
+#include <ogc/gx.h>
+#include <string.h>
+
+#include "assets.h"
+#include "font.h"
+#include "font_atlas.h"
+
+// Baked atlas, used in place from the linked data
+static const struct font_atlas_header *atlas = NULL;
+static const struct font_atlas_glyph *glyphs = NULL;
+static GXTexObj texture;
+
+// Size of a texel in texture coordinates
+static f32 texelWidth  = 0;
+static f32 texelHeight = 0;
+
+// Glyph index for each ASCII character, 0xFF if the atlas doesn't have it
+static u8 asciiGlyphs[128];
+
+// Decode the next UTF-8 character, only the 1 and 2 byte sequences the menus use are supported
+static u16 nextChar(const char **text)
+{
+  const u8 *s = (const u8 *)*text;
+  u16 c       = *s++;
+  if (c >= 0xC0 && c < 0xE0 && (*s & 0xC0) == 0x80)
+    c = ((c & 0x1F) << 6) | (*s++ & 0x3F);
+
+  *text = (const char *)s;
+  return c;
+}
+
+static const struct font_atlas_glyph *findGlyph(u16 c)
+{
+  if (c < 128)
+    return asciiGlyphs[c] != 0xFF ? &glyphs[asciiGlyphs[c]] : NULL;
+
+  for (int i = 0; i < atlas->num_glyphs; i++) {
+    if (glyphs[i].codepoint == c)
+      return &glyphs[i];
+  }
+
+  return NULL;
+}
+
+void setupFont()
+{
+  atlas  = (const struct font_atlas_header *)font_atlas_bin;
+  glyphs = (const struct font_atlas_glyph *)(atlas + 1);
+
+  memset(asciiGlyphs, 0xFF, sizeof(asciiGlyphs));
+  for (int i = 0; i < atlas->num_glyphs; i++) {
+    if (glyphs[i].codepoint < 128)
+      asciiGlyphs[glyphs[i].codepoint] = i;
+  }
+
+  // bin2o aligns the data to 32 bytes, and the baker aligns the texture within it, so GX can read it in place
+  void *data = (void *)(font_atlas_bin + atlas->data_offset);
+  DCFlushRange(data, atlas->width * atlas->height * 2);
+
+  GX_InitTexObj(&texture, data, atlas->width, atlas->height, GX_TF_IA8, GX_CLAMP, GX_CLAMP, GX_FALSE);
+  GX_InitTexObjLOD(&texture, GX_NEAR, GX_NEAR, 0.0f, 0.0f, 0.0f, GX_FALSE, GX_FALSE, GX_ANISO_1);
+
+  texelWidth  = 1.0f / atlas->width;
+  texelHeight = 1.0f / atlas->height;
+}
+
+void drawText(int x, int y, const char *text, u32 color)
+{
+  // count the quads first, the whole string is drawn in a single batch
+  u16 quads = 0;
+  for (const char *s = text; *s;) {
+    const struct font_atlas_glyph *glyph = findGlyph(nextChar(&s));
+    if (glyph && glyph->w)
+      quads++;
+  }
+
+  if (!quads)
+    return;
+
+  GX_LoadTexObj(&texture, GX_TEXMAP0);
+  GX_SetTevOp(GX_TEVSTAGE0, GX_MODULATE);
+  GX_SetVtxDesc(GX_VA_TEX0, GX_DIRECT);
+
+  // same pen placement as GRRLIB_PrintfTTF, the baseline is one font size down
+  int penX = x;
+  int penY = y + atlas->size;
+
+  GX_Begin(GX_QUADS, GX_VTXFMT0, quads * 4);
+  for (const char *s = text; *s;) {
+    const struct font_atlas_glyph *glyph = findGlyph(nextChar(&s));
+    if (!glyph)
+      continue;
+
+    if (glyph->w) {
+      f32 x0 = penX + glyph->left;
+      f32 y0 = penY - glyph->top;
+      f32 x1 = x0 + glyph->w;
+      f32 y1 = y0 + glyph->h;
+      f32 s0 = glyph->x * texelWidth;
+      f32 t0 = glyph->y * texelHeight;
+      f32 s1 = (glyph->x + glyph->w) * texelWidth;
+      f32 t1 = (glyph->y + glyph->h) * texelHeight;
+
+      GX_Position3f32(x0, y0, 0.0f);
+      GX_Color1u32(color);
+      GX_TexCoord2f32(s0, t0);
+
+      GX_Position3f32(x1, y0, 0.0f);
+      GX_Color1u32(color);
+      GX_TexCoord2f32(s1, t0);
+
+      GX_Position3f32(x1, y1, 0.0f);
+      GX_Color1u32(color);
+      GX_TexCoord2f32(s1, t1);
+
+      GX_Position3f32(x0, y1, 0.0f);
+      GX_Color1u32(color);
+      GX_TexCoord2f32(s0, t1);
+    }
+
+    penX += glyph->advance;
+  }
+  GX_End();
+
+  GX_SetTevOp(GX_TEVSTAGE0, GX_PASSCLR);
+  GX_SetVtxDesc(GX_VA_TEX0, GX_NONE);
+}
+
+u32 getTextWidth(const char *text)
+{
+  // the advances are baked, so this is just a table walk
+  u32 width = 0;
+  for (const char *s = text; *s;) {
+    const struct font_atlas_glyph *glyph = findGlyph(nextChar(&s));
+    if (glyph)
+      width += glyph->advance;
+  }
+
+  return width;
+}
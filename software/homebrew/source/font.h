@@ -0,0 +1,7 @@
+#pragma once
+
+#include <gctypes.h>
+
+void setupFont(void);
+void drawText(int x, int y, const char *text, u32 color);
+u32 getTextWidth(const char *text);
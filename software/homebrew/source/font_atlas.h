@@ -0,0 +1,32 @@
+/*
+ * Baked font atlas format
+ *
+ * Written by tools/font_bake at build time, and drawn by font.c at runtime without FreeType.
+ * All fields are big-endian, so the atlas can be used in place on the Wii.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define FONT_ATLAS_MAGIC 0x54564654 // "TVFT"
+
+// The texture data is GX_TF_IA8, swizzled into 4x4 texel tiles, and starts at a 32 byte aligned offset
+struct font_atlas_header {
+  uint32_t magic;
+  uint16_t width; // Texture width, in texels
+  uint16_t height; // Texture height, in texels
+  uint8_t size; // Pixel size the font was baked at
+  uint8_t num_glyphs; // Number of glyphs following the header, sorted by codepoint
+  uint16_t data_offset; // Offset of the texture data from the start of the atlas
+};
+
+struct font_atlas_glyph {
+  uint16_t codepoint;
+  uint16_t x, y; // Position in the texture, in texels
+  uint8_t w, h; // Size in the texture, in texels
+  int8_t left, top; // Bearing from the pen position on the baseline
+  uint8_t advance; // Pen advance, in pixels
+  uint8_t reserved;
+};
@@ -0,0 +1,29 @@
+/*
+ * Baked texture format
+ *
+ * Written by tools/tex_convert at build time, and used in place by texture.c at runtime, with no
+ * PNG decode or reformat. All fields are big-endian, like the Wii.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define GX_TEXTURE_MAGIC 0x54565458 // "TVTX"
+
+// Texture formats, matching GX_TF_xxx
+#define GX_TEXTURE_I8     0x1
+#define GX_TEXTURE_IA8    0x3
+#define GX_TEXTURE_RGB5A3 0x5
+#define GX_TEXTURE_RGBA8  0x6
+
+// The texture data is swizzled into the format's tiles, padded to whole tiles, and starts 32 byte aligned
+struct gx_texture_header {
+  uint32_t magic;
+  uint16_t width; // Texture width, in texels
+  uint16_t height; // Texture height, in texels
+  uint8_t format; // GX_TEXTURE_xxx
+  uint8_t reserved;
+  uint16_t data_offset; // Offset of the texture data from the start of the file
+};
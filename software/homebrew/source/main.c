@@ -5,6 +5,7 @@
 
 #include <asndlib.h>
 #include <mp3player.h>
+#include <ogc/lwp_watchdog.h>
 #include <ogc/pad.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,6 +41,9 @@ void wiimotePowerPressed(s32 chan)
 
 int main(int argc, char **argv)
 {
+  // Time the startup, up to the first frame on screen
+  u64 launchTime  = gettime();
+  bool firstFrame = true;
 
   // Initialise the Graphics & Video subsystem
   GRRLIB_Init();
@@ -84,12 +88,16 @@ int main(int argc, char **argv)
     // Draw the menu
     drawMenu();
 
+    if (firstFrame) {
+      setStartupTime(diff_msec(launchTime, gettime()));
+      firstFrame = false;
+    }
+
     // Check if the power or reset button was pressed
     if (hardwareButton != -1)
       break;
   }
 
-  // GRRLIB_FreeTTF(myFont);
   GRRLIB_Exit(); // Be a good boy, clear the memory allocated by GRRLIB
 
   // Power off or return to the Wii menu
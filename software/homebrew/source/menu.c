@@ -6,17 +6,22 @@
  */
 
 #include <asndlib.h>
+#include <fat.h>
 #include <grrlib.h>
 #include <mp3player.h>
 #include <ogc/lwp_watchdog.h>
 #include <ogc/pad.h>
+#include <unistd.h>
 #include <wiiuse/wpad.h>
 
 #include "i2c/thundervolt.h"
+#include "i2c/thundervolt_boot.h"
 
 #include "assets.h"
+#include "font.h"
 #include "input.h"
 #include "menu.h"
+#include "texture.h"
 
 // UI colors
 enum color {
@@ -50,18 +55,15 @@ static const int COL_END   = 550;
 static const int COL_START = COL_END - COL_WIDTH;
 static const int COL_MID   = COL_START + COL_WIDTH / 2;
 
-// Font
-static GRRLIB_ttfFont *myFont = NULL;
-
 // Textures
-static GRRLIB_texImg *logo      = NULL;
-static GRRLIB_texImg *note      = NULL;
-static GRRLIB_texImg *arrow     = NULL;
-static GRRLIB_texImg *cursor    = NULL;
-static GRRLIB_texImg *bullet    = NULL;
-static GRRLIB_texImg *toggleOn  = NULL;
-static GRRLIB_texImg *toggleOff = NULL;
-static GRRLIB_texImg *icon      = NULL;
+static texture logo;
+static texture note;
+static texture arrow;
+static texture cursor;
+static texture bullet;
+static texture toggleOn;
+static texture toggleOff;
+static texture icon;
 
 // Menu state
 static menu *prevMenu               = NULL;
@@ -253,6 +255,7 @@ int dummy(menu *self, uint8_t action)
 int enterUndervoltMenu(menu *self, uint8_t action);
 int enterOvertempMenu(menu *self, uint8_t action);
 int enterCreditsMenu(menu *self, uint8_t action);
+int updateFirmware(menu *self, uint8_t action);
 
 // Menu entries
 static menu mainMenu[] = {
@@ -264,6 +267,7 @@ static menu mainMenu[] = {
     {"configure overtemp protection", 0, 1, 1, 0, 1, 1, 7, white, enterOvertempMenu},
     {"power monitor                ", 0, 1, 0, 0, 1, 1, 8, grey, dummy},
     {"stress test                  ", 0, 1, 0, 0, 1, 1, 9, grey, dummy},
+    {"update firmware              ", 0, 1, 1, 0, 1, 1, 10, white, updateFirmware},
     {"credits                      ", 0, 1, 1, 0, 1, 1, 11, white, enterCreditsMenu},
     {"exit                         ", 2, 1, 1, 0, 1, 1, 12, white, exitToPad},
 };
@@ -390,14 +394,106 @@ static menu creditsMenu[] = {
     {"music by ShockSlayer         ", 4, 1, 0, 0, 1, 1, 6, white, dummy},
     {"thundervolt firmware by loopj", 4, 1, 0, 0, 1, 1, 8, white, dummy},
     {"thundervolt hardware designed by YveltalGriffin", 4, 1, 0, 0, 1, 1, 10, white, dummy},
+    {"[startup time]               ", 4, 1, 0, 0, 1, 1, 11, grey, dummy},
     {"back                         ", 2, 1, 1, 1, 1, 1, 12, white, exitSubmenu},
 };
 
+void setStartupTime(uint32_t ms)
+{
+  snprintf(creditsMenu[8].name, 50, "%s%u%s", "launch to first frame: ", (unsigned)ms, " ms");
+}
+
 int enterCreditsMenu(menu *self, uint8_t action)
 {
   return enterSubmenu(creditsMenu, sizeof(creditsMenu) / sizeof(menu));
 }
 
+//
+// Firmware update
+//
+
+// Firmware image on the SD card, see "Firmware updates" in the README
+#define FIRMWARE_PATH "sd:/thundervolt/firmware.bin"
+
+// Largest image that fits the Thundervolt's flash
+#define FIRMWARE_MAX_SIZE (16 * 1024)
+
+static uint64_t prevProgressTime = 0;
+
+// Redraw the menu with the update progress, a few times a second so it doesn't slow the transfer down
+void showUpdateProgress(uint8_t stage, uint16_t done, uint16_t total, void *ctx)
+{
+  menu *self = (menu *)ctx;
+
+  u64 now = gettime();
+  if (done != total && diff_msec(prevProgressTime, now) < 100)
+    return;
+
+  const char *stageName = stage == THUNDERVOLT_BOOT_STAGE_BACKUP ? "backing up" :
+                          stage == THUNDERVOLT_BOOT_STAGE_WRITE  ? "writing" :
+                                                                   "restoring";
+  snprintf(self->name, 50, "%s %d/%d", stageName, done, total);
+
+  drawMenu();
+  prevProgressTime = now;
+}
+
+int updateFirmware(menu *self, uint8_t action)
+{
+  playSound(enter_raw, enter_raw_size);
+
+  // Read the new image from the SD card
+  FILE *file = NULL;
+  if (fatInitDefault())
+    file = fopen(FIRMWARE_PATH, "rb");
+
+  if (!file) {
+    snprintf(self->name, 50, "no %s", FIRMWARE_PATH + 3);
+    return 1;
+  }
+
+  uint8_t *image = malloc(FIRMWARE_MAX_SIZE);
+  size_t len     = image ? fread(image, 1, FIRMWARE_MAX_SIZE, file) : 0;
+  fclose(file);
+
+  if (len == 0) {
+    free(image);
+    snprintf(self->name, 50, "firmware.bin unreadable");
+    return 1;
+  }
+
+  // Hand over to the bootloader, the application isn't on the bus until the update is finished
+  bool wasPresent    = thundervoltPresent;
+  thundervoltPresent = false;
+
+  u64 start = gettime();
+  int rcode = thundervolt_boot_enter();
+  if (rcode == 0)
+    rcode = thundervolt_boot_update(image, len, showUpdateProgress, self);
+
+  u32 elapsed = diff_msec(start, gettime());
+  free(image);
+
+  if (rcode == 0 || rcode == -THUNDERVOLT_BOOT_ERR_RESTORED) {
+    if (rcode == 0) {
+      snprintf(self->name, 50, "updated in %u ms (%u B/s)", elapsed, elapsed ? (u32)(len * 1000 / elapsed) : 0);
+    } else {
+      snprintf(self->name, 50, "update failed, restored");
+    }
+
+    // Show the result, then start the installed firmware, which power cycles the console
+    drawMenu();
+    sleep(2);
+    thundervolt_boot_start_app();
+  } else {
+    // Without a valid image the bootloader stays on the bus, so the update can be retried
+    snprintf(self->name, 50, "update failed (%d)", rcode);
+    thundervoltPresent = wasPresent && thundervolt_is_present();
+  }
+
+  return 1;
+}
+
 const char *getHardwareName(uint8_t hw_variant)
 {
   switch (hw_variant) {
@@ -415,17 +511,17 @@ const char *getHardwareName(uint8_t hw_variant)
 void setupMenu()
 {
   // Load font
-  myFont = GRRLIB_LoadTTF(Glass_TTY_VT220_ttf, Glass_TTY_VT220_ttf_size);
+  setupFont();
 
   // Load textures
-  logo      = GRRLIB_LoadTexture(tv_png);
-  note      = GRRLIB_LoadTexture(note_png);
-  arrow     = GRRLIB_LoadTexture(arrow_png);
-  cursor    = GRRLIB_LoadTexture(cursor_png);
-  bullet    = GRRLIB_LoadTexture(bullet_png);
-  toggleOn  = GRRLIB_LoadTexture(toggle_on_png);
-  toggleOff = GRRLIB_LoadTexture(toggle_off_png);
-  icon      = GRRLIB_LoadTexture(dolphin_png);
+  loadTexture(&logo, tv_tex, tv_tex_size);
+  loadTexture(&note, note_tex, note_tex_size);
+  loadTexture(&arrow, arrow_tex, arrow_tex_size);
+  loadTexture(&cursor, cursor_tex, cursor_tex_size);
+  loadTexture(&bullet, bullet_tex, bullet_tex_size);
+  loadTexture(&toggleOn, toggle_on_tex, toggle_on_tex_size);
+  loadTexture(&toggleOff, toggle_off_tex, toggle_off_tex_size);
+  loadTexture(&icon, dolphin_tex, dolphin_tex_size);
 
   // set up main menu
   currentMenu       = mainMenu;
@@ -485,7 +581,13 @@ void setupMenu()
     mainMenu[5].color      = grey;
     mainMenu[5].selectable = false;
 
-    mainMenu[8].selected = true;
+    // a board left in its bootloader can still be updated
+    if (!thundervolt_boot_is_present()) {
+      mainMenu[8].color      = grey;
+      mainMenu[8].selectable = false;
+    }
+
+    mainMenu[9].selected = true;
   }
 }
 
@@ -557,11 +659,11 @@ void drawMenu()
   GRRLIB_Rectangle(50, 40, 540, 380, 0x000000C8, true);
 
   // draw the logo
-  GRRLIB_DrawImg(73, 58, logo, 0, 1, 1, white);
+  drawTexture(73, 58, &logo, false, white);
 
 #if defined(DOLPHIN)
   // draw dolphin mode icon
-  GRRLIB_DrawImg(280, 69, icon, 0, 1, 1, white);
+  drawTexture(280, 69, &icon, false, white);
 #endif
 
   // update the board temp periodically
@@ -572,6 +674,19 @@ void drawMenu()
       snprintf(mainMenu[2].name, 50, "%s%.2f%s", "board temp: ", temp, "°C");
       snprintf(overtempMenu[1].name, 50, "%s%.2f%s", "current temperature:                   ", temp, "°C");
 
+      // warn about latched regulator faults in place of the safe mode status, which can't change while running
+      uint8_t faults[THUNDERVOLT_RAIL_3V3 + 1];
+      if (thundervolt_get_regulator_faults(faults) == 0) {
+        static const char *railNames[] = {"1.0V", "1.15V", "1.8V", "3.3V"};
+        for (int i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++) {
+          if (faults[i]) {
+            snprintf(mainMenu[1].name, 50, "%s%s%s%02x%s", "regulator fault: ", railNames[i], " (", faults[i], ")");
+            mainMenu[1].color = yellow;
+            break;
+          }
+        }
+      }
+
       prevTempTime = now;
     }
   }
@@ -584,7 +699,7 @@ void drawMenu()
     menu *entry = &currentMenu[n];
 
     // draw the entry name
-    GRRLIB_PrintfTTF(85, 120 + entry->index * 20, myFont, entry->name, 20, entry->color);
+    drawText(85, 120 + entry->index * 20, entry->name, entry->color);
 
     // draw toggle menu entries
     if (entry->type == TOGGLE) {
@@ -595,8 +710,8 @@ void drawMenu()
       }
 
       // draw toggle switch
-      GRRLIB_texImg *img = entry->value ? toggleOn : toggleOff;
-      GRRLIB_DrawImg(COL_MID - img->w / 2, 125 + entry->index * 20, img, 0, 1, 1, dirty ? yellow : white);
+      texture *img = entry->value ? &toggleOn : &toggleOff;
+      drawTexture(COL_MID - img->w / 2, 125 + entry->index * 20, img, false, dirty ? yellow : white);
     }
 
     // draw adjustable menu entries
@@ -605,12 +720,12 @@ void drawMenu()
 
       // if value is not min, draw left arrow
       if (!limits || entry->value > limits->min) {
-        GRRLIB_DrawImg(COL_START, 123 + entry->index * 20, arrow, 0, 1, 1, white);
+        drawTexture(COL_START, 123 + entry->index * 20, &arrow, false, white);
       }
 
       // if value is not max, draw right arrow
       if (!limits || entry->value < limits->max) {
-        GRRLIB_DrawImg(COL_END, 123 + entry->index * 20, arrow, 0, -1, 1, white);
+        drawTexture(COL_END, 123 + entry->index * 20, &arrow, true, white);
       }
 
       // hardcode "dirty" comparison for now
@@ -632,27 +747,27 @@ void drawMenu()
       }
 
       // draw value text
-      u32 textWidth = GRRLIB_WidthTTF(myFont, valueStr, 20);
-      GRRLIB_PrintfTTF(COL_MID - textWidth / 2, 120 + entry->index * 20, myFont, valueStr, 20, dirty ? yellow : white);
+      u32 textWidth = getTextWidth(valueStr);
+      drawText(COL_MID - textWidth / 2, 120 + entry->index * 20, valueStr, dirty ? yellow : white);
     }
 
     // draw bullet points on credits menu
     if (currentMenu == creditsMenu && (entry->index > 2 && entry->index < 6)) {
-      GRRLIB_DrawImg(82, 126 + entry->index * 20, bullet, 0, 1, 1, white);
+      drawTexture(82, 126 + entry->index * 20, &bullet, false, white);
     }
 
     // draw cursor
     if (entry->selected) {
-      GRRLIB_DrawImg(60, 126 + entry->index * 20, cursor, 0, 1, 1, yellow);
+      drawTexture(60, 126 + entry->index * 20, &cursor, false, yellow);
     }
   }
 
   // now playing indicator / URL
   if (currentMenu == creditsMenu) {
-    GRRLIB_PrintfTTF(390, 360, myFont, "visit thundervo.lt!", 20, yellow);
+    drawText(390, 360, "visit thundervo.lt!", yellow);
   } else {
-    GRRLIB_DrawImg(420, 380, note, 0, 1, 1, white); // Draw a png
-    GRRLIB_PrintfTTF(450, 380, myFont, "Enough Blocks", 20, white);
+    drawTexture(420, 380, &note, false, white);
+    drawText(450, 380, "Enough Blocks", white);
   }
 
   // send the frame buffer to the screen
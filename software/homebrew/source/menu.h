@@ -40,4 +40,6 @@ void setupMenu(void);
 
 int handleMenuInput(void);
 
-void drawMenu(void);
\ No newline at end of file
+void drawMenu(void);
+
+void setStartupTime(uint32_t ms);
\ No newline at end of file
@@ -1,21 +1,37 @@
-#include <stdlib.h>
 #include <time.h>
 
 #include <grrlib.h>
 #include <ogc/gx.h>
+#include <ogc/lwp_watchdog.h>
+#include <ogc/video.h>
+
+#include "rain_sim.h"
 
 #define NUM_DROPS           600 // Defines rain density
+#define MIN_DROPS           100 // Never thin the rain out below this
 #define MAX_THUNDER_OPACITY 100 // More is too brutal
 
-typedef struct {
-  int x, y;
-  int dx, dy;
-} Rain;
+// Frame time budget, the rain backs off when the frame overruns or it takes more than its share
+#define RAIN_BUDGET_US      500 // CPU time for the rain, a small fraction of the frame
+#define FIELD_US_60HZ       16683
+#define FIELD_US_50HZ       20000
+
+// Drops as structure-of-arrays, so pairs of drops can be moved with paired-single instructions
+static f32 dropX[NUM_DROPS] ATTRIBUTE_ALIGN(32);
+static f32 dropY[NUM_DROPS] ATTRIBUTE_ALIGN(32);
+static f32 dropDX[NUM_DROPS] ATTRIBUTE_ALIGN(32);
+static f32 dropDY[NUM_DROPS] ATTRIBUTE_ALIGN(32);
 
-static Rain drops[NUM_DROPS];
+// xorshift32 state, never 0
+static u32 rngState = 1;
 
-static u16 k      = 0;
-static u32 ndrops = 1;
+static u16 k         = 0;
+static u32 ndrops    = 1;
+static u32 dropLimit = NUM_DROPS;
+
+// Frame timing, for adapting the drop count
+static u64 prevFrameTime = 0;
+static u32 rainUs        = 0;
 
 static bool thunderOn = false;
 static int thunder    = 1;
@@ -23,58 +39,77 @@ static int thAlpha    = MAX_THUNDER_OPACITY;
 
 void setupRain()
 {
-  srand(time(NULL));
+  rngState = time(NULL) | 1;
   for (k = 0; k < NUM_DROPS; k++) {
     // random place
-    drops[k].x = rand() % (640 - 5);
-    drops[k].y = -(rand() % 480); // rain drops are loaded above the screen
-    // horizontal speed always set to 1, vertical speed between 4 and 6
-    drops[k].dx = 1;
-    drops[k].dy = (rand() & 2) + 3;
+    dropX[k] = xorshift32(&rngState) % (640 - 5);
+    dropY[k] = -(f32)(xorshift32(&rngState) % 480); // rain drops are loaded above the screen
+    // horizontal speed always set to 1, vertical speed either 3 or 5
+    dropDX[k] = 1;
+    dropDY[k] = (xorshift32(&rngState) & 2) + 3;
   }
 }
 
+// Adapt the drop count to the measured frame time
+// Back off quickly when the frame overruns or the rain goes over budget, and recover a drop per frame
+static void adaptRain(u64 now)
+{
+  if (prevFrameTime) {
+    u32 fieldUs = VIDEO_GetCurrentTvMode() == VI_PAL ? FIELD_US_50HZ : FIELD_US_60HZ;
+    u32 frameUs = diff_usec(prevFrameTime, now);
+
+    if (frameUs > fieldUs + fieldUs / 2 || rainUs > RAIN_BUDGET_US) {
+      dropLimit -= dropLimit / 4;
+      if (dropLimit < MIN_DROPS)
+        dropLimit = MIN_DROPS;
+    } else if (dropLimit < NUM_DROPS) {
+      dropLimit++;
+    }
+  }
+  prevFrameTime = now;
+
+  if (ndrops < dropLimit)
+    ndrops++;
+  else
+    ndrops = dropLimit;
+}
+
 void drawRain()
 {
-  // rain background
-  for (k = 0; k < ndrops; k++) { // Draw all drops
-    drops[k].x += drops[k].dx;
-    drops[k].y += drops[k].dy;
+  u64 start = gettime();
+  adaptRain(start);
+
+  // rain background, all the drops go in a single batch to keep the command FIFO overhead down
+  stepDrops(dropX, dropDX, ndrops);
+  stepDrops(dropY, dropDY, ndrops);
 
+  GX_Begin(GX_LINES, GX_VTXFMT0, 2 * ndrops);
+  for (k = 0; k < ndrops; k++) {
     // check for collision with the screen boundaries
-    if (drops[k].x > 640)
-      drops[k].x -= 640;
+    if (dropX[k] > 640)
+      dropX[k] -= 640;
 
-    if (drops[k].y > 480) {
-      drops[k].x = rand() % (640 - 5);
-      drops[k].y -= 480;
+    if (dropY[k] > 480) {
+      dropX[k] = xorshift32(&rngState) % (640 - 5);
+      dropY[k] -= 480;
     }
 
-    if (drops[k].dy > 3) {
-      GX_Begin(GX_LINES, GX_VTXFMT0, 2);
-      GX_Position3f32(drops[k].x, drops[k].y, 0.0f);
-      GX_Color1u32(0xffffff00);
-      GX_Position3f32(drops[k].x + 3, drops[k].y + 10, 0.0f);
-      GX_Color1u32(0xffffff80);
-      GX_End();
-    } else {
-      GX_Begin(GX_LINES, GX_VTXFMT0, 2);
-      GX_Position3f32(drops[k].x, drops[k].y, 0.0f);
-      GX_Color1u32(0xffffff00);
-      GX_Position3f32(drops[k].x + 3, drops[k].y + 10, 0.0f);
-      GX_Color1u32(0xffffffff);
-      GX_End();
-    }
+    // faster drops have a fainter tail
+    GX_Position3f32(dropX[k], dropY[k], 0.0f);
+    GX_Color1u32(0xffffff00);
+    GX_Position3f32(dropX[k] + 3, dropY[k] + 10, 0.0f);
+    GX_Color1u32(dropDY[k] > 3 ? 0xffffff80 : 0xffffffff);
   }
-  if (ndrops < NUM_DROPS)
-    ndrops++;
+  GX_End();
+
+  rainUs = diff_usec(start, gettime());
 
   // thunder effect
   if (thunder == 55)
     thunderOn = true;
 
   else if (!thunderOn) {
-    thunder = rand() % 500; // Probability of 1/200 per frame to hit thunder
+    thunder = xorshift32(&rngState) % 500; // Probability of 1/200 per frame to hit thunder
     thAlpha = MAX_THUNDER_OPACITY;
   }
 
@@ -84,7 +119,7 @@ void drawRain()
       thAlpha -= 5;
     else {
       thunderOn = false;
-      thunder   = rand() % 200;
+      thunder   = xorshift32(&rngState) % 200;
     }
   }
 }
\ No newline at end of file
@@ -0,0 +1,28 @@
+/*
+ * Rain simulation
+ *
+ * See rain_sim.h
+ *
+ */
+
+#include "rain_sim.h"
+
+// The paired-single and scalar versions both do IEEE single precision adds, so their results are bit-identical
+void stepDrops(float *pos, const float *vel, uint32_t n)
+{
+  uint32_t i = 0;
+#if defined(GEKKO)
+  // two drops per instruction, GQR0 is set up by libogc for unscaled floats
+  for (; i + 2 <= n; i += 2) {
+    asm volatile("psq_l 0, 0(%0), 0, 0\n"
+                 "psq_l 1, 0(%1), 0, 0\n"
+                 "ps_add 0, 0, 1\n"
+                 "psq_st 0, 0(%0), 0, 0\n"
+                 :
+                 : "b"(&pos[i]), "b"(&vel[i])
+                 : "fr0", "fr1", "memory");
+  }
+#endif
+  for (; i < n; i++)
+    pos[i] += vel[i];
+}
@@ -0,0 +1,26 @@
+/*
+ * Rain simulation
+ *
+ * The drop movement and random numbers for the rain, kept free of libogc so the host tests can
+ * build them. Everything that draws the rain stays in rain.c.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Cheap random numbers for the rain, libc's rand() is far slower than this needs
+// The state must never be 0
+static inline uint32_t xorshift32(uint32_t *state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+// Add the velocities to the positions, pos[i] += vel[i]
+// On the Wii pairs of drops are moved with paired-single instructions, so pos and vel must be 8 byte aligned
+void stepDrops(float *pos, const float *vel, uint32_t n);
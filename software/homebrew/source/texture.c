@@ -0,0 +1,59 @@
+/*
+ * Texture
+ *
+ * Draws the textures converted to GX formats at build time by tools/tex_convert. They're used
+ * in place from the linked data, so nothing is decoded or copied at startup
+ *
+ */
+
+#include <grrlib.h>
+#include <ogc/cache.h>
+#include <ogc/gx.h>
+
+#include "gx_texture.h"
+#include "texture.h"
+
+void loadTexture(texture *tex, const u8 *data, u32 size)
+{
+  const struct gx_texture_header *header = (const struct gx_texture_header *)data;
+  void *texels                           = (void *)(data + header->data_offset);
+
+  // bin2o aligns the data to 32 bytes, and the converter aligns the texels within it, so GX can read them in place
+  DCFlushRange(texels, size - header->data_offset);
+
+  GX_InitTexObj(&tex->obj, texels, header->width, header->height, header->format, GX_CLAMP, GX_CLAMP, GX_FALSE);
+  tex->w = header->width;
+  tex->h = header->height;
+}
+
+void drawTexture(f32 x, f32 y, const texture *tex, bool mirror, u32 color)
+{
+  GX_LoadTexObj((GXTexObj *)&tex->obj, GX_TEXMAP0);
+  GX_SetTevOp(GX_TEVSTAGE0, GX_MODULATE);
+  GX_SetVtxDesc(GX_VA_TEX0, GX_DIRECT);
+
+  // mirroring flips the texture horizontally in place, like GRRLIB_DrawImg with a scale of -1
+  f32 s0 = mirror ? 1.0f : 0.0f;
+  f32 s1 = mirror ? 0.0f : 1.0f;
+
+  GX_Begin(GX_QUADS, GX_VTXFMT0, 4);
+  GX_Position3f32(x, y, 0.0f);
+  GX_Color1u32(color);
+  GX_TexCoord2f32(s0, 0.0f);
+
+  GX_Position3f32(x + tex->w, y, 0.0f);
+  GX_Color1u32(color);
+  GX_TexCoord2f32(s1, 0.0f);
+
+  GX_Position3f32(x + tex->w, y + tex->h, 0.0f);
+  GX_Color1u32(color);
+  GX_TexCoord2f32(s1, 1.0f);
+
+  GX_Position3f32(x, y + tex->h, 0.0f);
+  GX_Color1u32(color);
+  GX_TexCoord2f32(s0, 1.0f);
+  GX_End();
+
+  GX_SetTevOp(GX_TEVSTAGE0, GX_PASSCLR);
+  GX_SetVtxDesc(GX_VA_TEX0, GX_NONE);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <gccore.h>
+
+typedef struct texture_s texture;
+
+struct texture_s {
+  GXTexObj obj;
+  u16 w;
+  u16 h;
+};
+
+void loadTexture(texture *tex, const u8 *data, u32 size);
+void drawTexture(f32 x, f32 y, const texture *tex, bool mirror, u32 color);
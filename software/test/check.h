@@ -0,0 +1,42 @@
+/*
+ * Minimal checks for the host tests
+ *
+ * Each failed check prints its location and is counted, and CHECK_DONE() returns non-zero
+ * from main() if any of them failed, so the whole test binary runs even after a failure.
+ *
+ */
+
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+
+static int check_failures = 0;
+
+#define CHECK(cond)                                                                                                    \
+  do {                                                                                                                 \
+    if (!(cond)) {                                                                                                     \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                                         \
+      check_failures++;                                                                                                \
+    }                                                                                                                  \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                                                                     \
+  do {                                                                                                                 \
+    long long a_ = (actual), e_ = (expected);                                                                          \
+    if (a_ != e_) {                                                                                                    \
+      fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_);                      \
+      check_failures++;                                                                                                \
+    }                                                                                                                  \
+  } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                                                        \
+  do {                                                                                                                 \
+    double a_ = (actual), e_ = (expected);                                                                             \
+    if (fabs(a_ - e_) > (tolerance)) {                                                                                 \
+      fprintf(stderr, "%s:%d: %s is %g, expected %g\n", __FILE__, __LINE__, #actual, a_, e_);                          \
+      check_failures++;                                                                                                \
+    }                                                                                                                  \
+  } while (0)
+
+#define CHECK_DONE() (check_failures ? (fprintf(stderr, "%d checks failed\n", check_failures), 1) : 0)
@@ -0,0 +1,13 @@
+/*
+ * Host stand-in for avr-libc's util/atomic.h
+ *
+ * The host tests are single threaded, so an atomic block just runs its body once.
+ *
+ */
+
+#pragma once
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+
+#define ATOMIC_BLOCK(type) for (int atomic_once_ = 1; atomic_once_; atomic_once_ = 0)
@@ -0,0 +1,18 @@
+/*
+ * Host stand-in for avr-libc's util/delay.h
+ *
+ * The fake devices in the host tests respond instantly, so there is nothing to wait for.
+ *
+ */
+
+#pragma once
+
+static inline void _delay_ms(double ms)
+{
+  (void)ms;
+}
+
+static inline void _delay_us(double us)
+{
+  (void)us;
+}
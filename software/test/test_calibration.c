@@ -0,0 +1,233 @@
+/*
+ * Host test of the rail setpoint calibration
+ *
+ * Runs the calibration against fake Thundervolt 2 regulators and INA700s on the I2C bus, through
+ * the real regulator and INA700 drivers. Each rail's output is modelled with its own offset and
+ * gain error, so the test checks both the fit and the setpoints the calibration programs.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "calibration.h"
+#include "check.h"
+#include "i2c.h"
+#include "i2c/ina700.h"
+#include "i2c/thundervolt.h"
+#include "i2c/tps6286x.h"
+#include "i2c/tps6381x.h"
+
+#define NUM_RAILS (THUNDERVOLT_RAIL_3V3 + 1)
+
+// Thundervolt 2 regulator addresses, by rail
+static const uint8_t REG_ADDR[NUM_RAILS] = {0x42, 0x43, 0x41, TPS6381X_I2C_ADDR};
+
+// Regulator setpoint resolution, by rail, in mV
+static const uint8_t STEP[NUM_RAILS] = {TPS6286X_VOUT_STEP, TPS6286X_VOUT_STEP, TPS6286X_VOUT_STEP * 2,
+                                        TPS6381X_VOUT_RESOLUTION};
+
+// Fake device registers, by I2C address
+static uint8_t regs[0x80][0x100];
+
+// Output model for each rail, in the same terms as the calibration: the output is the
+// setpoint + offset + gain * (setpoint - stock) / 1000, plus a disturbance at one setpoint
+// to bend the sweep away from a straight line
+struct rail_model {
+  float offset;
+  float gain;
+  uint16_t bent_setpoint;
+  float bend;
+};
+
+static struct rail_model model[NUM_RAILS];
+
+// Measurement noise added to successive INA700 readings, spread across one LSB so the averaged
+// readings resolve the output to better than an LSB, like the noise on a real rail
+static const float NOISE[] = {-1.17f, 0.39f, -0.39f, 1.17f};
+static uint8_t readings = 0;
+
+static uint16_t get_setpoint(uint8_t rail)
+{
+  uint8_t vout = regs[REG_ADDR[rail]][rail == THUNDERVOLT_RAIL_3V3 ? TPS6381X_REG_VOUT1 : TPS6286X_REG_VOUT1];
+
+  switch (rail) {
+    case THUNDERVOLT_RAIL_1V8:
+      return (vout * TPS6286X_VOUT_STEP + TPS6286X_VOUT_BASE) * 2;
+    case THUNDERVOLT_RAIL_3V3:
+      return vout * TPS6381X_VOUT_RESOLUTION + TPS6381X_VOUT_START_LOW;
+    default:
+      return vout * TPS6286X_VOUT_STEP + TPS6286X_VOUT_BASE;
+  }
+}
+
+static float get_output(uint8_t rail)
+{
+  uint16_t min, stock;
+  thundervolt_get_voltage_range(rail, &min, &stock);
+
+  uint16_t setpoint = get_setpoint(rail);
+  float output      = setpoint + model[rail].offset + model[rail].gain * (setpoint - stock) / 1000;
+  if (setpoint == model[rail].bent_setpoint)
+    output += model[rail].bend;
+
+  return output;
+}
+
+int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
+{
+  if (addr >= 0x80 || msgs[0].len < 1)
+    return -I2C_ERR;
+
+  uint8_t reg = msgs[0].buf[0];
+
+  // Register write
+  if (num_msgs == 1) {
+    for (uint32_t i = 1; i < msgs[0].len; i++)
+      regs[addr][reg + i - 1] = msgs[0].buf[i];
+    return 0;
+  }
+
+  // INA700 bus voltage, measured from the rail model, big-endian like the real one
+  if (addr >= INA700_I2C_ADDR_START && addr <= INA700_I2C_ADDR_END && reg == INA700_REG_VBUS) {
+    float noise    = NOISE[readings++ % (sizeof(NOISE) / sizeof(NOISE[0]))];
+    uint16_t raw   = lroundf((get_output(addr - INA700_I2C_ADDR_START) + noise) * 1000 / 3125);
+    msgs[1].buf[0] = raw >> 8;
+    msgs[1].buf[1] = raw & 0xFF;
+    return 0;
+  }
+
+  for (uint32_t i = 0; i < msgs[1].len; i++)
+    msgs[1].buf[i] = regs[addr][reg + i];
+
+  return 0;
+}
+
+static void reset(void)
+{
+  static const struct thundervolt_calibration uncalibrated = {0, 0};
+
+  memset(regs, 0, sizeof(regs));
+  memset(model, 0, sizeof(model));
+  for (uint8_t i = 0; i < NUM_RAILS; i++)
+    thundervolt_set_calibration(i, &uncalibrated);
+}
+
+static void test_accepted()
+{
+  static const struct rail_model errors[NUM_RAILS] = {
+      {.offset = -8, .gain = 10},
+      {.offset = 12, .gain = -15},
+      {.offset = 18, .gain = 30},
+      {.offset = 15, .gain = 0},
+  };
+
+  reset();
+  memcpy(model, errors, sizeof(model));
+
+  for (uint8_t i = 0; i < NUM_RAILS; i++) {
+    uint16_t min, stock;
+    thundervolt_get_voltage_range(i, &min, &stock);
+
+    struct thundervolt_calibration cal;
+    CHECK_EQ(calibration_run(i, &cal), 0);
+    CHECK_NEAR(cal.offset, errors[i].offset, 1);
+    CHECK_NEAR(cal.gain, errors[i].gain, 5);
+
+    // The rail is back at stock, with the calibration applied, to within half a regulator step and the fit
+    CHECK_NEAR(get_output(i), stock, STEP[i] / 2 + 2);
+
+    // Calibrated setpoints land on the requested voltage anywhere in the range
+    CHECK_EQ(thundervolt_set_voltage(i, min + 100), 0);
+    CHECK_NEAR(get_output(i), min + 100, STEP[i] / 2 + 2);
+  }
+}
+
+static void test_rejected()
+{
+  struct thundervolt_calibration cal;
+
+  // Offset out of range, the sweep reads 40mV high everywhere
+  reset();
+  model[THUNDERVOLT_RAIL_1V0].offset = 40;
+  CHECK_EQ(calibration_run(THUNDERVOLT_RAIL_1V0, &cal), -CALIBRATION_ERR_RANGE);
+
+  // The rail is back at stock, with its raw setpoint
+  CHECK_EQ(get_setpoint(THUNDERVOLT_RAIL_1V0), THUNDERVOLT_STOCK_VOLTAGE_1V0);
+
+  // Gain out of range
+  reset();
+  model[THUNDERVOLT_RAIL_1V15].gain = 80;
+  CHECK_EQ(calibration_run(THUNDERVOLT_RAIL_1V15, &cal), -CALIBRATION_ERR_RANGE);
+  CHECK_EQ(get_setpoint(THUNDERVOLT_RAIL_1V15), THUNDERVOLT_STOCK_VOLTAGE_1V15);
+
+  // One point of the sweep well off the line, the offset and gain alone would be accepted
+  reset();
+  model[THUNDERVOLT_RAIL_1V0].offset        = -5;
+  model[THUNDERVOLT_RAIL_1V0].bent_setpoint = 950;
+  model[THUNDERVOLT_RAIL_1V0].bend          = -20;
+  CHECK_EQ(calibration_run(THUNDERVOLT_RAIL_1V0, &cal), -CALIBRATION_ERR_FIT);
+  CHECK_EQ(get_setpoint(THUNDERVOLT_RAIL_1V0), THUNDERVOLT_STOCK_VOLTAGE_1V0);
+
+  // A rejected fit leaves the raw setpoints in use
+  CHECK_EQ(thundervolt_set_voltage(THUNDERVOLT_RAIL_1V0, 900), 0);
+  CHECK_EQ(get_setpoint(THUNDERVOLT_RAIL_1V0), 900);
+}
+
+static void test_fit()
+{
+  struct thundervolt_calibration cal = {1, 2};
+
+  // Every point at the same setpoint, there's no gain to fit
+  const float flat_x[]     = {0, 0, 0, 0};
+  const float flat_error[] = {3, 3, 3, 3};
+  CHECK_EQ(calibration_fit(flat_x, flat_error, 4, &cal), -CALIBRATION_ERR_FIT);
+  CHECK_EQ(cal.offset, 1);
+  CHECK_EQ(cal.gain, 2);
+
+  // An exact line, offset -7.4mV and a gain of 12/1000
+  const float x[]     = {0, -50, -100, -150};
+  const float error[] = {-7.4f, -8.0f, -8.6f, -9.2f};
+  CHECK_EQ(calibration_fit(x, error, 4, &cal), 0);
+  CHECK_EQ(cal.offset, -7);
+  CHECK_EQ(cal.gain, 12);
+
+  // The limits themselves are accepted
+  const float edge_error[] = {CALIBRATION_MAX_OFFSET_MV, CALIBRATION_MAX_OFFSET_MV, CALIBRATION_MAX_OFFSET_MV,
+                              CALIBRATION_MAX_OFFSET_MV};
+  CHECK_EQ(calibration_fit(x, edge_error, 4, &cal), 0);
+  CHECK_EQ(cal.offset, CALIBRATION_MAX_OFFSET_MV);
+  CHECK_EQ(cal.gain, 0);
+}
+
+static void test_clamped_setpoints()
+{
+  // Calibration registers at their extremes, from a corrupted EEPROM for example
+  reset();
+  struct thundervolt_calibration low = {-127, -127};
+  thundervolt_set_calibration(THUNDERVOLT_RAIL_1V0, &low);
+
+  // Stock would need a setpoint of 1127mV, which is clamped to one trim above stock
+  CHECK_EQ(thundervolt_set_voltage(THUNDERVOLT_RAIL_1V0, THUNDERVOLT_STOCK_VOLTAGE_1V0), 0);
+  CHECK_EQ(get_setpoint(THUNDERVOLT_RAIL_1V0), THUNDERVOLT_STOCK_VOLTAGE_1V0 + THUNDERVOLT_CAL_MAX_TRIM);
+
+  struct thundervolt_calibration high = {127, 127};
+  thundervolt_set_calibration(THUNDERVOLT_RAIL_1V0, &high);
+  CHECK_EQ(thundervolt_set_voltage(THUNDERVOLT_RAIL_1V0, THUNDERVOLT_MIN_VOLTAGE_1V0), 0);
+  CHECK_EQ(get_setpoint(THUNDERVOLT_RAIL_1V0), THUNDERVOLT_MIN_VOLTAGE_1V0 - THUNDERVOLT_CAL_MAX_TRIM);
+
+  // Same on the 3.3V rail, whose regulator has 25mV steps
+  thundervolt_set_calibration(THUNDERVOLT_RAIL_3V3, &low);
+  CHECK_EQ(thundervolt_set_voltage(THUNDERVOLT_RAIL_3V3, THUNDERVOLT_STOCK_VOLTAGE_3V3), 0);
+  CHECK_EQ(get_setpoint(THUNDERVOLT_RAIL_3V3), THUNDERVOLT_STOCK_VOLTAGE_3V3 + THUNDERVOLT_CAL_MAX_TRIM);
+}
+
+int main()
+{
+  test_accepted();
+  test_rejected();
+  test_fit();
+  test_clamped_setpoints();
+
+  return CHECK_DONE();
+}
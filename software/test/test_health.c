@@ -0,0 +1,129 @@
+/*
+ * Host test of the regulator health polling
+ *
+ * Runs the poll against fake Thundervolt 2 regulators on the I2C bus, through the real regulator
+ * drivers. The fake STATUS registers clear when they're read, like the real ones, so a fault can
+ * only be seen by the poll that reads it.
+ *
+ */
+
+#include <string.h>
+
+#include "check.h"
+#include "health.h"
+#include "i2c.h"
+#include "i2c/thundervolt.h"
+#include "i2c/tps6286x.h"
+#include "i2c/tps6381x.h"
+
+#define NUM_RAILS (THUNDERVOLT_RAIL_3V3 + 1)
+#define ALL_RAILS ((1 << NUM_RAILS) - 1)
+
+// Thundervolt 2 regulator addresses, by rail
+static const uint8_t REG_ADDR[NUM_RAILS] = {0x42, 0x43, 0x41, TPS6381X_I2C_ADDR};
+
+// Fake regulator STATUS registers, by rail
+static uint8_t status_reg[NUM_RAILS];
+
+// Error returned by each rail's regulator, 0 to respond normally
+static int fail[NUM_RAILS];
+
+int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
+{
+  for (uint8_t i = 0; i < NUM_RAILS; i++) {
+    if (addr != REG_ADDR[i])
+      continue;
+    if (fail[i])
+      return fail[i];
+
+    uint8_t reg = msgs[0].buf[0];
+    if (num_msgs != 2 || reg != (i == THUNDERVOLT_RAIL_3V3 ? TPS6381X_REG_STATUS : TPS6286X_REG_STATUS))
+      return -I2C_ERR;
+
+    // Reading STATUS clears the faults, the TPS6381x power-good bit follows the output
+    msgs[1].buf[0] = status_reg[i];
+    status_reg[i] &= i == THUNDERVOLT_RAIL_3V3 ? TPS6381X_PG : 0;
+    return 0;
+  }
+
+  return -I2C_ERR;
+}
+
+static void reset(void)
+{
+  memset(fail, 0, sizeof(fail));
+  memset(status_reg, 0, sizeof(status_reg));
+  status_reg[THUNDERVOLT_RAIL_3V3] = TPS6381X_PG;
+}
+
+static void test_healthy()
+{
+  uint8_t health[NUM_RAILS], addrs[NUM_RAILS], status[NUM_RAILS];
+
+  reset();
+  CHECK_EQ(health_poll(health, addrs, status), ALL_RAILS);
+  for (uint8_t i = 0; i < NUM_RAILS; i++) {
+    CHECK_EQ(health[i], 0);
+    CHECK_EQ(addrs[i], REG_ADDR[i]);
+  }
+}
+
+static void test_faults()
+{
+  uint8_t health[NUM_RAILS], addrs[NUM_RAILS], status[NUM_RAILS];
+
+  reset();
+  status_reg[THUNDERVOLT_RAIL_1V0]  = TPS6286X_THERM;
+  status_reg[THUNDERVOLT_RAIL_1V15] = TPS6286X_HICCUP;
+  status_reg[THUNDERVOLT_RAIL_3V3]  = TPS6381X_TSD;
+
+  CHECK_EQ(health_poll(health, addrs, status), ALL_RAILS);
+  CHECK_EQ(health[THUNDERVOLT_RAIL_1V0], THUNDERVOLT_HEALTH_THERM);
+  CHECK_EQ(status[THUNDERVOLT_RAIL_1V0], TPS6286X_THERM);
+  CHECK_EQ(health[THUNDERVOLT_RAIL_1V15], THUNDERVOLT_HEALTH_HICCUP);
+  CHECK_EQ(health[THUNDERVOLT_RAIL_1V8], 0);
+  CHECK_EQ(health[THUNDERVOLT_RAIL_3V3], THUNDERVOLT_HEALTH_THERM | THUNDERVOLT_HEALTH_PG_LOST);
+
+  // The faults were cleared by the read, the poll is the only chance to latch them
+  CHECK_EQ(health_poll(health, addrs, status), ALL_RAILS);
+  CHECK_EQ(health[THUNDERVOLT_RAIL_1V0], 0);
+  CHECK_EQ(health[THUNDERVOLT_RAIL_1V15], 0);
+}
+
+static void test_rail_fails()
+{
+  uint8_t health[NUM_RAILS], addrs[NUM_RAILS], status[NUM_RAILS];
+
+  // A lost arbitration on the 1.8V rail, after the faults on the rails before it have been read and cleared
+  reset();
+  status_reg[THUNDERVOLT_RAIL_1V0]  = TPS6286X_UVLO;
+  status_reg[THUNDERVOLT_RAIL_1V15] = TPS6286X_THERM;
+  status_reg[THUNDERVOLT_RAIL_1V8]  = TPS6286X_HICCUP;
+  fail[THUNDERVOLT_RAIL_1V8]        = -I2C_ERR_ARBLOST;
+
+  // Only the failed rail is skipped, the faults already read are returned, and the rail after it is still read
+  CHECK_EQ(health_poll(health, addrs, status), ALL_RAILS & ~(1 << THUNDERVOLT_RAIL_1V8));
+  CHECK_EQ(health[THUNDERVOLT_RAIL_1V0], THUNDERVOLT_HEALTH_UVLO);
+  CHECK_EQ(health[THUNDERVOLT_RAIL_1V15], THUNDERVOLT_HEALTH_THERM);
+  CHECK_EQ(health[THUNDERVOLT_RAIL_3V3], 0);
+
+  // The skipped rail keeps its fault for the next poll
+  fail[THUNDERVOLT_RAIL_1V8] = 0;
+  CHECK_EQ(health_poll(health, addrs, status), ALL_RAILS);
+  CHECK_EQ(health[THUNDERVOLT_RAIL_1V8], THUNDERVOLT_HEALTH_HICCUP);
+
+  // A regulator that doesn't respond is a fault of its own, not a failed read
+  reset();
+  fail[THUNDERVOLT_RAIL_1V8] = -I2C_ERR;
+  CHECK_EQ(health_poll(health, addrs, status), ALL_RAILS);
+  CHECK_EQ(health[THUNDERVOLT_RAIL_1V8], THUNDERVOLT_HEALTH_NO_RESPONSE);
+}
+
+int main()
+{
+  test_healthy();
+  test_faults();
+  test_rail_fails();
+
+  return CHECK_DONE();
+}
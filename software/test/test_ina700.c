@@ -0,0 +1,150 @@
+/*
+ * Host test of the INA700 register conversions
+ *
+ * The I2C bus is replaced by a fake INA700, which returns the raw register values set by the test.
+ *
+ */
+
+#include <string.h>
+
+#include "check.h"
+#include "i2c.h"
+#include "i2c/ina700.h"
+
+#define ADDR 0x44
+
+// Fake INA700 registers, big-endian on the bus like the real one
+static uint32_t regs[0x40];
+static int bus_error = 0;
+
+int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
+{
+  if (bus_error)
+    return bus_error;
+
+  // Register reads are always a one byte write of the register address, then the read
+  if (addr != ADDR || num_msgs != 2 || msgs[0].len != 1 || !(msgs[1].flags & I2C_MSG_READ))
+    return -I2C_ERR;
+
+  uint32_t value = regs[msgs[0].buf[0]];
+  for (uint32_t i = 0; i < msgs[1].len; i++)
+    msgs[1].buf[i] = value >> (8 * (msgs[1].len - 1 - i));
+
+  return 0;
+}
+
+static void test_bus_voltage()
+{
+  uint16_t voltage;
+
+  // 3.125mV per LSB, 320 * 3125 doesn't fit in a 16-bit int
+  regs[INA700_REG_VBUS] = 320;
+  CHECK_EQ(ina700_get_bus_voltage(ADDR, &voltage), 0);
+  CHECK_EQ(voltage, 1000);
+
+  regs[INA700_REG_VBUS] = 1056;
+  CHECK_EQ(ina700_get_bus_voltage(ADDR, &voltage), 0);
+  CHECK_EQ(voltage, 3300);
+
+  regs[INA700_REG_VBUS] = 289;
+  CHECK_EQ(ina700_get_bus_voltage(ADDR, &voltage), 0);
+  CHECK_EQ(voltage, 903);
+
+  // Largest voltage that fits in the result
+  regs[INA700_REG_VBUS] = 20971;
+  CHECK_EQ(ina700_get_bus_voltage(ADDR, &voltage), 0);
+  CHECK_EQ(voltage, 65534);
+}
+
+static void test_temp()
+{
+  float temp;
+
+  // 125m°C per LSB, signed in bits 15:4
+  regs[INA700_REG_DIETEMP] = 200 << 4;
+  CHECK_EQ(ina700_get_temp(ADDR, &temp), 0);
+  CHECK_NEAR(temp, 25.0, 0.001);
+
+  regs[INA700_REG_DIETEMP] = (1000 << 4) | 0xF;
+  CHECK_EQ(ina700_get_temp(ADDR, &temp), 0);
+  CHECK_NEAR(temp, 125.0, 0.001);
+
+  regs[INA700_REG_DIETEMP] = (uint16_t)(-320 * 16);
+  CHECK_EQ(ina700_get_temp(ADDR, &temp), 0);
+  CHECK_NEAR(temp, -40.0, 0.001);
+
+  regs[INA700_REG_DIETEMP] = (uint16_t)(-1 * 16);
+  CHECK_EQ(ina700_get_temp(ADDR, &temp), 0);
+  CHECK_NEAR(temp, -0.125, 0.001);
+}
+
+static void test_current()
+{
+  uint16_t current;
+
+  // 480uA per LSB
+  regs[INA700_REG_CURRENT] = 2084;
+  CHECK_EQ(ina700_get_current(ADDR, &current), 0);
+  CHECK_EQ(current, 1000);
+
+  regs[INA700_REG_CURRENT] = 100;
+  CHECK_EQ(ina700_get_current(ADDR, &current), 0);
+  CHECK_EQ(current, 48);
+
+  regs[INA700_REG_CURRENT] = 31250;
+  CHECK_EQ(ina700_get_current(ADDR, &current), 0);
+  CHECK_EQ(current, 15000);
+}
+
+static void test_power()
+{
+  uint32_t power;
+
+  // 96uW per LSB, 24-bit register
+  regs[INA700_REG_POWER] = 10417;
+  CHECK_EQ(ina700_get_power(ADDR, &power), 0);
+  CHECK_EQ(power, 1000032);
+
+  // Every byte with its top bit set, so a sign-extended byte would show up in the result
+  regs[INA700_REG_POWER] = 0x818283;
+  CHECK_EQ(ina700_get_power(ADDR, &power), 0);
+  CHECK_EQ(power, 0x818283UL * 96);
+
+  regs[INA700_REG_POWER] = 0xFFFFFF;
+  CHECK_EQ(ina700_get_power(ADDR, &power), 0);
+  CHECK_EQ(power, 0xFFFFFFUL * 96);
+}
+
+static void test_errors()
+{
+  uint16_t voltage = 1234;
+  uint32_t power   = 5678;
+
+  regs[INA700_REG_MANUFACTURER_ID] = INA700_MANFID;
+  CHECK(ina700_is_present(ADDR));
+  CHECK(!ina700_is_present(ADDR + 1));
+
+  regs[INA700_REG_MANUFACTURER_ID] = 0x1234;
+  CHECK(!ina700_is_present(ADDR));
+
+  // Errors are passed through, without touching the result
+  bus_error = -I2C_ERR_ARBLOST;
+  CHECK_EQ(ina700_get_bus_voltage(ADDR, &voltage), -I2C_ERR_ARBLOST);
+  CHECK_EQ(voltage, 1234);
+  CHECK_EQ(ina700_get_power(ADDR, &power), -I2C_ERR_ARBLOST);
+  CHECK_EQ(power, 5678);
+  bus_error = 0;
+}
+
+int main()
+{
+  memset(regs, 0, sizeof(regs));
+
+  test_bus_voltage();
+  test_temp();
+  test_current();
+  test_power();
+  test_errors();
+
+  return CHECK_DONE();
+}
@@ -0,0 +1,146 @@
+/*
+ * Host test of the rail voltage control
+ *
+ * Runs the rail control loop against stubbed regulators and power monitors, standing in for the
+ * Thundervolt driver, so the load-line compensation can be driven with any load current.
+ *
+ */
+
+#include "check.h"
+#include "i2c/thundervolt.h"
+#include "rails.h"
+
+#define NUM_RAILS (THUNDERVOLT_RAIL_3V3 + 1)
+
+// Stubbed regulator setpoints and rail currents, by rail
+static uint16_t setpoint[NUM_RAILS] = {
+    THUNDERVOLT_STOCK_VOLTAGE_1V0,
+    THUNDERVOLT_STOCK_VOLTAGE_1V15,
+    THUNDERVOLT_STOCK_VOLTAGE_1V8,
+    THUNDERVOLT_STOCK_VOLTAGE_3V3,
+};
+static uint16_t current[NUM_RAILS];
+
+int thundervolt_get_voltage_range(uint8_t rail, uint16_t *min, uint16_t *max)
+{
+  static const uint16_t MIN[NUM_RAILS]   = {THUNDERVOLT_MIN_VOLTAGE_1V0, THUNDERVOLT_MIN_VOLTAGE_1V15,
+                                            THUNDERVOLT_MIN_VOLTAGE_1V8, THUNDERVOLT_MIN_VOLTAGE_3V3};
+  static const uint16_t STOCK[NUM_RAILS] = {THUNDERVOLT_STOCK_VOLTAGE_1V0, THUNDERVOLT_STOCK_VOLTAGE_1V15,
+                                            THUNDERVOLT_STOCK_VOLTAGE_1V8, THUNDERVOLT_STOCK_VOLTAGE_3V3};
+  if (rail >= NUM_RAILS)
+    return -THUNDERVOLT_ERR_INVALID_RAIL;
+
+  *min = MIN[rail];
+  *max = STOCK[rail];
+  return 0;
+}
+
+int thundervolt_get_voltage(uint8_t rail, uint16_t *voltage)
+{
+  *voltage = setpoint[rail];
+  return 0;
+}
+
+int thundervolt_set_voltage(uint8_t rail, uint16_t voltage)
+{
+  uint16_t min, max;
+  thundervolt_get_voltage_range(rail, &min, &max);
+  if (voltage < min || voltage > max)
+    return -THUNDERVOLT_ERR_INVALID_VOLTAGE;
+
+  setpoint[rail] = voltage;
+  return 0;
+}
+
+int thundervolt_get_current(uint8_t rail, uint16_t *mA)
+{
+  *mA = current[rail];
+  return 0;
+}
+
+bool thundervolt_has_power_monitoring()
+{
+  return true;
+}
+
+// Run the rail control loop for a number of updates
+static void update(uint8_t count)
+{
+  while (count--)
+    rails_update();
+}
+
+static void test_raise()
+{
+  // The user's voltage is set at a 1A load
+  setpoint[THUNDERVOLT_RAIL_1V0] = 900;
+  current[THUNDERVOLT_RAIL_1V0]  = 1000;
+  rails_set_avp_gain(THUNDERVOLT_RAIL_1V0, 20);
+  update(1);
+  CHECK_EQ(setpoint[THUNDERVOLT_RAIL_1V0], 900);
+
+  // 2A more load raises the rail by 40mV, two regulator steps per update
+  current[THUNDERVOLT_RAIL_1V0] = 3000;
+  update(1);
+  CHECK_EQ(setpoint[THUNDERVOLT_RAIL_1V0], 910);
+  update(10);
+  CHECK_EQ(setpoint[THUNDERVOLT_RAIL_1V0], 940);
+
+  // Never above stock
+  current[THUNDERVOLT_RAIL_1V0] = 10000;
+  update(20);
+  CHECK_EQ(setpoint[THUNDERVOLT_RAIL_1V0], THUNDERVOLT_STOCK_VOLTAGE_1V0);
+
+  // The other rails are left at their voltages
+  CHECK_EQ(setpoint[THUNDERVOLT_RAIL_1V15], THUNDERVOLT_STOCK_VOLTAGE_1V15);
+}
+
+static void test_lower()
+{
+  // Back at the load the user's voltage was set at
+  current[THUNDERVOLT_RAIL_1V0] = 1000;
+  update(20);
+  CHECK_EQ(setpoint[THUNDERVOLT_RAIL_1V0], 900);
+
+  // Below it the rail is lowered, 1A less load takes 20mV off
+  current[THUNDERVOLT_RAIL_1V0] = 0;
+  update(1);
+  CHECK_EQ(setpoint[THUNDERVOLT_RAIL_1V0], 890);
+  update(10);
+  CHECK_EQ(setpoint[THUNDERVOLT_RAIL_1V0], 880);
+
+  // Corrections inside the deadband are ignored
+  current[THUNDERVOLT_RAIL_1V0] = 1200;
+  update(20);
+  CHECK_EQ(setpoint[THUNDERVOLT_RAIL_1V0], 900);
+}
+
+static void test_min()
+{
+  // A voltage set close to the minimum, the correction would take the rail 50mV below it
+  setpoint[THUNDERVOLT_RAIL_1V0] = THUNDERVOLT_MIN_VOLTAGE_1V0 + 10;
+  update(1);
+  current[THUNDERVOLT_RAIL_1V0] = 200;
+  rails_set_avp_gain(THUNDERVOLT_RAIL_1V0, 50);
+  update(20);
+  CHECK_EQ(setpoint[THUNDERVOLT_RAIL_1V0], THUNDERVOLT_MIN_VOLTAGE_1V0);
+
+  // Disabling the compensation returns the rail to the user's voltage
+  rails_set_avp_gain(THUNDERVOLT_RAIL_1V0, 0);
+  update(20);
+  CHECK_EQ(setpoint[THUNDERVOLT_RAIL_1V0], THUNDERVOLT_MIN_VOLTAGE_1V0 + 10);
+
+  // And hands the rails back, voltages written from elsewhere are then left alone
+  setpoint[THUNDERVOLT_RAIL_1V0] = 800;
+  update(20);
+  CHECK_EQ(setpoint[THUNDERVOLT_RAIL_1V0], 800);
+}
+
+int main()
+{
+  test_raise();
+  test_lower();
+  test_min();
+
+  return CHECK_DONE();
+}
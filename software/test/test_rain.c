@@ -0,0 +1,61 @@
+/*
+ * Host test of the rain simulation
+ *
+ * Checks the drop movement bit for bit against IEEE single precision sums, the same results the
+ * paired-single version gives on the Wii, and the random numbers against the reference xorshift32.
+ * The host build only has the scalar version, the paired-single one can only be checked on a Wii.
+ *
+ */
+
+#include <string.h>
+
+#include "check.h"
+#include "rain_sim.h"
+
+static uint32_t bits(float value)
+{
+  uint32_t b;
+  memcpy(&b, &value, sizeof(b));
+  return b;
+}
+
+static void test_step()
+{
+  // Sums that round in single precision, including ties to even, and an odd count so the last drop
+  // isn't part of a pair
+  float pos[8]                = {0.1f, 16777216.0f, 16777218.0f, 1e8f, -479.0f, 634.5f, -0.75f, 42.0f};
+  const float vel[8]          = {0.2f, 1.0f, 1.0f, 3.0f, 5.0f, 1.0f, 0.25f, 1.0f};
+  static const uint32_t sum[] = {0x3E99999A, 0x4B800000, 0x4B800002, 0x4CBEBC20,
+                                 0xC3ED0000, 0x441EE000, 0xBF000000};
+
+  stepDrops(pos, vel, 7);
+  for (uint8_t i = 0; i < 7; i++)
+    CHECK_EQ(bits(pos[i]), sum[i]);
+
+  // Drops past the count are left alone
+  CHECK_EQ(bits(pos[7]), bits(42.0f));
+
+  // Nothing to move
+  stepDrops(pos, vel, 0);
+  CHECK_EQ(bits(pos[0]), sum[0]);
+}
+
+static void test_xorshift()
+{
+  // Marsaglia's xorshift32 with shifts 13, 17, 5, starting from 1
+  static const uint32_t sequence[] = {0x00042021, 0x04080601, 0x9DCCA8C5, 0x1255994F, 0x8EF917D1};
+
+  uint32_t state = 1;
+  for (uint8_t i = 0; i < sizeof(sequence) / sizeof(sequence[0]); i++) {
+    CHECK_EQ(xorshift32(&state), sequence[i]);
+    CHECK_EQ(state, sequence[i]);
+  }
+}
+
+int main()
+{
+  test_step();
+  test_xorshift();
+
+  return CHECK_DONE();
+}
@@ -0,0 +1,230 @@
+/*
+ * Host test of the cooperative task scheduler
+ *
+ * The scheduler keeps its tasks in static slots that can't be freed, except by a one-shot running,
+ * so the tests run in order and share the slots, filling the last of them at the end.
+ *
+ */
+
+#include "check.h"
+
+// Included directly, so the tick can be started just short of wrapping
+#include "sched.c"
+
+static uint8_t periodic_runs, oneshot_runs, deferred_runs, filler_runs;
+
+static void periodic_fn()
+{
+  periodic_runs++;
+}
+
+static void oneshot_fn()
+{
+  oneshot_runs++;
+}
+
+static void deferred_fn()
+{
+  deferred_runs++;
+}
+
+static void filler_fn()
+{
+  filler_runs++;
+}
+
+// Reschedules itself until it has run three times
+static void repeat_fn()
+{
+  if (++oneshot_runs < 3)
+    CHECK(sched_after(5, repeat_fn) >= 0);
+}
+
+// Posts itself once, from inside sched_run
+static int8_t self_post_task = -1;
+static void self_post_fn()
+{
+  if (deferred_runs++ == 0)
+    sched_post(self_post_task);
+}
+
+// Run the main loop once per millisecond tick
+static void advance(uint16_t ms)
+{
+  while (ms--) {
+    sched_tick();
+    sched_run();
+  }
+}
+
+static void test_periodic()
+{
+  int8_t task = sched_every(10, periodic_fn);
+  CHECK_EQ(task, 0);
+
+  advance(9);
+  CHECK_EQ(periodic_runs, 0);
+  advance(1);
+  CHECK_EQ(periodic_runs, 1);
+  advance(30);
+  CHECK_EQ(periodic_runs, 4);
+
+  // A main loop held up past a deadline runs the task once, then restarts the period from now
+  for (uint8_t i = 0; i < 25; i++)
+    sched_tick();
+  sched_run();
+  CHECK_EQ(periodic_runs, 5);
+  advance(9);
+  CHECK_EQ(periodic_runs, 5);
+  advance(1);
+  CHECK_EQ(periodic_runs, 6);
+
+  // A period of 0 pauses the task, without freeing its slot
+  sched_set_period(task, 0);
+  advance(100);
+  CHECK_EQ(periodic_runs, 6);
+}
+
+static void test_oneshot()
+{
+  int8_t task = sched_after(5, oneshot_fn);
+  CHECK_EQ(task, 1);
+
+  advance(4);
+  CHECK_EQ(oneshot_runs, 0);
+  advance(1);
+  CHECK_EQ(oneshot_runs, 1);
+  advance(50);
+  CHECK_EQ(oneshot_runs, 1);
+
+  // The slot is freed before the task runs, so it can reschedule itself into the same slot
+  oneshot_runs = 0;
+  CHECK_EQ(sched_after(5, repeat_fn), task);
+  advance(14);
+  CHECK_EQ(oneshot_runs, 2);
+  advance(1);
+  CHECK_EQ(oneshot_runs, 3);
+  advance(50);
+  CHECK_EQ(oneshot_runs, 3);
+
+  // No delay runs on the next pass
+  oneshot_runs = 0;
+  CHECK_EQ(sched_after(0, oneshot_fn), task);
+  sched_run();
+  CHECK_EQ(oneshot_runs, 1);
+}
+
+static void test_deferred()
+{
+  int8_t task = sched_register(deferred_fn);
+  CHECK_EQ(task, 1);
+
+  // Deferred tasks never run on their own
+  advance(100);
+  CHECK_EQ(deferred_runs, 0);
+
+  // Posting several times before the task runs only runs it once
+  sched_post(task);
+  sched_post(task);
+  sched_post(task);
+  sched_run();
+  CHECK_EQ(deferred_runs, 1);
+  sched_run();
+  CHECK_EQ(deferred_runs, 1);
+
+  // A task posted while sched_run is running runs on the next pass
+  deferred_runs  = 0;
+  self_post_task = sched_register(self_post_fn);
+  CHECK_EQ(self_post_task, 2);
+  sched_post(self_post_task);
+  sched_run();
+  CHECK_EQ(deferred_runs, 1);
+  sched_run();
+  CHECK_EQ(deferred_runs, 2);
+  sched_run();
+  CHECK_EQ(deferred_runs, 2);
+
+  // Invalid handles, such as a failed registration, are ignored
+  deferred_runs = 0;
+  sched_post(-1);
+  sched_post(SCHED_MAX_TASKS);
+  sched_set_period(-1, 10);
+  sched_set_period(SCHED_MAX_TASKS, 10);
+  advance(20);
+  CHECK_EQ(deferred_runs, 0);
+  CHECK_EQ(periodic_runs, 6);
+}
+
+static void test_wraparound()
+{
+  // Start the tick just short of wrapping, the only timed tasks are the ones added here
+  millis = UINT32_MAX - 5;
+
+  int8_t task   = sched_every(4, periodic_fn);
+  periodic_runs = 0;
+  oneshot_runs  = 0;
+  CHECK_EQ(task, 3);
+
+  // Due after the tick wraps, a plain comparison would see it as overdue and run it straight away
+  CHECK_EQ(sched_after(10, oneshot_fn), 4);
+  sched_run();
+  CHECK_EQ(oneshot_runs, 0);
+
+  advance(4);
+  CHECK_EQ(periodic_runs, 1);
+  advance(4);
+  CHECK_EQ(periodic_runs, 2);
+  CHECK_EQ(sched_millis(), 2);
+
+  advance(1);
+  CHECK_EQ(oneshot_runs, 0);
+  advance(1);
+  CHECK_EQ(oneshot_runs, 1);
+
+  sched_set_period(task, 0);
+}
+
+static void test_full()
+{
+  // Fill the remaining slots, the last one is the top bit used in the posted word
+  int8_t task, last = -1;
+  uint8_t fillers = 0;
+  while ((task = sched_register(filler_fn)) >= 0) {
+    last = task;
+    fillers++;
+  }
+
+  CHECK_EQ(last, SCHED_MAX_TASKS - 1);
+  CHECK_EQ(fillers, SCHED_MAX_TASKS - 4);
+
+  // Every kind of task is refused once the slots are full
+  CHECK_EQ(sched_every(10, periodic_fn), -1);
+  CHECK_EQ(sched_after(10, oneshot_fn), -1);
+  CHECK_EQ(sched_register(deferred_fn), -1);
+
+  // Only the posted task runs
+  deferred_runs = 0;
+  sched_post(last);
+  sched_run();
+  CHECK_EQ(filler_runs, 1);
+  CHECK_EQ(deferred_runs, 0);
+
+  // Every slot can be posted at once
+  filler_runs = 0;
+  for (int8_t i = 0; i < SCHED_MAX_TASKS; i++)
+    sched_post(i);
+  sched_run();
+  CHECK_EQ(filler_runs, fillers);
+  CHECK_EQ(deferred_runs, 2);
+}
+
+int main()
+{
+  test_periodic();
+  test_oneshot();
+  test_deferred();
+  test_wraparound();
+  test_full();
+
+  return CHECK_DONE();
+}
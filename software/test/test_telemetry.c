@@ -0,0 +1,171 @@
+/*
+ * Host test of the telemetry history records
+ *
+ * The board power is read through the real INA700 conversions, from fake INA700s on the I2C bus,
+ * so the test covers the whole path from the power registers to the mW in the records.
+ *
+ */
+
+#include <string.h>
+
+#include "check.h"
+#include "fault_log.h"
+#include "i2c.h"
+#include "i2c/ina700.h"
+#include "i2c/thundervolt.h"
+#include "telemetry.h"
+
+// Fake INA700 power registers, one per rail
+static uint32_t power_regs[THUNDERVOLT_RAIL_3V3 + 1];
+static int power_error = 0;
+
+// Fake board temperature
+static float board_temp = 25.0f;
+static int8_t fault_temp;
+
+int i2c_transfer(uint8_t addr, struct i2c_msg *msgs, uint8_t num_msgs)
+{
+  uint8_t rail = addr - INA700_I2C_ADDR_START;
+  if (power_error || rail > THUNDERVOLT_RAIL_3V3 || num_msgs != 2 || msgs[0].buf[0] != INA700_REG_POWER)
+    return -I2C_ERR;
+
+  for (uint32_t i = 0; i < msgs[1].len; i++)
+    msgs[1].buf[i] = power_regs[rail] >> (8 * (msgs[1].len - 1 - i));
+
+  return 0;
+}
+
+bool thundervolt_has_power_monitoring()
+{
+  return true;
+}
+
+int thundervolt_get_power(uint8_t rail, uint32_t *power)
+{
+  return ina700_get_power(INA700_I2C_ADDR_START + rail, power);
+}
+
+int thundervolt_get_temp(float *temp)
+{
+  *temp = board_temp;
+  return 0;
+}
+
+void fault_log_set_temp(int8_t temp)
+{
+  fault_temp = temp;
+}
+
+static uint16_t record_word(uint8_t index, uint8_t offset)
+{
+  uint16_t base = index * THUNDERVOLT_HIST_RECORD_SIZE + offset;
+  return telemetry_read(base) | (telemetry_read(base + 1) << 8);
+}
+
+static void set_power_mw(uint32_t mw)
+{
+  // Split evenly between the rails, in 96uW steps
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++)
+    power_regs[i] = mw * 1000 / 4 / 96;
+}
+
+static void test_record()
+{
+  telemetry_set_samples_per_record(4);
+
+  // 10417 * 96uW is 1000.032mW per rail
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++)
+    power_regs[i] = 10417;
+
+  board_temp = 20.4f;
+  telemetry_sample();
+  CHECK_EQ(fault_temp, 20);
+
+  board_temp = 30.6f;
+  telemetry_sample();
+  CHECK_EQ(fault_temp, 31);
+
+  // Rails with every byte's top bit set, 0x808080 * 96uW is 808.5W per rail, so the total saturates
+  for (uint8_t i = THUNDERVOLT_RAIL_1V0; i <= THUNDERVOLT_RAIL_3V3; i++)
+    power_regs[i] = 0x808080;
+
+  board_temp = -5.5f;
+  telemetry_sample();
+  CHECK_EQ(fault_temp, -6);
+
+  set_power_mw(12000);
+  board_temp = 25.0f;
+  CHECK_EQ(telemetry_count(), 0);
+  telemetry_sample();
+  CHECK_EQ(telemetry_count(), 1);
+
+  CHECK_EQ((int8_t)telemetry_read(THUNDERVOLT_HIST_TEMP_MIN), -6);
+  CHECK_EQ((int8_t)telemetry_read(THUNDERVOLT_HIST_TEMP_MAX), 31);
+  CHECK_EQ((int8_t)telemetry_read(THUNDERVOLT_HIST_TEMP_AVG), (20 + 31 - 6 + 25) / 4);
+  CHECK_EQ(telemetry_read(THUNDERVOLT_HIST_SAMPLES), 4);
+  CHECK_EQ(record_word(0, THUNDERVOLT_HIST_POWER_MIN), 4000);
+  CHECK_EQ(record_word(0, THUNDERVOLT_HIST_POWER_MAX), 65535);
+  CHECK_EQ(record_word(0, THUNDERVOLT_HIST_POWER_AVG), (4000 + 4000 + 65535 + 12000) / 4);
+
+  // Past the newest record
+  CHECK_EQ(telemetry_read(THUNDERVOLT_HIST_RECORD_SIZE), 0);
+
+  telemetry_pop(1);
+  CHECK_EQ(telemetry_count(), 0);
+}
+
+static void test_skipped_samples()
+{
+  telemetry_set_samples_per_record(2);
+  set_power_mw(8000);
+
+  // A failed power read skips the whole sample, but still updates the fault log temperature
+  board_temp  = 60.0f;
+  power_error = 1;
+  telemetry_sample();
+  telemetry_sample();
+  CHECK_EQ(fault_temp, 60);
+  CHECK_EQ(telemetry_count(), 0);
+  power_error = 0;
+
+  // Temperatures past the int8 record are clamped
+  board_temp = 200.0f;
+  telemetry_sample();
+  CHECK_EQ(fault_temp, 127);
+  board_temp = 25.0f;
+  telemetry_sample();
+  CHECK_EQ(telemetry_count(), 1);
+  CHECK_EQ((int8_t)telemetry_read(THUNDERVOLT_HIST_TEMP_MAX), 127);
+  CHECK_EQ(record_word(0, THUNDERVOLT_HIST_POWER_MIN), 7999);
+
+  telemetry_pop(1);
+}
+
+static void test_fifo()
+{
+  telemetry_set_samples_per_record(1);
+
+  // Fill the FIFO past its length, the oldest records are dropped
+  for (int i = 0; i < TELEMETRY_HISTORY_LEN + 3; i++) {
+    board_temp = i;
+    telemetry_sample();
+  }
+
+  CHECK_EQ(telemetry_count(), TELEMETRY_HISTORY_LEN);
+  CHECK_EQ((int8_t)telemetry_read(THUNDERVOLT_HIST_TEMP_AVG), 3);
+  uint16_t newest = (TELEMETRY_HISTORY_LEN - 1) * THUNDERVOLT_HIST_RECORD_SIZE;
+  CHECK_EQ((int8_t)telemetry_read(newest + THUNDERVOLT_HIST_TEMP_AVG), TELEMETRY_HISTORY_LEN + 2);
+
+  // Popping more than are available empties it
+  telemetry_pop(TELEMETRY_HISTORY_LEN + 1);
+  CHECK_EQ(telemetry_count(), 0);
+}
+
+int main()
+{
+  test_record();
+  test_skipped_samples();
+  test_fifo();
+
+  return CHECK_DONE();
+}
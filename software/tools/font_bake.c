@@ -0,0 +1,197 @@
+/*
+ * Font atlas baker for the Thundervolt homebrew.
+ *
+ * Renders the glyphs the menus use from a TrueType font at a single pixel size,
+ * packs them into a GX_TF_IA8 texture, and writes the texture with the glyph
+ * metrics in the format from homebrew/source/font_atlas.h. The homebrew draws
+ * text as textured quads from the atlas, so FreeType never runs on the Wii.
+ *
+ * Build:  cc -O2 -I../homebrew/source -o font_bake font_bake.c `pkg-config freetype2 --cflags --libs`
+ * Usage:  ./font_bake Glass_TTY_VT220.ttf 20 font_atlas.bin
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "font_atlas.h"
+
+#define ATLAS_WIDTH 256
+#define MAX_GLYPHS  128
+
+// Printable ASCII, and the other characters the menus use
+static const uint16_t EXTRA_CHARS[] = {
+    0x00B0, // degree sign
+};
+
+static struct font_atlas_glyph glyphs[MAX_GLYPHS];
+static uint8_t *bitmaps[MAX_GLYPHS];
+static unsigned num_glyphs = 0;
+
+static void put_be16(uint8_t *buf, uint16_t value)
+{
+  buf[0] = value >> 8;
+  buf[1] = value & 0xFF;
+}
+
+static void put_be32(uint8_t *buf, uint32_t value)
+{
+  put_be16(buf, value >> 16);
+  put_be16(buf + 2, value & 0xFFFF);
+}
+
+// Render a glyph, keeping a copy of its coverage bitmap
+static int render_glyph(FT_Face face, uint16_t codepoint)
+{
+  FT_UInt index = FT_Get_Char_Index(face, codepoint);
+  if (!index) {
+    fprintf(stderr, "font has no glyph for U+%04X\n", codepoint);
+    return -1;
+  }
+
+  if (FT_Load_Glyph(face, index, FT_LOAD_RENDER) != 0) {
+    fprintf(stderr, "failed to render U+%04X\n", codepoint);
+    return -1;
+  }
+
+  FT_GlyphSlot slot = face->glyph;
+  FT_Bitmap *bitmap = &slot->bitmap;
+  if (bitmap->pixel_mode != FT_PIXEL_MODE_GRAY && bitmap->width) {
+    fprintf(stderr, "unsupported pixel mode for U+%04X\n", codepoint);
+    return -1;
+  }
+
+  struct font_atlas_glyph *glyph = &glyphs[num_glyphs];
+  glyph->codepoint               = codepoint;
+  glyph->w                       = bitmap->width;
+  glyph->h                       = bitmap->rows;
+  glyph->left                    = slot->bitmap_left;
+  glyph->top                     = slot->bitmap_top;
+  glyph->advance                 = slot->advance.x >> 6;
+
+  uint8_t *copy = calloc(1, bitmap->width * bitmap->rows + 1);
+  for (unsigned row = 0; row < bitmap->rows; row++)
+    memcpy(copy + row * bitmap->width, bitmap->buffer + row * bitmap->pitch, bitmap->width);
+  bitmaps[num_glyphs++] = copy;
+
+  return 0;
+}
+
+// Pack the glyphs into rows across the atlas, with a texel of padding between them
+// Returns the atlas height, rounded up to whole 4x4 tiles
+static unsigned pack_glyphs()
+{
+  unsigned x = 0, y = 0, row_height = 0;
+  for (unsigned i = 0; i < num_glyphs; i++) {
+    if (x + glyphs[i].w > ATLAS_WIDTH) {
+      x = 0;
+      y += row_height + 1;
+      row_height = 0;
+    }
+
+    glyphs[i].x = x;
+    glyphs[i].y = y;
+    x += glyphs[i].w + 1;
+    if (glyphs[i].h > row_height)
+      row_height = glyphs[i].h;
+  }
+
+  return (y + row_height + 3) & ~3u;
+}
+
+// Write the glyphs into the texture, swizzled into the 4x4 tiles of GX_TF_IA8
+// Each texel is alpha then intensity, the intensity is always white so the vertex color tints the text
+static void write_texture(uint8_t *tex)
+{
+  for (unsigned i = 0; i < num_glyphs; i++) {
+    for (unsigned gy = 0; gy < glyphs[i].h; gy++) {
+      for (unsigned gx = 0; gx < glyphs[i].w; gx++) {
+        unsigned x      = glyphs[i].x + gx;
+        unsigned y      = glyphs[i].y + gy;
+        unsigned tile   = (y / 4) * (ATLAS_WIDTH / 4) + x / 4;
+        unsigned offset = (tile * 16 + (y % 4) * 4 + x % 4) * 2;
+
+        tex[offset]     = bitmaps[i][gy * glyphs[i].w + gx];
+        tex[offset + 1] = 0xFF;
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (argc != 4) {
+    fprintf(stderr, "usage: %s <font.ttf> <size> <atlas.bin>\n", argv[0]);
+    return 1;
+  }
+
+  int size = atoi(argv[2]);
+  if (size <= 0 || size > 64) {
+    fprintf(stderr, "invalid size: %s\n", argv[2]);
+    return 1;
+  }
+
+  FT_Library library;
+  FT_Face face;
+  if (FT_Init_FreeType(&library) != 0 || FT_New_Face(library, argv[1], 0, &face) != 0) {
+    fprintf(stderr, "failed to load %s\n", argv[1]);
+    return 1;
+  }
+
+  // Same sizing as GRRLIB_PrintfTTF, so the text lines up as it did before
+  FT_Set_Pixel_Sizes(face, 0, size);
+
+  for (uint16_t c = 0x20; c < 0x7F; c++) {
+    if (render_glyph(face, c) < 0)
+      return 1;
+  }
+  for (unsigned i = 0; i < sizeof(EXTRA_CHARS) / sizeof(EXTRA_CHARS[0]); i++) {
+    if (render_glyph(face, EXTRA_CHARS[i]) < 0)
+      return 1;
+  }
+
+  unsigned height = pack_glyphs();
+  if (height > 1024) {
+    fprintf(stderr, "atlas too tall: %u\n", height);
+    return 1;
+  }
+
+  // Header, glyph table, then the texture data on a 32 byte boundary for GX
+  unsigned data_offset = (sizeof(struct font_atlas_header) + num_glyphs * sizeof(struct font_atlas_glyph) + 31) & ~31u;
+  unsigned total       = data_offset + ATLAS_WIDTH * height * 2;
+  uint8_t *out         = calloc(1, total);
+
+  put_be32(out, FONT_ATLAS_MAGIC);
+  put_be16(out + 4, ATLAS_WIDTH);
+  put_be16(out + 6, height);
+  out[8] = size;
+  out[9] = num_glyphs;
+  put_be16(out + 10, data_offset);
+
+  for (unsigned i = 0; i < num_glyphs; i++) {
+    uint8_t *entry = out + sizeof(struct font_atlas_header) + i * sizeof(struct font_atlas_glyph);
+    put_be16(entry, glyphs[i].codepoint);
+    put_be16(entry + 2, glyphs[i].x);
+    put_be16(entry + 4, glyphs[i].y);
+    entry[6]  = glyphs[i].w;
+    entry[7]  = glyphs[i].h;
+    entry[8]  = glyphs[i].left;
+    entry[9]  = glyphs[i].top;
+    entry[10] = glyphs[i].advance;
+  }
+
+  write_texture(out + data_offset);
+
+  FILE *file = fopen(argv[3], "wb");
+  if (!file || fwrite(out, 1, total, file) != total || fclose(file) != 0) {
+    fprintf(stderr, "failed to write %s\n", argv[3]);
+    return 1;
+  }
+
+  printf("%u glyphs, %ux%u atlas, %u bytes\n", num_glyphs, ATLAS_WIDTH, height, total);
+  return 0;
+}
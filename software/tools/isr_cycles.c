@@ -0,0 +1,412 @@
+/*
+ * Static worst case cycle count for the Thundervolt interrupt handlers.
+ *
+ * Reads the disassembly of a firmware build on stdin and follows every path
+ * through each named handler, including the functions it calls, adding up
+ * the cycle counts of the AVRxt instruction set. Each handler is checked
+ * against its budget from firmware/src/profile.h, so the budgets can be
+ * checked without hardware. Exits with 1 if any handler is over its budget,
+ * or a path can't be followed.
+ *
+ * The entry cycles (-e) are added to every handler, by default the interrupt
+ * response, the jump from the vector table and the COUNTERS_TIMED_ISR vector
+ * ahead of the handler body. Indirect calls can go to any of the functions
+ * given with -i, and every loop is taken to run -l times. A loop inside
+ * another loop is counted as if its body included the outer one's, so the
+ * result is an upper bound rather than an exact count.
+ *
+ * Build:  cc -O2 -o isr_cycles isr_cycles.c
+ * Usage:  avr-objdump -d firmware.elf | ./isr_cycles [-e cycles] [-l loops] [-i symbol]... handler=budget...
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SYMBOLS  4096
+#define MAX_INDIRECT 16
+
+// Cycles from the interrupt request to the handler body: response (5), vector table jump (3) and the
+// COUNTERS_TIMED_ISR vector (push, cli, lds, sts, lds, sei, sts, pop, jmp)
+#define DEFAULT_ENTRY_CYCLES (5 + 3 + 18)
+
+enum kind { PLAIN, RETURN, JUMP, INDIRECT_JUMP, CALL, INDIRECT_CALL, BRANCH, SKIP };
+
+struct insn {
+  uint32_t addr;
+  uint8_t size;
+  uint8_t cycles;
+  enum kind kind;
+  uint32_t target;
+  char mnemonic[8];
+};
+
+// The longest paths from an instruction, in cycles, or NONE if there is no such path
+#define NONE -1L
+struct path {
+  long ret;  // to the return from its function
+  long back; // to going back round a loop it is in
+};
+
+enum state { UNVISITED, IN_PROGRESS, DONE };
+
+static struct insn *insns = NULL;
+static size_t insn_count  = 0;
+
+// Worst case paths from each instruction, see cost
+static struct path *paths = NULL;
+static uint8_t *state     = NULL;
+static uint8_t *loop_head = NULL;
+
+static struct {
+  char name[64];
+  uint32_t addr;
+} symbols[MAX_SYMBOLS];
+static size_t symbol_count = 0;
+
+static uint32_t indirect[MAX_INDIRECT];
+static size_t indirect_count = 0;
+
+static long loops = 0;
+
+// Instruction timings on AVRxt, see the AVR instruction set manual
+static const struct {
+  const char *mnemonic;
+  uint8_t cycles;
+  enum kind kind;
+} TIMINGS[] = {
+    {"add", 1, PLAIN},             {"adc", 1, PLAIN},             {"sub", 1, PLAIN},
+    {"subi", 1, PLAIN},            {"sbc", 1, PLAIN},             {"sbci", 1, PLAIN},
+    {"and", 1, PLAIN},             {"andi", 1, PLAIN},            {"or", 1, PLAIN},
+    {"ori", 1, PLAIN},             {"eor", 1, PLAIN},             {"com", 1, PLAIN},
+    {"neg", 1, PLAIN},             {"inc", 1, PLAIN},             {"dec", 1, PLAIN},
+    {"tst", 1, PLAIN},             {"clr", 1, PLAIN},             {"ser", 1, PLAIN},
+    {"cp", 1, PLAIN},              {"cpc", 1, PLAIN},             {"cpi", 1, PLAIN},
+    {"mov", 1, PLAIN},             {"movw", 1, PLAIN},            {"ldi", 1, PLAIN},
+    {"in", 1, PLAIN},              {"out", 1, PLAIN},             {"lsl", 1, PLAIN},
+    {"lsr", 1, PLAIN},             {"rol", 1, PLAIN},             {"ror", 1, PLAIN},
+    {"asr", 1, PLAIN},             {"swap", 1, PLAIN},            {"bst", 1, PLAIN},
+    {"bld", 1, PLAIN},             {"sbi", 1, PLAIN},             {"cbi", 1, PLAIN},
+    {"sbr", 1, PLAIN},             {"cbr", 1, PLAIN},             {"bset", 1, PLAIN},
+    {"bclr", 1, PLAIN},            {"sec", 1, PLAIN},             {"clc", 1, PLAIN},
+    {"sen", 1, PLAIN},             {"cln", 1, PLAIN},             {"sez", 1, PLAIN},
+    {"clz", 1, PLAIN},             {"sei", 1, PLAIN},             {"cli", 1, PLAIN},
+    {"ses", 1, PLAIN},             {"cls", 1, PLAIN},             {"sev", 1, PLAIN},
+    {"clv", 1, PLAIN},             {"set", 1, PLAIN},             {"clt", 1, PLAIN},
+    {"seh", 1, PLAIN},             {"clh", 1, PLAIN},             {"nop", 1, PLAIN},
+    {"sleep", 1, PLAIN},           {"wdr", 1, PLAIN},             {"push", 1, PLAIN},
+    {"st", 1, PLAIN},              {"std", 1, PLAIN},             {"adiw", 2, PLAIN},
+    {"sbiw", 2, PLAIN},            {"mul", 2, PLAIN},             {"muls", 2, PLAIN},
+    {"mulsu", 2, PLAIN},           {"fmul", 2, PLAIN},            {"fmuls", 2, PLAIN},
+    {"fmulsu", 2, PLAIN},          {"ld", 2, PLAIN},              {"ldd", 2, PLAIN},
+    {"pop", 2, PLAIN},             {"sts", 2, PLAIN},             {"lds", 3, PLAIN},
+    {"lpm", 3, PLAIN},             {"elpm", 3, PLAIN},            {"ret", 4, RETURN},
+    {"reti", 4, RETURN},           {"rjmp", 2, JUMP},             {"jmp", 3, JUMP},
+    {"ijmp", 2, INDIRECT_JUMP},    {"eijmp", 2, INDIRECT_JUMP},   {"rcall", 2, CALL},
+    {"call", 3, CALL},             {"icall", 2, INDIRECT_CALL},   {"eicall", 3, INDIRECT_CALL},
+    {"cpse", 1, SKIP},             {"sbrc", 1, SKIP},             {"sbrs", 1, SKIP},
+    {"sbic", 1, SKIP},             {"sbis", 1, SKIP},
+};
+
+static void fail(const char *msg, uint32_t addr)
+{
+  fprintf(stderr, "0x%04X: %s\n", addr, msg);
+  exit(1);
+}
+
+static long find_insn(uint32_t addr)
+{
+  size_t lo = 0, hi = insn_count;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (insns[mid].addr < addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo < insn_count && insns[lo].addr == addr ? (long)lo : -1;
+}
+
+static long find_symbol(const char *name)
+{
+  for (size_t i = 0; i < symbol_count; i++) {
+    if (strcmp(symbols[i].name, name) == 0)
+      return symbols[i].addr;
+  }
+
+  return -1;
+}
+
+// Parse one instruction line, "  addr:\tbytes\tmnemonic\toperands ; 0xtarget <symbol>"
+static int parse_insn(const char *line, struct insn *insn)
+{
+  char *end;
+  insn->addr = strtoul(line, &end, 16);
+  if (end == line || *end != ':')
+    return -1;
+
+  const char *field = strchr(end, '\t');
+  if (!field)
+    return -1;
+
+  // Count the instruction bytes
+  const char *mnemonic = strchr(field + 1, '\t');
+  if (!mnemonic)
+    return -1;
+  insn->size = 0;
+  for (const char *p = field + 1; p + 1 < mnemonic; p++) {
+    if (isxdigit((unsigned char)p[0]) && isxdigit((unsigned char)p[1])) {
+      insn->size++;
+      p++;
+    }
+  }
+
+  mnemonic++;
+  size_t len = strcspn(mnemonic, "\t \n");
+  if (insn->size == 0 || len == 0 || len >= sizeof(insn->mnemonic))
+    return -1;
+  memcpy(insn->mnemonic, mnemonic, len);
+  insn->mnemonic[len] = '\0';
+
+  // Branches that aren't in the table are br followed by a condition, "break" is the only other br mnemonic
+  insn->kind   = PLAIN;
+  insn->cycles = 0;
+  for (size_t i = 0; i < sizeof(TIMINGS) / sizeof(TIMINGS[0]); i++) {
+    if (strcmp(TIMINGS[i].mnemonic, insn->mnemonic) == 0) {
+      insn->cycles = TIMINGS[i].cycles;
+      insn->kind   = TIMINGS[i].kind;
+    }
+  }
+  if (insn->cycles == 0 && strncmp(insn->mnemonic, "br", 2) == 0 && strcmp(insn->mnemonic, "break") != 0) {
+    insn->cycles = 1;
+    insn->kind   = BRANCH;
+  }
+
+  // Take the target from the comment, or the operand when there is no comment
+  insn->target          = 0;
+  const char *operands  = mnemonic + len;
+  const char *comment   = strstr(operands, "; 0x");
+  const char *immediate = strstr(operands, "0x");
+  if (comment)
+    insn->target = strtoul(comment + 2, NULL, 16);
+  else if (immediate)
+    insn->target = strtoul(immediate, NULL, 16);
+  else if ((operands = strchr(operands, '.')))
+    insn->target = insn->addr + insn->size + strtol(operands + 1, NULL, 0);
+
+  return 0;
+}
+
+static struct path cost(uint32_t addr);
+
+static struct path add(long cycles, struct path path)
+{
+  if (path.ret != NONE)
+    path.ret += cycles;
+  if (path.back != NONE)
+    path.back += cycles;
+  return path;
+}
+
+static struct path longest(struct path a, struct path b)
+{
+  if (b.ret > a.ret)
+    a.ret = b.ret;
+  if (b.back > a.back)
+    a.back = b.back;
+  return a;
+}
+
+// The worst case of a call, which has to return to continue the path
+static long call(uint32_t addr, uint32_t target)
+{
+  long cycles = cost(target).ret;
+  if (cycles == NONE)
+    fail("call that never returns, or is recursive", addr);
+  return cycles;
+}
+
+static struct path cost(uint32_t addr)
+{
+  long index = find_insn(addr);
+  if (index < 0)
+    fail("no instruction here, the path left the disassembly", addr);
+
+  // A path back to an instruction it has already been through goes round a loop, it is counted once the loop has
+  // been followed all the way round
+  if (state[index] == IN_PROGRESS) {
+    loop_head[index] = 1;
+    return (struct path){NONE, 0};
+  }
+  if (state[index] == DONE)
+    return paths[index];
+  state[index] = IN_PROGRESS;
+
+  const struct insn *insn = &insns[index];
+  uint32_t next           = insn->addr + insn->size;
+  struct path result      = {NONE, NONE};
+  long callee             = 0;
+  long skipped;
+
+  if (insn->cycles == 0)
+    fail("unknown instruction", addr);
+
+  switch (insn->kind) {
+  case PLAIN:
+    result = add(insn->cycles, cost(next));
+    break;
+  case RETURN:
+    result.ret = insn->cycles;
+    break;
+  case JUMP:
+    result = add(insn->cycles, cost(insn->target));
+    break;
+  case INDIRECT_JUMP:
+    fail("indirect jump, build with -fno-jump-tables so switches become branches", addr);
+    break;
+  case CALL:
+    callee = call(addr, insn->target);
+    result = add(insn->cycles + callee, cost(next));
+    break;
+  case INDIRECT_CALL:
+    if (indirect_count == 0)
+      fail("indirect call, give the functions it can call with -i", addr);
+    for (size_t i = 0; i < indirect_count; i++) {
+      long cycles = call(addr, indirect[i]);
+      if (cycles > callee)
+        callee = cycles;
+    }
+    result = add(insn->cycles + callee, cost(next));
+    break;
+  case BRANCH:
+    result = longest(add(insn->cycles, cost(next)), add(insn->cycles + 1, cost(insn->target)));
+    break;
+  case SKIP:
+    // Skipping takes one more cycle for each word skipped
+    skipped = find_insn(next);
+    if (skipped < 0)
+      fail("skip at the end of the disassembly", addr);
+    result = longest(add(insn->cycles, cost(next)),
+                     add(insn->cycles + insns[skipped].size / 2, cost(next + insns[skipped].size)));
+    break;
+  }
+
+  // At the start of a loop, the path back round it is the loop body. It runs up to the bound before leaving the
+  // loop, or going round an outer loop, which can also take in the whole body
+  if (loop_head[index] && result.back != NONE) {
+    if (loops == 0)
+      fail("loop, give the most times any loop runs with -l", addr);
+    long body = result.back;
+    if (result.ret != NONE)
+      result.ret += (loops - 1) * body;
+    result.back += (loops - 1) * body;
+  }
+
+  state[index] = DONE;
+  paths[index] = result;
+  return result;
+}
+
+static int compare_insns(const void *a, const void *b)
+{
+  const struct insn *x = a, *y = b;
+  return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned long entry = DEFAULT_ENTRY_CYCLES;
+  char *indirect_names[MAX_INDIRECT];
+  int arg = 1;
+
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (arg + 1 >= argc)
+      break;
+    if (strcmp(argv[arg], "-e") == 0) {
+      entry = strtoul(argv[++arg], NULL, 0);
+    } else if (strcmp(argv[arg], "-l") == 0) {
+      loops = strtol(argv[++arg], NULL, 0);
+    } else if (strcmp(argv[arg], "-i") == 0 && indirect_count < MAX_INDIRECT) {
+      indirect_names[indirect_count++] = argv[++arg];
+    } else {
+      break;
+    }
+  }
+
+  if (arg >= argc) {
+    fprintf(stderr, "usage: %s [-e cycles] [-l loops] [-i symbol]... handler=budget...\n", argv[0]);
+    return 1;
+  }
+
+  // Read the symbols and instructions
+  char line[512];
+  size_t capacity = 0;
+  while (fgets(line, sizeof(line), stdin)) {
+    unsigned long addr;
+    char name[64];
+    struct insn insn;
+
+    if (sscanf(line, "%lx <%63[^>]>:", &addr, name) == 2) {
+      if (symbol_count < MAX_SYMBOLS) {
+        strcpy(symbols[symbol_count].name, name);
+        symbols[symbol_count++].addr = addr;
+      }
+    } else if (parse_insn(line, &insn) == 0) {
+      if (insn_count == capacity) {
+        capacity = capacity ? capacity * 2 : 1024;
+        insns    = realloc(insns, capacity * sizeof(*insns));
+        if (!insns) {
+          fprintf(stderr, "out of memory\n");
+          return 1;
+        }
+      }
+      insns[insn_count++] = insn;
+    }
+  }
+
+  qsort(insns, insn_count, sizeof(*insns), compare_insns);
+  paths     = calloc(insn_count, sizeof(*paths));
+  state     = calloc(insn_count, sizeof(*state));
+  loop_head = calloc(insn_count, sizeof(*loop_head));
+  if (insn_count == 0 || !paths || !state || !loop_head) {
+    fprintf(stderr, "no instructions, expected the output of avr-objdump -d\n");
+    return 1;
+  }
+
+  for (size_t i = 0; i < indirect_count; i++) {
+    long addr = find_symbol(indirect_names[i]);
+    if (addr < 0) {
+      fprintf(stderr, "%s: no such symbol\n", indirect_names[i]);
+      return 1;
+    }
+    indirect[i] = addr;
+  }
+
+  // Check the handlers
+  int over = 0;
+  for (; arg < argc; arg++) {
+    char *budget = strchr(argv[arg], '=');
+    if (!budget) {
+      fprintf(stderr, "%s: expected handler=budget\n", argv[arg]);
+      return 1;
+    }
+    *budget++ = '\0';
+
+    long addr = find_symbol(argv[arg]);
+    if (addr < 0) {
+      fprintf(stderr, "%s: no such symbol\n", argv[arg]);
+      return 1;
+    }
+
+    unsigned long cycles = entry + call(addr, addr);
+    unsigned long limit  = strtoul(budget, NULL, 0);
+    printf("%s: %lu cycles, budget %lu%s\n", argv[arg], cycles, limit, cycles > limit ? ", over" : "");
+    if (cycles > limit)
+      over = 1;
+  }
+
+  return over;
+}
@@ -0,0 +1,230 @@
+/*
+ * Decoder for the Thundervolt UART telemetry stream.
+ *
+ * Reads frames from a serial port (or stdin) and writes them to stdout as CSV,
+ * one row per frame, and one row per register write. CRC errors and gaps in
+ * the sequence numbers are reported on stderr.
+ *
+ * Build:  cc -O2 -I../common/include -o stream_decode stream_decode.c ../common/src/crc8.c
+ * Usage:  ./stream_decode /dev/ttyUSB0 > telemetry.csv
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "crc8.h"
+#include "thundervolt_stream.h"
+
+#define FRAME_MAX (THUNDERVOLT_STREAM_OVERHEAD + THUNDERVOLT_STREAM_MAX_PAYLOAD)
+
+static const char *RAILS[] = {"1v0", "1v15", "1v8", "3v3"};
+
+// Stream statistics
+static unsigned long frames   = 0;
+static unsigned long lost     = 0;
+static unsigned long crc_errs = 0;
+
+static int last_seq = -1;
+
+static uint16_t get_word(const uint8_t *payload, uint8_t offset)
+{
+  return payload[offset] | (payload[offset + 1] << 8);
+}
+
+static uint32_t get_time(const uint8_t *payload)
+{
+  return get_word(payload, THUNDERVOLT_STREAM_TIME) | ((uint32_t)get_word(payload, THUNDERVOLT_STREAM_TIME + 2) << 16);
+}
+
+// Put a serial port into raw mode at the stream's baud rate
+static int configure_port(int fd)
+{
+  struct termios tio;
+  if (tcgetattr(fd, &tio) < 0)
+    return -1;
+
+  cfmakeraw(&tio);
+  cfsetispeed(&tio, B115200);
+  cfsetospeed(&tio, B115200);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cc[VMIN]  = 1;
+  tio.c_cc[VTIME] = 0;
+
+  return tcsetattr(fd, TCSANOW, &tio);
+}
+
+static void print_header()
+{
+  printf("frame,seq,time_ms,temp_c");
+  for (int i = 0; i < 4; i++) printf(",vout_%s", RAILS[i]);
+  for (int i = 0; i < 4; i++) printf(",vbus_%s", RAILS[i]);
+  for (int i = 0; i < 4; i++) printf(",current_%s", RAILS[i]);
+  printf(",dropped,reg,value,otsd_limit\n");
+}
+
+// Print a voltage or current column, empty if the firmware couldn't read it
+static void print_reading(const uint8_t *payload, uint8_t offset)
+{
+  uint16_t value = get_word(payload, offset);
+  if (value != THUNDERVOLT_STREAM_NO_READING) {
+    printf(",%u", value);
+  } else {
+    printf(",");
+  }
+}
+
+static void print_sample(uint8_t seq, const uint8_t *payload, uint8_t len)
+{
+  if (len < THUNDERVOLT_STREAM_SAMPLE_SIZE)
+    return;
+
+  int16_t temp = get_word(payload, THUNDERVOLT_STREAM_SAMPLE_TEMP);
+
+  printf("sample,%u,%u,", seq, get_time(payload));
+  if (temp != INT16_MIN)
+    printf("%.2f", temp / 100.0);
+
+  for (int i = 0; i < 4; i++) print_reading(payload, THUNDERVOLT_STREAM_SAMPLE_VOUT + i * 2);
+
+  // The INA700 readings are only sent on hardware with power monitoring
+  for (int i = 0; i < 4; i++) {
+    if (len >= THUNDERVOLT_STREAM_SAMPLE_SIZE_PM) {
+      print_reading(payload, THUNDERVOLT_STREAM_SAMPLE_VBUS + i * 2);
+    } else {
+      printf(",");
+    }
+  }
+  for (int i = 0; i < 4; i++) {
+    if (len >= THUNDERVOLT_STREAM_SAMPLE_SIZE_PM) {
+      print_reading(payload, THUNDERVOLT_STREAM_SAMPLE_CURRENT + i * 2);
+    } else {
+      printf(",");
+    }
+  }
+
+  printf(",%u,,,\n", payload[THUNDERVOLT_STREAM_SAMPLE_DROPPED]);
+}
+
+static void handle_frame(const uint8_t *frame)
+{
+  uint8_t type           = frame[THUNDERVOLT_STREAM_TYPE_OFS];
+  uint8_t seq            = frame[THUNDERVOLT_STREAM_SEQ_OFS];
+  uint8_t len            = frame[THUNDERVOLT_STREAM_LEN_OFS];
+  const uint8_t *payload = &frame[THUNDERVOLT_STREAM_PAYLOAD_OFS];
+
+  frames++;
+
+  // The sequence number restarts when the firmware boots
+  if (type == THUNDERVOLT_STREAM_BOOT) {
+    last_seq = -1;
+  } else if (last_seq >= 0 && seq != (uint8_t)(last_seq + 1)) {
+    uint8_t gap = seq - (uint8_t)(last_seq + 1);
+    fprintf(stderr, "lost %u frame(s) before seq %u\n", gap, seq);
+    lost += gap;
+  }
+  last_seq = seq;
+
+  if (len < THUNDERVOLT_STREAM_TIME + 4)
+    return;
+
+  switch (type) {
+    case THUNDERVOLT_STREAM_BOOT:
+      if (len >= THUNDERVOLT_STREAM_BOOT_SIZE)
+        fprintf(stderr, "boot: hardware revision %u, software revision %u\n",
+                payload[THUNDERVOLT_STREAM_BOOT_HW_REV], payload[THUNDERVOLT_STREAM_BOOT_SW_REV]);
+      printf("boot,%u,%u,,,,,,,,,,,,,,,,,\n", seq, get_time(payload));
+      break;
+    case THUNDERVOLT_STREAM_SAMPLE:
+      print_sample(seq, payload, len);
+      break;
+    case THUNDERVOLT_STREAM_OTSD:
+      if (len >= THUNDERVOLT_STREAM_OTSD_SIZE)
+        printf("otsd,%u,%u,,,,,,,,,,,,,,,,,%d\n", seq, get_time(payload),
+               (int8_t)payload[THUNDERVOLT_STREAM_OTSD_LIMIT]);
+      break;
+    case THUNDERVOLT_STREAM_WRITES:
+      for (uint8_t i = THUNDERVOLT_STREAM_WRITES_DATA; i + 1 < len; i += 2)
+        printf("write,%u,%u,,,,,,,,,,,,,,,0x%02X,0x%02X,\n", seq, get_time(payload), payload[i], payload[i + 1]);
+      break;
+    default:
+      fprintf(stderr, "unknown frame type 0x%02X\n", type);
+      break;
+  }
+
+  fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+  int fd = STDIN_FILENO;
+  if (argc > 1 && strcmp(argv[1], "-") != 0) {
+    if ((fd = open(argv[1], O_RDONLY | O_NOCTTY)) < 0) {
+      fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+      return 1;
+    }
+  }
+
+  if (isatty(fd) && configure_port(fd) < 0) {
+    fprintf(stderr, "failed to configure the serial port: %s\n", strerror(errno));
+    return 1;
+  }
+
+  print_header();
+
+  // Bytes received but not yet decoded, always starting at a sync byte once one has been found
+  uint8_t buf[FRAME_MAX * 2];
+  size_t used = 0;
+
+  while (1) {
+    ssize_t n = read(fd, &buf[used], sizeof(buf) - used);
+    if (n <= 0)
+      break;
+    used += n;
+
+    size_t pos = 0;
+    while (pos < used) {
+      // Skip to the next sync byte
+      if (buf[pos] != THUNDERVOLT_STREAM_SYNC) {
+        pos++;
+        continue;
+      }
+
+      // Wait for the rest of the header, and then the rest of the frame
+      if (used - pos < THUNDERVOLT_STREAM_PAYLOAD_OFS)
+        break;
+
+      uint8_t len = buf[pos + THUNDERVOLT_STREAM_LEN_OFS];
+      if (len > THUNDERVOLT_STREAM_MAX_PAYLOAD) {
+        pos++;
+        continue;
+      }
+
+      size_t frame_len = THUNDERVOLT_STREAM_OVERHEAD + len;
+      if (used - pos < frame_len)
+        break;
+
+      // Resynchronise from the next byte if the CRC doesn't match, the sync byte may have been data
+      uint8_t crc = crc8_update_buf(0, &buf[pos + THUNDERVOLT_STREAM_TYPE_OFS], frame_len - 2);
+      if (crc != buf[pos + frame_len - 1]) {
+        crc_errs++;
+        pos++;
+        continue;
+      }
+
+      handle_frame(&buf[pos]);
+      pos += frame_len;
+    }
+
+    memmove(buf, &buf[pos], used - pos);
+    used -= pos;
+  }
+
+  fprintf(stderr, "%lu frames, %lu lost, %lu CRC errors\n", frames, lost, crc_errs);
+
+  return 0;
+}
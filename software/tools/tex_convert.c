@@ -0,0 +1,210 @@
+/*
+ * Texture converter for the Thundervolt homebrew.
+ *
+ * Converts a PNG into a pre-swizzled GX texture, in the format from
+ * homebrew/source/gx_texture.h, so the homebrew can use it in place without
+ * decoding anything at startup. The smallest format that holds the image
+ * without loss is picked: I8 or IA8 for grey images, RGB5A3 if every visible
+ * texel fits it exactly, and RGBA8 otherwise.
+ *
+ * Build:  cc -O2 -I../homebrew/source -o tex_convert tex_convert.c `pkg-config libpng --cflags --libs`
+ * Usage:  ./tex_convert cursor.png cursor.tex
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <png.h>
+
+#include "gx_texture.h"
+
+static const char *FORMAT_NAMES[] = {
+    [GX_TEXTURE_I8] = "I8",
+    [GX_TEXTURE_IA8] = "IA8",
+    [GX_TEXTURE_RGB5A3] = "RGB5A3",
+    [GX_TEXTURE_RGBA8] = "RGBA8",
+};
+
+// Decoded image, 8-bit RGBA
+static uint8_t *pixels;
+static unsigned width, height;
+
+static void put_be16(uint8_t *buf, uint16_t value)
+{
+  buf[0] = value >> 8;
+  buf[1] = value & 0xFF;
+}
+
+static void put_be32(uint8_t *buf, uint32_t value)
+{
+  put_be16(buf, value >> 16);
+  put_be16(buf + 2, value & 0xFFFF);
+}
+
+static int load_png(const char *path)
+{
+  png_image image;
+  memset(&image, 0, sizeof(image));
+  image.version = PNG_IMAGE_VERSION;
+
+  if (!png_image_begin_read_from_file(&image, path)) {
+    fprintf(stderr, "failed to read %s: %s\n", path, image.message);
+    return -1;
+  }
+
+  image.format = PNG_FORMAT_RGBA;
+  width        = image.width;
+  height       = image.height;
+  pixels       = malloc(PNG_IMAGE_SIZE(image));
+  if (!png_image_finish_read(&image, NULL, pixels, 0, NULL)) {
+    fprintf(stderr, "failed to decode %s: %s\n", path, image.message);
+    return -1;
+  }
+
+  return 0;
+}
+
+static inline const uint8_t *pixel(unsigned x, unsigned y)
+{
+  static const uint8_t transparent[4] = {0, 0, 0, 0};
+  return x < width && y < height ? &pixels[(y * width + x) * 4] : transparent;
+}
+
+// Expand 3, 4 and 5 bit channels the way GX does
+static inline uint8_t expand3(uint8_t v)
+{
+  return (v << 5) | (v << 2) | (v >> 1);
+}
+
+static inline uint8_t expand4(uint8_t v)
+{
+  return (v << 4) | v;
+}
+
+static inline uint8_t expand5(uint8_t v)
+{
+  return (v << 3) | (v >> 2);
+}
+
+static uint16_t to_rgb5a3(const uint8_t *p)
+{
+  if (p[3] == 0xFF)
+    return 0x8000 | ((p[0] >> 3) << 10) | ((p[1] >> 3) << 5) | (p[2] >> 3);
+
+  return ((p[3] >> 5) << 12) | ((p[0] >> 4) << 8) | ((p[1] >> 4) << 4) | (p[2] >> 4);
+}
+
+// Check if a texel survives RGB5A3, fully transparent texels only need their alpha
+static bool fits_rgb5a3(const uint8_t *p)
+{
+  uint16_t v = to_rgb5a3(p);
+  if (v & 0x8000)
+    return expand5((v >> 10) & 0x1F) == p[0] && expand5((v >> 5) & 0x1F) == p[1] && expand5(v & 0x1F) == p[2];
+
+  if (expand3((v >> 12) & 0x7) != p[3])
+    return false;
+
+  return p[3] == 0 ||
+         (expand4((v >> 8) & 0xF) == p[0] && expand4((v >> 4) & 0xF) == p[1] && expand4(v & 0xF) == p[2]);
+}
+
+static uint8_t pick_format()
+{
+  bool grey = true, opaque = true, rgb5a3 = true;
+  for (unsigned i = 0; i < width * height; i++) {
+    const uint8_t *p = &pixels[i * 4];
+    grey &= p[0] == p[1] && p[1] == p[2];
+    opaque &= p[3] == 0xFF;
+    rgb5a3 &= fits_rgb5a3(p);
+  }
+
+  if (grey)
+    return opaque ? GX_TEXTURE_I8 : GX_TEXTURE_IA8;
+
+  return rgb5a3 ? GX_TEXTURE_RGB5A3 : GX_TEXTURE_RGBA8;
+}
+
+// Write the image swizzled into GX tiles, 8x4 texels for I8 and 4x4 for the others
+// Returns the number of bytes written
+static unsigned write_texture(uint8_t *out, uint8_t format)
+{
+  unsigned tile_w = format == GX_TEXTURE_I8 ? 8 : 4;
+  uint8_t *o      = out;
+
+  for (unsigned ty = 0; ty < height; ty += 4) {
+    for (unsigned tx = 0; tx < width; tx += tile_w) {
+      for (unsigned y = ty; y < ty + 4; y++) {
+        for (unsigned x = tx; x < tx + tile_w; x++) {
+          const uint8_t *p = pixel(x, y);
+          switch (format) {
+            case GX_TEXTURE_I8:
+              *o++ = p[0];
+              break;
+            case GX_TEXTURE_IA8:
+              *o++ = p[3];
+              *o++ = p[0];
+              break;
+            case GX_TEXTURE_RGB5A3:
+              put_be16(o, to_rgb5a3(p));
+              o += 2;
+              break;
+            case GX_TEXTURE_RGBA8:
+              // Alpha and red for the whole tile come first, then green and blue
+              o[0]  = p[3];
+              o[1]  = p[0];
+              o[32] = p[1];
+              o[33] = p[2];
+              o += 2;
+              break;
+          }
+        }
+      }
+
+      if (format == GX_TEXTURE_RGBA8)
+        o += 32;
+    }
+  }
+
+  return o - out;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <image.png> <texture.tex>\n", argv[0]);
+    return 1;
+  }
+
+  if (load_png(argv[1]) < 0)
+    return 1;
+
+  if (width > 1024 || height > 1024) {
+    fprintf(stderr, "%s is too large for GX: %ux%u\n", argv[1], width, height);
+    return 1;
+  }
+
+  // Header padded to 32 bytes, then the texture padded out to whole tiles (at most 4 bytes per texel)
+  uint8_t format       = pick_format();
+  unsigned data_offset = 32;
+  uint8_t *out         = calloc(1, data_offset + (width + 7) * (height + 3) * 4);
+
+  put_be32(out, GX_TEXTURE_MAGIC);
+  put_be16(out + 4, width);
+  put_be16(out + 6, height);
+  out[8] = format;
+  put_be16(out + 10, data_offset);
+
+  unsigned total = data_offset + write_texture(out + data_offset, format);
+
+  FILE *file = fopen(argv[2], "wb");
+  if (!file || fwrite(out, 1, total, file) != total || fclose(file) != 0) {
+    fprintf(stderr, "failed to write %s\n", argv[2]);
+    return 1;
+  }
+
+  printf("%ux%u %s, %u bytes\n", width, height, FORMAT_NAMES[format], total);
+  return 0;
+}